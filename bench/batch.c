@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Measures how the throughput of ejson_parse_batch scales with
+// the number of threads on a generated NDJSON log.
+
+static char *generate(size_t target, size_t *len)
+{
+    char *buf = malloc(target + 1024);
+    if (buf == NULL)
+        return NULL;
+
+    size_t num = 0;
+    for (int i = 0; num < target; i++)
+        num += sprintf(buf + num,
+            "{\"ts\": %d, \"level\": \"%s\", \"msg\": \"request %d served\", "
+            "\"latency\": %d.%d, \"tags\": [\"web\", \"eu-%d\"], \"ok\": %s}\n",
+            1700000000 + i, (i % 7) ? "info" : "warn", i,
+            i % 250, i % 10, i % 4, (i % 13) ? "true" : "false");
+    *len = num;
+    return buf;
+}
+
+int main(void)
+{
+    size_t len;
+    char *src = generate(256 << 20, &len);
+    if (src == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    long max = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max < 1) max = 1;
+
+    double base = 0;
+    printf("%8s %10s %8s\n", "threads", "MB/s", "speedup");
+    for (long threads = 1;; threads = (2 * threads < max) ? 2 * threads : max) {
+        ejson_batch batch;
+        double start = now();
+        bool ok = ejson_parse_batch(src, len, EJSON_BATCH_LINES, EJSON_DEFAULT_CONFIGS,
+                                    threads, &ejson_stdalloc, &batch);
+        double elapsed = now() - start;
+        if (!ok) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+        for (size_t i = 0; i < batch.count; i++)
+            if (batch.items[i].root == NULL) {
+                fprintf(stderr, "Error: %s\n", batch.items[i].error);
+                return -1;
+            }
+        ejson_batch_free(&batch);
+
+        double mbps = len / elapsed / 1e6;
+        if (threads == 1)
+            base = mbps;
+        printf("%8ld %10.1f %8.2f\n", threads, mbps, mbps / base);
+
+        if (threads == max)
+            break;
+    }
+
+    free(src);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef EJSON_BENCH_H
+#define EJSON_BENCH_H
+
+#include <time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Helpers shared by the benchmarks
+
+static inline double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Seeded generator, so that every run measures the same input
+static inline unsigned int next_random(unsigned int *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+// Growable buffer for generated sources
+typedef struct {
+    char  *data;
+    size_t size;
+    size_t max;
+} buffer_t;
+
+static inline void reserve(buffer_t *buf, size_t len)
+{
+    if (buf->size + len > buf->max) {
+        buf->max = 2 * (buf->size + len);
+        buf->data = realloc(buf->data, buf->max);
+        if (buf->data == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(-1);
+        }
+    }
+}
+
+static inline void append(buffer_t *buf, const char *str, size_t len)
+{
+    reserve(buf, len);
+    memcpy(buf->data + buf->size, str, len);
+    buf->size += len;
+}
+
+static inline void append_fmt(buffer_t *buf, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int num = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (num < 0) {
+        fprintf(stderr, "Error: Invalid format\n");
+        exit(-1);
+    }
+
+    // One more byte for the terminator vsnprintf writes
+    reserve(buf, num + 1);
+    va_start(args, fmt);
+    vsnprintf(buf->data + buf->size, num + 1, fmt, args);
+    va_end(args);
+    buf->size += num;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Diffs two versions of a large document that differ in a few places,
+// one of which shifts the items of an array, then applies the patch
+// to the first version and checks that it turns into the second.
+
+#define COUNT 200000
+
+// Document with COUNT items, where the item "skip" is left out and
+// the price of "bump" changed
+static size_t generate(char *dst, size_t cap, int skip, int bump)
+{
+    size_t len = snprintf(dst, cap, "{\"meta\": {\"version\": %d}, \"items\": [", skip < 0 ? 3 : 4);
+    bool first = true;
+    for (int i = 0; i < COUNT; i++) {
+        if (i == skip)
+            continue;
+        len += snprintf(dst + len, cap - len,
+            "%s{\"id\": %d, \"name\": \"item %d\", \"price\": %d.%02d, \"tags\": [\"a\", \"b\"]}",
+            first ? "" : ", ", i, i, i % 1000 + (i == bump), i % 100);
+        first = false;
+    }
+    len += snprintf(dst + len, cap - len, "]}");
+    return len;
+}
+
+int main(void)
+{
+    size_t cap = (size_t) COUNT * 96;
+    char *src1 = malloc(cap);
+    char *src2 = malloc(cap);
+    if (src1 == NULL || src2 == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    size_t len1 = generate(src1, cap, -1, -1);
+    size_t len2 = generate(src2, cap, COUNT / 3, COUNT / 2);
+
+    ejson_arena arena = {.allocator=&ejson_stdalloc};
+    ejson_error error;
+    double start = now();
+    ejson_value *from = ejson_parse(src1, len1, &error, &arena);
+    double parse_time = now() - start;
+    ejson_value *to   = ejson_parse(src2, len2, &error, &arena);
+    ejson_value *doc  = ejson_parse(src1, len1, &error, &arena);
+    if (from == NULL || to == NULL || doc == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    start = now();
+    ejson_value *patch = ejson_diff(from, to, &arena, NULL);
+    double diff_time = now() - start;
+    if (patch == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    start = now();
+    ejson_value *patch2 = ejson_diff(from, to, &arena, NULL);
+    double rediff_time = now() - start;
+
+    start = now();
+    bool ok = ejson_patch_apply(&doc, patch, &arena, NULL, &error);
+    double apply_time = now() - start;
+    if (!ok) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+    if (!ejson_valcmp2(doc, to, true) || !ejson_valcmp(patch, patch2)) {
+        fprintf(stderr, "Error: The patched document differs\n");
+        return -1;
+    }
+
+    char out[1024];
+    size_t num = ejson_print(patch, out, sizeof(out));
+    printf("patch:              %.*s%s\n", (int) (num < sizeof(out) ? num : sizeof(out)), out,
+           num < sizeof(out) ? "" : "...");
+    printf("ejson_parse:        %7.2f ms (%.1f MB)\n", parse_time * 1e3, len1 / 1e6);
+    printf("ejson_diff:         %7.2f ms\n", diff_time * 1e3);
+    printf("ejson_diff, hashed: %7.2f ms\n", rediff_time * 1e3);
+    printf("ejson_patch_apply:  %7.2f ms\n", apply_time * 1e3);
+
+    ejson_arena_free(&arena);
+    free(src1);
+    free(src2);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Edits a large indexed object in place: replaces values by key,
+// removes children and puts them back, and compares the cost of
+// each edit with parsing the document again.
+
+#define KEYS  100000
+#define EDITS 1000000
+
+int main(void)
+{
+    size_t cap = KEYS * 32;
+    char *src = malloc(cap);
+    if (src == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    size_t len = 0;
+    src[len++] = '{';
+    for (int i = 0; i < KEYS; i++)
+        len += snprintf(src + len, cap - len, "%s\"key%d\": %d", i ? ", " : "", i, i);
+    src[len++] = '}';
+
+    ejson_config config = EJSON_DEFAULT_CONFIGS;
+    config.key_index = EJSON_KEYINDEX_EAGER;
+
+    ejson_arena arena = {.allocator=&ejson_stdalloc};
+    ejson_error error;
+    double start = now();
+    ejson_value *root = ejson_parse2(src, len, NULL, &error, &arena, config);
+    double parse_time = now() - start;
+    if (root == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+    printf("parse:                   %7.2f ms\n", parse_time * 1e3);
+
+    srand(1);
+    start = now();
+    for (int i = 0; i < EDITS; i++) {
+        char key[32];
+        int n = snprintf(key, sizeof(key), "key%d", rand() % KEYS);
+        ejson_value *val = ejson_make_int(&arena, i);
+        if (val == NULL || !ejson_setbykey(root, key, n, val, &arena)) {
+            fprintf(stderr, "Error: Edit failed\n");
+            return -1;
+        }
+    }
+    double time = now() - start;
+    printf("ejson_setbykey:          %7.1f ns/edit\n", time / EDITS * 1e9);
+
+    start = now();
+    for (int i = 0; i < EDITS; i++) {
+        char key[32];
+        int n = snprintf(key, sizeof(key), "key%d", rand() % KEYS);
+        ejson_value *child = ejson_seekbykey2(root, key, n);
+        ejson_value *after = child->next ? child->next : root->when_array.head;
+        if (after == child)
+            continue;
+        ejson_remove(child);
+        if (!ejson_insert_before(after, child)) {
+            fprintf(stderr, "Error: Edit failed\n");
+            return -1;
+        }
+    }
+    time = now() - start;
+    printf("ejson_remove+insert:     %7.1f ns/edit\n", time / EDITS * 1e9);
+
+    if (root->when_array.size != KEYS || ejson_seekbykey(root, "key0") == NULL) {
+        fprintf(stderr, "Error: The object was damaged\n");
+        return -1;
+    }
+    printf("edits per parse:         %7.0f\n", parse_time / (time / EDITS));
+
+    ejson_arena_free(&arena);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Compares pulling three fields out of a 50 KB document by parsing
+// it whole and matching a pattern, and by ejson_parse_and_unpack.
+
+#define ROUNDS 2000
+
+static const char format[] = "{'meta': {'id': $n, 'owner': $s}, 'status': $s}";
+
+static size_t generate(char *buf, size_t target)
+{
+    size_t len = sprintf(buf, "{\"meta\": {\"id\": 42, \"owner\": \"alice\", \"labels\": [\"a\", \"b\"]}, \"events\": [");
+    for (int i = 0; len < target; i++)
+        len += sprintf(buf + len,
+            "%s{\"seq\": %d, \"kind\": \"update\", \"path\": \"/items/%d\", \"values\": [%d, %d, %d], \"ok\": true}",
+            i ? ", " : "", i, i, i, i+1, i+2);
+    len += sprintf(buf + len, "], \"status\": \"done\"}");
+    return len;
+}
+
+int main(void)
+{
+    static char src[64 << 10];
+    size_t len = generate(src, 50 << 10);
+
+    static char pool[1 << 20];
+    ejson_arena arena = {.base=pool, .size=sizeof(pool)};
+    ejson_error error;
+
+    ejson_pattern *pattern = ejson_pattern_compile(format, &error, &arena);
+    if (pattern == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+    size_t base = arena.used;
+
+    ejson_value *out[3];
+    size_t used_full = 0, used_lazy = 0;
+
+    double start = now();
+    for (int i = 0; i < ROUNDS; i++) {
+        arena.used = base;
+        ejson_value *val = ejson_parse(src, len, &error, &arena);
+        if (val == NULL || ejson_pattern_exec(pattern, val, out) != EJSON_MATCH) {
+            fprintf(stderr, "Error: No match\n");
+            return -1;
+        }
+        used_full = arena.used - base;
+    }
+    double full = (now() - start) / ROUNDS;
+
+    start = now();
+    for (int i = 0; i < ROUNDS; i++) {
+        arena.used = base;
+        if (ejson_parse_and_unpack(src, len, NULL, &error, &arena, EJSON_DEFAULT_CONFIGS, pattern, out) != EJSON_MATCH) {
+            fprintf(stderr, "Error: No match\n");
+            return -1;
+        }
+        used_lazy = arena.used - base;
+    }
+    double lazy = (now() - start) / ROUNDS;
+
+    printf("%-8s %10s %12s\n", "", "us/doc", "arena bytes");
+    printf("%-8s %10.1f %12zu\n", "full", full * 1e6, used_full);
+    printf("%-8s %10.1f %12zu\n", "lazy", lazy * 1e6, used_lazy);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Compares reading a file into the heap and parsing it with parsing
+// it from a mapping by ejson_parse_file, into growable arenas backed
+// by malloc and by huge pages.
+
+#define PATH "bench_file.json"
+
+static bool generate_file(size_t target)
+{
+    FILE *stream = fopen(PATH, "w");
+    if (stream == NULL)
+        return false;
+
+    unsigned int state = 1;
+    size_t size = fprintf(stream, "[");
+    for (int i = 0; size < target; i++)
+        size += fprintf(stream, "%s{\"id\": %d, \"name\": \"item %u\", \"score\": %.4f, \"ok\": %s}",
+                        i ? ",\n" : "", i, next_random(&state),
+                        (next_random(&state) % 1000000) / 1e4,
+                        next_random(&state) % 2 ? "true" : "false");
+    fprintf(stream, "]");
+    return fclose(stream) == 0;
+}
+
+static double run_read(const ejson_allocator *allocator)
+{
+    double start = now();
+
+    int fd = open(PATH, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        fprintf(stderr, "Error: Couldn't open the file\n");
+        exit(-1);
+    }
+    char *src = malloc(info.st_size);
+    if (src == NULL || read(fd, src, info.st_size) != info.st_size) {
+        fprintf(stderr, "Error: Couldn't read the file\n");
+        exit(-1);
+    }
+    close(fd);
+
+    ejson_error error;
+    ejson_arena arena = {.allocator=allocator};
+    if (ejson_parse(src, info.st_size, &error, &arena) == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        exit(-1);
+    }
+    double elapsed = now() - start;
+
+    ejson_arena_free(&arena);
+    free(src);
+    return elapsed;
+}
+
+static double run_mapped(const ejson_allocator *allocator)
+{
+    double start = now();
+
+    ejson_file file;
+    ejson_error error;
+    ejson_arena arena = {.allocator=allocator};
+    if (ejson_parse_file(PATH, &file, &error, &arena, EJSON_DEFAULT_CONFIGS) == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        exit(-1);
+    }
+    double elapsed = now() - start;
+
+    ejson_arena_free(&arena);
+    ejson_file_close(&file);
+    return elapsed;
+}
+
+int main(void)
+{
+    if (!generate_file(128 << 20)) {
+        fprintf(stderr, "Error: Couldn't write the file\n");
+        return -1;
+    }
+
+    // Best of a few rounds, with the file in the page cache
+    double best[4] = {1e9, 1e9, 1e9, 1e9};
+    for (int i = 0; i < 3; i++) {
+        double t[4] = {
+            run_read(&ejson_stdalloc),
+            run_read(&ejson_hugealloc),
+            run_mapped(&ejson_stdalloc),
+            run_mapped(&ejson_hugealloc),
+        };
+        for (int j = 0; j < 4; j++)
+            if (t[j] < best[j])
+                best[j] = t[j];
+    }
+    printf("read + ejson_parse:              %7.1f ms\n", best[0] * 1e3);
+    printf("read + ejson_parse (huge pages): %7.1f ms\n", best[1] * 1e3);
+    printf("ejson_parse_file:                %7.1f ms\n", best[2] * 1e3);
+    printf("ejson_parse_file (huge pages):   %7.1f ms\n", best[3] * 1e3);
+
+    unlink(PATH);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Measures ejson_hash on a set of records, then compares every
+// record with the next one, which differs from it only in its last
+// value, with and without the hashes cached.
+
+#define COUNT 100000
+
+int main(void)
+{
+    ejson_arena arena = {.allocator=&ejson_stdalloc};
+    ejson_value **records = malloc(COUNT * sizeof(ejson_value*));
+    if (records == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < COUNT; i++) {
+        char src[512];
+        int len = snprintf(src, sizeof(src),
+            "{\"user\": {\"name\": \"someone\", \"roles\": [\"admin\", \"dev\"], \"age\": 42},"
+            " \"items\": [1, 2, 3, 4, 5, 6, 7, 8], \"notes\": \"the same for every record\","
+            " \"seq\": %d}", i);
+        ejson_error error;
+        records[i] = ejson_parse(src, len, &error, &arena);
+        if (records[i] == NULL) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            return -1;
+        }
+        total += len;
+    }
+
+    size_t equal = 0;
+    double start = now();
+    for (int i = 0; i + 1 < COUNT; i++)
+        equal += ejson_valcmp(records[i], records[i+1]);
+    printf("ejson_valcmp:           %7.1f M pairs/s\n", (COUNT - 1) / (now() - start) / 1e6);
+
+    uint64_t sum = 0;
+    start = now();
+    for (int i = 0; i < COUNT; i++)
+        sum += ejson_hash(records[i]);
+    printf("ejson_hash:             %7.1f MB/s\n", total / (now() - start) / 1e6);
+
+    size_t equal2 = 0;
+    start = now();
+    for (int i = 0; i + 1 < COUNT; i++)
+        equal2 += ejson_valcmp(records[i], records[i+1]);
+    printf("ejson_valcmp (hashed):  %7.1f M pairs/s\n", (COUNT - 1) / (now() - start) / 1e6);
+
+    start = now();
+    for (int i = 0; i + 1 < COUNT; i++)
+        equal2 += ejson_valcmp2(records[i], records[i+1], true);
+    printf("ejson_valcmp2 (hashed): %7.1f M pairs/s\n", (COUNT - 1) / (now() - start) / 1e6);
+
+    if (sum == 0 || 2 * equal != equal2) {
+        fprintf(stderr, "Error: The results differ\n");
+        return -1;
+    }
+
+    ejson_arena_free(&arena);
+    free(records);
+    return 0;
+}
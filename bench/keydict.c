@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Handles a stream of messages with the same keys, parsing each one
+// into the same arena and reading a few of its fields, with plain
+// keys and with a key dictionary.
+
+#define COUNT 200000
+#define ROUNDS 5
+
+static const char *fields[] = {
+    "timestamp", "service", "endpoint", "status", "latency_ms",
+    "request_id", "user_agent", "bytes_sent", "bytes_received", "region",
+};
+
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+// Best rate over a few rounds in M messages/s. Fields are read
+// by interned key when "interned" is set.
+static double run(char **srcs, size_t *lens, ejson_config config,
+                  const char **interned, long long *sum)
+{
+    static char mem[1 << 16];
+    ejson_arena arena = {.base=mem, .size=sizeof(mem)};
+
+    double best = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        *sum = 0;
+        double start = now();
+        for (int i = 0; i < COUNT; i++) {
+            ejson_error error;
+            arena.used = 0;
+            ejson_value *root = ejson_parse2(srcs[i], lens[i], NULL, &error, &arena, config);
+            if (root == NULL) {
+                fprintf(stderr, "Error: %s\n", error.msg);
+                exit(-1);
+            }
+            for (size_t j = NUM_FIELDS - 3; j < NUM_FIELDS; j++) {
+                ejson_value *val = interned
+                    ? ejson_seekbyinterned(root, interned[j])
+                    : ejson_seekbykey(root, fields[j]);
+                *sum += val->when_number.as_int;
+            }
+        }
+        double rate = COUNT / (now() - start) / 1e6;
+        if (rate > best)
+            best = rate;
+    }
+    return best;
+}
+
+int main(void)
+{
+    char  **srcs = malloc(COUNT * sizeof(char*));
+    size_t *lens = malloc(COUNT * sizeof(size_t));
+    if (srcs == NULL || lens == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    for (int i = 0; i < COUNT; i++) {
+        char buf[1024];
+        size_t len = 0;
+        buf[len++] = '{';
+        for (size_t j = 0; j < NUM_FIELDS; j++)
+            len += snprintf(buf + len, sizeof(buf) - len, "%s\"%s\": %d",
+                            j ? ", " : "", fields[j], i * 7 + (int) j);
+        buf[len++] = '}';
+        srcs[i] = malloc(len);
+        if (srcs[i] == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+        memcpy(srcs[i], buf, len);
+        lens[i] = len;
+    }
+
+    long long sum, sum2;
+    ejson_config config = EJSON_DEFAULT_CONFIGS;
+    printf("plain keys:     %6.2f M messages/s\n", run(srcs, lens, config, NULL, &sum));
+
+    config.key_dict = ejson_keydict_create(1024, NULL);
+    if (config.key_dict == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    const char *interned[NUM_FIELDS];
+    for (size_t j = 0; j < NUM_FIELDS; j++)
+        interned[j] = ejson_keydict_intern(config.key_dict, fields[j], strlen(fields[j]));
+    printf("key dictionary: %6.2f M messages/s\n", run(srcs, lens, config, interned, &sum2));
+
+    if (sum != sum2) {
+        fprintf(stderr, "Error: The results differ\n");
+        return -1;
+    }
+
+    ejson_keydict_free(config.key_dict);
+    for (int i = 0; i < COUNT; i++)
+        free(srcs[i]);
+    free(srcs);
+    free(lens);
+    return 0;
+}
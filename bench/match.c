@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Compares matching the same format against many messages with
+// ejson_match_and_unpack and with a compiled pattern.
+
+#define MESSAGES 1000000
+
+static const char format[] = "{'type': 'order', 'id': $n, 'user': {'name': $s}, 'items': $a}";
+
+int main(void)
+{
+    static const char src[] =
+        "{\"type\": \"order\", \"id\": 1234, \"status\": \"paid\", "
+        "\"user\": {\"name\": \"alice\", \"country\": \"it\"}, "
+        "\"items\": [{\"sku\": \"a-1\", \"qty\": 2}], \"total\": 19.5}";
+
+    static char pool[1 << 16];
+    ejson_arena arena = {.base=pool, .size=sizeof(pool)};
+    ejson_error error;
+
+    ejson_value *val = ejson_parse(src, sizeof(src)-1, &error, &arena);
+    ejson_pattern *pattern = ejson_pattern_compile(format, &error, &arena);
+    if (val == NULL || pattern == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    ejson_value *out[3];
+    size_t matched = 0;
+
+    double start = now();
+    for (int i = 0; i < MESSAGES; i++)
+        matched += ejson_match_and_unpack(val, format, out) == EJSON_MATCH;
+    double interpreted = now() - start;
+
+    start = now();
+    for (int i = 0; i < MESSAGES; i++)
+        matched += ejson_pattern_exec(pattern, val, out) == EJSON_MATCH;
+    double compiled = now() - start;
+
+    if (matched != 2 * MESSAGES) {
+        fprintf(stderr, "Error: No match\n");
+        return -1;
+    }
+
+    printf("%-12s %10.1f ns/match\n", "interpreted", interpreted / MESSAGES * 1e9);
+    printf("%-12s %10.1f ns/match\n", "compiled",    compiled    / MESSAGES * 1e9);
+    return 0;
+}
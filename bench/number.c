@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+#include "number.h"
+
+// Measures the parsing throughput of a GeoJSON-like document made
+// mostly of coordinates, and the conversion rate of its numbers by
+// ejson_parse_number compared to strtod.
+
+static void append_str(buffer_t *buf, const char *str)
+{
+    append(buf, str, strlen(str));
+}
+
+// Polygons with a ring of points each, printed with
+// the full precision of doubles like map exports do.
+static void generate_geojson(buffer_t *buf, buffer_t *nums, size_t target)
+{
+    unsigned int state = 1;
+    char tmp[64];
+
+    append_str(buf, "{\"type\": \"FeatureCollection\", \"features\": [");
+    for (int i = 0; buf->size < target; i++) {
+        if (i > 0) append_str(buf, ", ");
+        append_str(buf, "{\"type\": \"Feature\", \"geometry\": {\"type\": \"Polygon\", \"coordinates\": [[");
+        double lon = -180.0 + 360.0 * (next_random(&state) % 1000000) / 1e6;
+        double lat =  -90.0 + 180.0 * (next_random(&state) % 1000000) / 1e6;
+        for (int j = 0; j < 32; j++) {
+            double x = lon + (next_random(&state) % 10000) / 1e6;
+            double y = lat + (next_random(&state) % 10000) / 1e6;
+            int n = snprintf(tmp, sizeof(tmp), "%s[%.17g, %.17g]", j ? ", " : "", x, y);
+            append(buf, tmp, n);
+
+            n = snprintf(tmp, sizeof(tmp), "%.17g", x);
+            append(nums, tmp, n+1);
+            n = snprintf(tmp, sizeof(tmp), "%.17g", y);
+            append(nums, tmp, n+1);
+        }
+        append_str(buf, "]]}, \"properties\": {\"id\": ");
+        int n = snprintf(tmp, sizeof(tmp), "%d", i);
+        append(buf, tmp, n);
+        append_str(buf, "}}");
+    }
+    append_str(buf, "]}");
+}
+
+static double run_parse(buffer_t *buf, ejson_arena *arena, int rounds)
+{
+    double best = 0;
+    for (int i = 0; i < rounds; i++) {
+        ejson_error error;
+        arena->used = 0;
+        double start = now();
+        ejson_value *val = ejson_parse(buf->data, buf->size, &error, arena);
+        double elapsed = now() - start;
+        if (val == NULL) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            exit(-1);
+        }
+        double mbps = buf->size / elapsed / 1e6;
+        if (mbps > best)
+            best = mbps;
+    }
+    return best;
+}
+
+// The numbers are stored one after the other, each
+// followed by its null terminator.
+static double run_numbers(buffer_t *nums, size_t count, int use_strtod, double *sum)
+{
+    double start = now();
+    double total = 0;
+    for (size_t cur = 0; cur < nums->size; ) {
+        const char *str = nums->data + cur;
+        size_t len = strlen(str);
+        if (use_strtod)
+            total += strtod(str, NULL);
+        else {
+            size_t end;
+            ejson_number num;
+            ejson_parse_number(str, len, &end, &num);
+            total += num.as_flt;
+        }
+        cur += len + 1;
+    }
+    *sum = total;
+    return count / (now() - start) / 1e6;
+}
+
+int main(void)
+{
+    buffer_t doc = {0}, nums = {0};
+    generate_geojson(&doc, &nums, 64 << 20);
+
+    size_t count = 0;
+    for (size_t i = 0; i < nums.size; i++)
+        if (nums.data[i] == '\0')
+            count++;
+
+    ejson_arena arena;
+    arena.size = 8 * doc.size;
+    arena.used = 0;
+    arena.base = malloc(arena.size);
+    if (arena.base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    printf("ejson_parse:       %8.1f MB/s\n", run_parse(&doc, &arena, 5));
+
+    double a, b;
+    double ours   = run_numbers(&nums, count, 0, &a);
+    double theirs = run_numbers(&nums, count, 1, &b);
+    printf("ejson_parse_number: %7.1f M numbers/s\n", ours);
+    printf("strtod:             %7.1f M numbers/s\n", theirs);
+    if (a != b) {
+        fprintf(stderr, "Error: The results differ\n");
+        return -1;
+    }
+
+    free(arena.base);
+    free(doc.data);
+    free(nums.data);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Measures how the throughput of ejson_parse_parallel scales with
+// the number of threads on one large exported array, into both a
+// fixed and a growable arena.
+
+static char *generate(size_t target, size_t *len)
+{
+    char *buf = malloc(target + 1024);
+    if (buf == NULL)
+        return NULL;
+
+    size_t num = sprintf(buf, "[");
+    for (int i = 0; num < target; i++)
+        num += sprintf(buf + num,
+            "%s\n  {\"id\": %d, \"name\": \"user %d\", \"email\": \"user%d@example.com\", "
+            "\"score\": %d.%d, \"roles\": [\"read\", \"write\"], \"active\": %s}",
+            i ? "," : "", i, i, i, i % 100, i % 10, (i % 3) ? "true" : "false");
+    num += sprintf(buf + num, "\n]\n");
+    *len = num;
+    return buf;
+}
+
+static double run(const char *src, size_t len, ejson_arena *arena, size_t threads)
+{
+    ejson_error error;
+    double start = now();
+    ejson_value *root = ejson_parse_parallel(src, len, NULL, &error, arena,
+        EJSON_DEFAULT_CONFIGS, threads, &ejson_stdalloc);
+    double elapsed = now() - start;
+    if (root == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        exit(-1);
+    }
+    return len / elapsed / 1e6;
+}
+
+int main(void)
+{
+    size_t len;
+    char *src = generate(128 << 20, &len);
+    if (src == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    ejson_arena fixed = {0};
+    fixed.size = 8 * len;
+    fixed.base = malloc(fixed.size);
+    if (fixed.base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    // Touch the pages once so that the first run isn't penalized
+    memset(fixed.base, 0, fixed.size);
+
+    long max = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max < 1) max = 1;
+
+    double base = 0;
+    printf("%8s %12s %12s %8s\n", "threads", "fixed MB/s", "grow MB/s", "speedup");
+    for (long threads = 1;; threads = (2 * threads < max) ? 2 * threads : max) {
+
+        fixed.used = 0;
+        double a = run(src, len, &fixed, threads);
+
+        ejson_arena grow = {.allocator=&ejson_stdalloc};
+        double b = run(src, len, &grow, threads);
+        ejson_arena_free(&grow);
+
+        if (threads == 1)
+            base = a;
+        printf("%8ld %12.1f %12.1f %8.2f\n", threads, a, b, a / base);
+
+        if (threads == max)
+            break;
+    }
+
+    free(fixed.base);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+#include "arena.h"
+
+// Looks up a few paths in a large document: one at a time with
+// ejson_seekbypointer, all together with a compiled path set, and
+// while parsing with ejson_parse_paths, which skips what the paths
+// don't lead to.
+
+#define COUNT  50000
+#define ROUNDS 5
+
+static const char *paths[] = {
+    "/search_metadata/count",
+    "/statuses/0/id",
+    "/statuses/0/user/screen_name",
+    "/statuses/100/text",
+    "/statuses/100/entities/hashtags/1",
+    "/statuses/1000/user/followers_count",
+    "/statuses/1000/retweeted",
+    "/statuses/20000/user/name",
+};
+
+#define NUM_PATHS (sizeof(paths) / sizeof(paths[0]))
+
+int main(void)
+{
+    size_t cap = (size_t) COUNT * 320;
+    char *src = malloc(cap);
+    if (src == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    size_t len = snprintf(src, cap, "{\"statuses\": [");
+    for (int i = 0; i < COUNT; i++)
+        len += snprintf(src + len, cap - len,
+            "%s{\"id\": %d, \"text\": \"Status number %d, with some text in it\", "
+            "\"user\": {\"id\": %d, \"name\": \"User %d\", \"screen_name\": \"user%d\", "
+            "\"followers_count\": %d}, \"entities\": {\"hashtags\": [\"a\", \"b\", \"c\"], "
+            "\"urls\": []}, \"retweeted\": %s, \"favorite_count\": %d}",
+            i ? ", " : "", i, i, i % 977, i % 977, i % 977, i * 7 % 10000,
+            i % 3 ? "false" : "true", i % 50);
+    len += snprintf(src + len, cap - len, "], \"search_metadata\": {\"count\": %d}}", COUNT);
+
+    ejson_arena arena = {.allocator=&ejson_stdalloc};
+    ejson_error error;
+    ejson_pathset *set = ejson_pathset_compile(paths, NUM_PATHS, &error, &arena);
+    if (set == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    double parse_best  = 1e9;
+    double seek_best   = 1e9;
+    double exec_best   = 1e9;
+    double stream_best = 1e9;
+    for (int r = 0; r < ROUNDS; r++) {
+        ejson_arena_mark save = ejson_arena_save(&arena);
+
+        double start = now();
+        ejson_value *root = ejson_parse(src, len, &error, &arena);
+        double time = now() - start;
+        if (root == NULL) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            return -1;
+        }
+        if (time < parse_best) parse_best = time;
+
+        ejson_value *seek[NUM_PATHS];
+        start = now();
+        for (size_t i = 0; i < NUM_PATHS; i++)
+            seek[i] = ejson_seekbypointer(root, paths[i], strlen(paths[i]));
+        time = now() - start;
+        if (time < seek_best) seek_best = time;
+
+        ejson_value *exec[NUM_PATHS];
+        start = now();
+        ejson_pathset_exec(set, root, exec);
+        time = now() - start;
+        if (time < exec_best) exec_best = time;
+
+        ejson_value *stream[NUM_PATHS];
+        start = now();
+        if (!ejson_parse_paths(src, len, NULL, &error, &arena, EJSON_DEFAULT_CONFIGS, set, stream)) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            return -1;
+        }
+        time = now() - start;
+        if (time < stream_best) stream_best = time;
+
+        for (size_t i = 0; i < NUM_PATHS; i++) {
+            if (seek[i] == NULL || seek[i] != exec[i] || !ejson_valcmp(seek[i], stream[i])) {
+                fprintf(stderr, "Error: The results of \"%s\" differ\n", paths[i]);
+                return -1;
+            }
+        }
+        ejson_arena_restore(&arena, save);
+    }
+
+    printf("ejson_parse:          %8.3f ms (%.1f MB)\n", parse_best * 1e3, len / 1e6);
+    printf("ejson_seekbypointer:  %8.3f ms (%zu paths)\n", seek_best * 1e3, NUM_PATHS);
+    printf("ejson_pathset_exec:   %8.3f ms\n", exec_best * 1e3);
+    printf("ejson_parse_paths:    %8.3f ms\n", stream_best * 1e3);
+
+    ejson_arena_free(&arena);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+#include "number.h"
+
+// Measures the printing throughput of a document made of numbers,
+// into a fixed buffer and through ejson_write into a growable one,
+// and the formatting rate of doubles by ejson_format_double compared
+// to snprintf with enough digits to round trip. Then compares printing
+// a document of long strings, a few of which need escaping, with
+// copying it.
+
+#define COUNT (1 << 20)
+
+// Best rate of ejson_print over a few rounds, in MB/s
+static double print_rate(ejson_value *val, char *dst, size_t max)
+{
+    double best = 0;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        size_t out = ejson_print(val, dst, max);
+        double mbps = out / (now() - start) / 1e6;
+        if (out >= max) {
+            fprintf(stderr, "Error: Output truncated\n");
+            exit(-1);
+        }
+        if (mbps > best)
+            best = mbps;
+    }
+    return best;
+}
+
+int main(void)
+{
+    static double values[COUNT];
+    unsigned int state = 1;
+    for (int i = 0; i < COUNT; i++) {
+        double x = (next_random(&state) % 100000000) / 1e5;
+        values[i] = (i % 4 == 0) ? (double) (int) x : x;
+    }
+
+    // Array of pairs of numbers, like coordinates
+    size_t max = (size_t) COUNT * 32;
+    char *src = malloc(max);
+    char *dst = malloc(max);
+    if (src == NULL || dst == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    size_t len = 0;
+    src[len++] = '[';
+    for (int i = 0; i < COUNT; i += 2) {
+        if (i > 0) src[len++] = ',';
+        len += snprintf(src + len, max - len, "[%.17g,%.17g]", values[i], values[i+1]);
+    }
+    src[len++] = ']';
+
+    ejson_arena arena;
+    arena.size = 16 * len;
+    arena.used = 0;
+    arena.base = malloc(arena.size);
+    if (arena.base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    ejson_error error;
+    ejson_value *val = ejson_parse(src, len, &error, &arena);
+    if (val == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    printf("ejson_print:         %7.1f MB/s\n", print_rate(val, dst, max));
+
+    double best = 0;
+    for (int i = 0; i < 5; i++) {
+        ejson_buffer buf = {0};
+        double start = now();
+        if (!ejson_write(val, ejson_bufwriter, &buf, EJSON_DEFAULT_WRITEOPTS)) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return -1;
+        }
+        double mbps = buf.size / (now() - start) / 1e6;
+        if (mbps > best)
+            best = mbps;
+        ejson_buffer_free(&buf);
+    }
+    printf("ejson_write:         %7.1f MB/s\n", best);
+
+    char buf[64];
+    size_t total = 0;
+    double start = now();
+    for (int i = 0; i < COUNT; i++)
+        total += ejson_format_double(values[i], buf);
+    printf("ejson_format_double: %7.1f M numbers/s\n", COUNT / (now() - start) / 1e6);
+
+    start = now();
+    for (int i = 0; i < COUNT; i++)
+        total += snprintf(buf, sizeof(buf), "%.17g", values[i]);
+    printf("snprintf(\"%%.17g\"):   %7.1f M numbers/s\n", COUNT / (now() - start) / 1e6);
+
+    if (total == 0)
+        return -1;
+
+    // Strings of text, one in 16 with a quote
+    static const char words[] = "lorem ipsum dolor sit amet consectetur adipiscing elit sed do ";
+    len = 0;
+    src[len++] = '[';
+    for (int i = 0; len + 4200 < max / 2; i++) {
+        if (i > 0) src[len++] = ',';
+        src[len++] = '"';
+        size_t size = 256 + (i * 7919) % 3840;
+        for (size_t j = 0; j < size; j++)
+            src[len++] = words[(i + j) % (sizeof(words)-1)];
+        if (i % 16 == 0) {
+            src[len++] = '\\';
+            src[len++] = '"';
+        }
+        src[len++] = '"';
+    }
+    src[len++] = ']';
+
+    arena.used = 0;
+    val = ejson_parse(src, len, &error, &arena);
+    if (val == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+    printf("ejson_print strings: %7.1f MB/s\n", print_rate(val, dst, max));
+
+    best = 0;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        memcpy(dst, src, len);
+        double mbps = len / (now() - start) / 1e6;
+        if (mbps > best)
+            best = mbps;
+    }
+    printf("memcpy:              %7.1f MB/s\n", best);
+
+    free(arena.base);
+    free(src);
+    free(dst);
+    return 0;
+}
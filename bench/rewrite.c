@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Read-modify-write of a large document: parses it, edits one value
+// deep inside, and writes it back with and without copying the
+// unedited values from the source, next to a plain copy of the
+// source.
+
+#define COUNT 200000
+
+// Best time of writing the document over a few rounds
+static double write_time(ejson_value *root, ejson_buffer *out, bool verbatim)
+{
+    ejson_writeopts opts = EJSON_DEFAULT_WRITEOPTS;
+    opts.verbatim = verbatim;
+
+    double best = 1e9;
+    for (int i = 0; i < 5; i++) {
+        out->size = 0;
+        double start = now();
+        if (!ejson_write(root, ejson_bufwriter, out, opts)) {
+            fprintf(stderr, "Out of memory\n");
+            exit(-1);
+        }
+        double time = now() - start;
+        if (time < best)
+            best = time;
+    }
+    return best;
+}
+
+int main(void)
+{
+    size_t cap = (size_t) COUNT * 128;
+    char *src = malloc(cap);
+    char *dst = malloc(cap);
+    if (src == NULL || dst == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    size_t len = snprintf(src, cap, "{\n  \"meta\": {\"version\": 3, \"updated\": \"yesterday\"},\n  \"items\": [\n");
+    for (int i = 0; i < COUNT; i++)
+        len += snprintf(src + len, cap - len,
+            "    {\"id\": %d, \"name\": \"item %d\", \"price\": %d.%02d, \"tags\": [\"a\", \"b\"]}%s\n",
+            i, i, i % 1000, i % 100, i+1 < COUNT ? "," : "");
+    len += snprintf(src + len, cap - len, "  ]\n}\n");
+
+    ejson_arena arena = {.allocator=&ejson_stdalloc};
+    ejson_error error;
+    ejson_value *root = ejson_parse2(src, len, NULL, &error, &arena, EJSON_DEFAULT_CONFIGS);
+    if (root == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    // Change the price of an item in the middle
+    ejson_value *items = ejson_seekbykey(root, "items");
+    ejson_value *item  = ejson_seekbyindex(items, COUNT / 2);
+    ejson_value *price = ejson_make_float(&arena, 9.99);
+    if (price == NULL || !ejson_setbykey(item, "price", 5, price, &arena)) {
+        fprintf(stderr, "Error: Edit failed\n");
+        return -1;
+    }
+
+    ejson_buffer out = {0};
+    double best = 1e9;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        memcpy(dst, src, len);
+        double time = now() - start;
+        if (time < best)
+            best = time;
+    }
+    printf("memcpy of the source:  %7.2f ms (%.1f MB)\n", best * 1e3, len / 1e6);
+    printf("ejson_write:           %7.2f ms\n", write_time(root, &out, false) * 1e3);
+    printf("ejson_write verbatim:  %7.2f ms\n", write_time(root, &out, true) * 1e3);
+
+    ejson_value *copy = ejson_parse2(out.data, out.size, NULL, &error, &arena, EJSON_DEFAULT_CONFIGS);
+    if (copy == NULL || !ejson_valcmp(copy, root)) {
+        fprintf(stderr, "Error: The output differs\n");
+        return -1;
+    }
+
+    ejson_buffer_free(&out);
+    ejson_arena_free(&arena);
+    free(src);
+    free(dst);
+    return 0;
+}
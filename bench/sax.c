@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Measures the throughput of ejson_sax counting the values of a
+// document of log records, compared to building the tree with
+// ejson_parse, and how much arena the tree would have needed.
+
+static void generate_records(buffer_t *buf, size_t target)
+{
+    static const char *levels[] = {"debug", "info", "warning", "error"};
+    unsigned int state = 1;
+    char tmp[256];
+
+    append(buf, "[", 1);
+    for (int i = 0; buf->size < target; i++) {
+        if (i > 0) append(buf, ",\n", 2);
+        int n = snprintf(tmp, sizeof(tmp),
+            "{\"id\": %d, \"level\": \"%s\", \"latency\": %.3f, \"cached\": %s, "
+            "\"user\": null, \"tags\": [\"svc-%u\", \"zone-%u\"], \"msg\": \"request \\\"%u\\\" done\"}",
+            i, levels[next_random(&state) % 4], (next_random(&state) % 100000) / 7.0,
+            next_random(&state) % 2 ? "true" : "false", next_random(&state) % 64,
+            next_random(&state) % 8, next_random(&state));
+        append(buf, tmp, n);
+    }
+    append(buf, "]", 1);
+}
+
+static bool count_event(void *userp)
+{
+    (*(size_t*) userp)++;
+    return true;
+}
+
+static bool count_string(void *userp, ejson_string str, bool escaped)
+{
+    (void) str;
+    (void) escaped;
+    (*(size_t*) userp)++;
+    return true;
+}
+
+static bool count_number(void *userp, ejson_number num)
+{
+    (void) num;
+    (*(size_t*) userp)++;
+    return true;
+}
+
+static bool count_boolean(void *userp, bool value)
+{
+    (void) value;
+    (*(size_t*) userp)++;
+    return true;
+}
+
+int main(void)
+{
+    buffer_t doc = {0};
+    generate_records(&doc, 64 << 20);
+
+    size_t count = 0;
+    ejson_handler handler = {
+        .begin_object = count_event,
+        .begin_array  = count_event,
+        .string       = count_string,
+        .number       = count_number,
+        .boolean      = count_boolean,
+        .null         = count_event,
+        .userp        = &count,
+    };
+
+    double best = 0;
+    for (int i = 0; i < 5; i++) {
+        ejson_error error;
+        count = 0;
+        double start = now();
+        if (ejson_sax(doc.data, doc.size, NULL, &error, EJSON_DEFAULT_CONFIGS, &handler) != EJSON_SAX_DONE) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            return -1;
+        }
+        double mbps = doc.size / (now() - start) / 1e6;
+        if (mbps > best)
+            best = mbps;
+    }
+    printf("ejson_sax:   %7.1f MB/s (%zu values, no arena)\n", best, count);
+
+    size_t nodes, bytes;
+    ejson_error error;
+    if (!ejson_measure(doc.data, doc.size, NULL, &error, EJSON_DEFAULT_CONFIGS, &nodes, &bytes)) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    ejson_arena arena;
+    arena.size = bytes;
+    arena.used = 0;
+    arena.base = malloc(arena.size);
+    if (arena.base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    best = 0;
+    for (int i = 0; i < 5; i++) {
+        arena.used = 0;
+        double start = now();
+        if (ejson_parse(doc.data, doc.size, &error, &arena) == NULL) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            return -1;
+        }
+        double mbps = doc.size / (now() - start) / 1e6;
+        if (mbps > best)
+            best = mbps;
+    }
+    printf("ejson_parse: %7.1f MB/s (%zu values, %zu MB of arena)\n", best, nodes, bytes >> 20);
+
+    free(arena.base);
+    free(doc.data);
+    return 0;
+}
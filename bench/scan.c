@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+#include "scan.h"
+
+// Measures the parsing throughput of whitespace-heavy and string-heavy
+// inputs with each of the scanning kernels available on this machine.
+
+static void append_indent(buffer_t *buf, int depth)
+{
+    append(buf, "\n", 1);
+    for (int i = 0; i < depth; i++)
+        append(buf, "        ", 8);
+}
+
+// Pretty-printed records nested a few levels deep, so that
+// most of the input is indentation.
+static void generate_spaces(buffer_t *buf, size_t target)
+{
+    append(buf, "[", 1);
+    for (int i = 0; buf->size < target; i++) {
+        if (i > 0) append(buf, ",", 1);
+        append_indent(buf, 1);
+        append(buf, "{", 1);
+        append_indent(buf, 2);
+        append(buf, "\"id\": 1234,", 11);
+        append_indent(buf, 2);
+        append(buf, "\"tags\": [", 9);
+        for (int j = 0; j < 4; j++) {
+            if (j > 0) append(buf, ",", 1);
+            append_indent(buf, 3);
+            append(buf, "{", 1);
+            append_indent(buf, 4);
+            append(buf, "\"ok\": true", 10);
+            append_indent(buf, 3);
+            append(buf, "}", 1);
+        }
+        append_indent(buf, 2);
+        append(buf, "]", 1);
+        append_indent(buf, 1);
+        append(buf, "}", 1);
+    }
+    append_indent(buf, 0);
+    append(buf, "]", 1);
+}
+
+// Arrays of long strings, as found in documents
+// carrying text or encoded blobs.
+static void generate_strings(buffer_t *buf, size_t target)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    append(buf, "[", 1);
+    for (int i = 0; buf->size < target; i++) {
+        if (i > 0) append(buf, ",", 1);
+        append(buf, "{\"key\": \"", 9);
+        size_t len = 64 + (i * 7919) % 1024;
+        for (size_t j = 0; j < len; j++)
+            append(buf, &alphabet[(i + j * 31) % (sizeof(alphabet)-1)], 1);
+        append(buf, "\"}", 2);
+    }
+    append(buf, "]", 1);
+}
+
+static double run(buffer_t *buf, ejson_arena *arena, int rounds)
+{
+    double best = 0;
+    for (int i = 0; i < rounds; i++) {
+        ejson_error error;
+        arena->used = 0;
+        double start = now();
+        ejson_value *val = ejson_parse(buf->data, buf->size, &error, arena);
+        double elapsed = now() - start;
+        if (val == NULL) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            exit(-1);
+        }
+        double gbps = buf->size / elapsed / 1e9;
+        if (gbps > best)
+            best = gbps;
+    }
+    return best;
+}
+
+int main(void)
+{
+    static const char *level_names[] = {
+        [EJSON_SCAN_SCALAR] = "scalar",
+        [EJSON_SCAN_SSE2]   = "sse2",
+        [EJSON_SCAN_AVX2]   = "avx2",
+    };
+    size_t target = 64 << 20;
+
+    buffer_t spaces = {0}, strings = {0};
+    generate_spaces(&spaces, target);
+    generate_strings(&strings, target);
+
+    ejson_arena arena;
+    arena.size = 256 << 20;
+    arena.used = 0;
+    arena.base = malloc(arena.size);
+    if (arena.base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    printf("%-8s %12s %12s\n", "kernel", "spaces GB/s", "strings GB/s");
+    for (ejson_scan_level level = EJSON_SCAN_SCALAR; level <= EJSON_SCAN_AVX2; level++) {
+        if (ejson_scan_setlevel(level) != level)
+            break;
+        double a = run(&spaces,  &arena, 5);
+        double b = run(&strings, &arena, 5);
+        printf("%-8s %12.2f %12.2f\n", level_names[level], a, b);
+    }
+
+    free(arena.base);
+    free(spaces.data);
+    free(strings.data);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Compares the startup cost of parsing a large reference document
+// with opening a snapshot of it, both at the address it was written
+// for and relocated into a buffer.
+
+#define PATH "bench_snapshot.bin"
+
+// Object of products by code, each with a few attributes
+static void generate_catalog(buffer_t *buf, size_t target)
+{
+    unsigned int state = 1;
+    char tmp[256];
+
+    append(buf, "{", 1);
+    for (int i = 0; buf->size < target; i++) {
+        int n = snprintf(tmp, sizeof(tmp),
+            "%s\"P%08d\": {\"name\": \"product %u\", \"price\": %.2f, \"stock\": %u, "
+            "\"active\": %s, \"tags\": [\"t%u\", \"t%u\"]}",
+            i ? ",\n" : "", i, next_random(&state), (next_random(&state) % 100000) / 100.0,
+            next_random(&state) % 1000, next_random(&state) % 2 ? "true" : "false",
+            next_random(&state) % 50, next_random(&state) % 50);
+        append(buf, tmp, n);
+    }
+    append(buf, "}", 1);
+}
+
+int main(void)
+{
+    buffer_t doc = {0};
+    generate_catalog(&doc, 64 << 20);
+
+    ejson_config config = EJSON_DEFAULT_CONFIGS;
+    config.key_index = EJSON_KEYINDEX_EAGER;
+
+    size_t bytes;
+    ejson_error error;
+    if (!ejson_measure(doc.data, doc.size, NULL, &error, config, NULL, &bytes)) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    ejson_arena arena;
+    arena.size = bytes;
+    arena.used = 0;
+    arena.base = malloc(arena.size);
+    if (arena.base == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    double start = now();
+    ejson_value *root = ejson_parse2(doc.data, doc.size, NULL, &error, &arena, config);
+    if (root == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+    printf("ejson_parse2:        %8.2f ms\n", (now() - start) * 1e3);
+
+    int fd = open(PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !ejson_snapshot_write(root, ejson_fdwriter, &fd, NULL)) {
+        fprintf(stderr, "Error: Couldn't write the snapshot\n");
+        return -1;
+    }
+    close(fd);
+
+    ejson_snapshot snap;
+    start = now();
+    if (!ejson_snapshot_open(PATH, &snap, &error)) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+    ejson_value *found = ejson_seekbykey(snap.root, "P00001000");
+    printf("ejson_snapshot_open: %8.2f ms (%zu MB image)\n", (now() - start) * 1e3, snap.size >> 20);
+    if (found == NULL) {
+        fprintf(stderr, "Error: Key not found\n");
+        return -1;
+    }
+
+    void *copy = aligned_alloc(64, (snap.size + 63) & ~(size_t) 63);
+    if (copy == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    size_t size = snap.size;
+    memcpy(copy, snap.base, size);
+    ejson_snapshot_close(&snap);
+
+    start = now();
+    if (ejson_snapshot_load(copy, size, &error) == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+    printf("ejson_snapshot_load: %8.2f ms (relocated)\n", (now() - start) * 1e3);
+
+    unlink(PATH);
+    free(copy);
+    free(arena.base);
+    free(doc.data);
+    return 0;
+}
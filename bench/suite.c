@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ejson.h"
+#include "bench.h"
+
+// Regression suite. Generates a corpus of each of the usual shapes
+// of documents and times the main operations on it, reporting MB per
+// second of source read (of output, for ejson_print), nanoseconds per
+// value of the document and arena bytes per source byte. The corpora
+// are made by a seeded generator, so every run and every commit
+// measures the same bytes.
+//
+//   make bench-run BENCHARGS="[--json] [--baseline FILE]"
+//
+// With "--json" the results are printed as JSON, which can be saved
+// and passed back with "--baseline" to a later run, whose output then
+// shows how much the time per value of each operation changed.
+
+#define TARGET (4 << 20) // Bytes of each corpus
+#define ROUNDS 5
+
+static const char *words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "json", "parser", "arena",
+    "value", "tree", "quick", "brown", "fox", "jumps", "over", "lazy",
+};
+
+#define NUM_WORDS (sizeof(words) / sizeof(words[0]))
+
+static void append_words(buffer_t *t, unsigned int *state, int count)
+{
+    for (int i = 0; i < count; i++)
+        append_fmt(t, "%s%s", i ? " " : "", words[next_random(state) % NUM_WORDS]);
+}
+
+// Objects like those of a social network API: short strings,
+// small integers, booleans and nested objects and arrays
+static void make_twitter(buffer_t *t, unsigned int *state, int i)
+{
+    append_fmt(t, "{\"id\": %d, \"text\": \"", 1000000 + i);
+    append_words(t, state, 8 + next_random(state) % 12);
+    append_fmt(t, "\", \"user\": {\"id\": %u, \"name\": \"User %u\", \"screen_name\": \"user_%u\", "
+              "\"followers_count\": %u, \"verified\": %s}, ",
+           next_random(state) % 100000, next_random(state) % 1000, next_random(state) % 1000,
+           next_random(state) % 50000, next_random(state) % 10 ? "false" : "true");
+    append_fmt(t, "\"entities\": {\"hashtags\": [\"%s\", \"%s\"], \"urls\": []}, "
+              "\"retweet_count\": %u, \"lang\": \"en\", \"coordinates\": null}",
+           words[next_random(state) % NUM_WORDS], words[next_random(state) % NUM_WORDS],
+           next_random(state) % 500);
+}
+
+// Coordinates with all the digits of a double, like GeoJSON
+static void make_numbers(buffer_t *t, unsigned int *state, int i)
+{
+    (void) i;
+    double x = (next_random(state) % 36000000) / 1e5 - 180;
+    double y = (next_random(state) % 18000000) / 1e5 - 90;
+    append_fmt(t, "[%.17g, %.17g]", x, y);
+}
+
+// Objects and arrays alternating 32 levels deep
+static void make_nested(buffer_t *t, unsigned int *state, int i)
+{
+    (void) state;
+    for (int k = 0; k < 16; k++)
+        append_fmt(t, "{\"k%d\": [", k);
+    append_fmt(t, "%d", i);
+    for (int k = 0; k < 16; k++)
+        append_fmt(t, "]}");
+}
+
+// Long strings, some of them with escape sequences
+static void make_strings(buffer_t *t, unsigned int *state, int i)
+{
+    append_fmt(t, "{\"title\": \"");
+    append_words(t, state, 6);
+    append_fmt(t, "\", \"body\": \"");
+    append_words(t, state, 60 + next_random(state) % 60);
+    if (i % 4 == 0)
+        append_fmt(t, "\\n\\t\\\"quoted\\\" caf\\u00e9");
+    append_fmt(t, "\"}");
+}
+
+typedef struct {
+    const char *name;
+    const char *format; // Matched against each element
+    void (*make)(buffer_t *t, unsigned int *state, int i);
+} corpus_t;
+
+static const corpus_t corpora[] = {
+    {"twitter", "{'id': $n, 'user': {'screen_name': $s}, 'entities': {'hashtags': $a}}", make_twitter},
+    {"numbers", "[$n, $n]",                                                          make_numbers},
+    {"nested",  "{'k0': [{'k1': $a}]}",                                              make_nested},
+    {"strings", "{'title': $s, 'body': $s}",                                         make_strings},
+};
+
+#define NUM_CORPORA (sizeof(corpora) / sizeof(corpora[0]))
+
+// Array of elements made by the corpus until it's about TARGET bytes
+static buffer_t generate(const corpus_t *corpus)
+{
+    buffer_t t = {0};
+    unsigned int state = 1;
+    append_fmt(&t, "[\n");
+    for (int i = 0; t.size < TARGET; i++) {
+        if (i > 0)
+            append_fmt(&t, ",\n");
+        corpus->make(&t, &state, i);
+    }
+    append_fmt(&t, "\n]\n");
+    return t;
+}
+
+// Looks up every key of every object, the way a program
+// reading the whole document would
+static void lookup_all(ejson_value *val)
+{
+    if (val->type != EJSON_ARRAY && val->type != EJSON_OBJECT)
+        return;
+    for (ejson_value *child = val->when_array.head; child; child = child->next) {
+        if (val->type == EJSON_OBJECT
+         && ejson_seekbykey2(val, child->key.base, child->key.size) == NULL) {
+            fprintf(stderr, "Error: Key not found\n");
+            exit(-1);
+        }
+        lookup_all(child);
+    }
+}
+
+typedef struct {
+    const char *corpus;
+    const char *op;
+    size_t      bytes;
+    size_t      nodes;
+    double      time; // Best of the rounds
+} result_t;
+
+static result_t results[NUM_CORPORA * 8];
+static size_t   num_results;
+
+typedef struct {
+    const char *name;
+    size_t      bytes;
+    size_t      nodes;
+    double      arena_per_byte;
+} summary_t;
+
+static summary_t summaries[NUM_CORPORA];
+
+static void record(const char *corpus, const char *op, size_t bytes, size_t nodes, double time)
+{
+    results[num_results++] = (result_t) {corpus, op, bytes, nodes, time};
+}
+
+static double mb_per_s(const result_t *r)
+{
+    return r->bytes / r->time / 1e6;
+}
+
+static double ns_per_node(const result_t *r)
+{
+    return r->time / r->nodes * 1e9;
+}
+
+static void run_corpus(const corpus_t *corpus, summary_t *summary)
+{
+    buffer_t t = generate(corpus);
+
+    ejson_error error;
+    size_t nodes;
+    size_t bytes;
+    if (!ejson_measure(t.data, t.size, NULL, &error, EJSON_DEFAULT_CONFIGS, &nodes, &bytes)) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        exit(-1);
+    }
+    *summary = (summary_t) {corpus->name, t.size, nodes, (double) bytes / t.size};
+
+    ejson_arena arena1 = {.size = bytes, .base = malloc(bytes)};
+    ejson_arena arena2 = {.size = bytes, .base = malloc(bytes)};
+    size_t max = 3 * t.size;
+    char *out = malloc(max);
+    if (arena1.base == NULL || arena2.base == NULL || out == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(-1);
+    }
+
+    double best = 1e9;
+    ejson_value *root = NULL;
+    for (int r = 0; r < ROUNDS; r++) {
+        arena1.used = 0;
+        double start = now();
+        root = ejson_parse(t.data, t.size, &error, &arena1);
+        double time = now() - start;
+        if (root == NULL) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            exit(-1);
+        }
+        if (time < best)
+            best = time;
+    }
+    record(corpus->name, "ejson_parse", t.size, nodes, best);
+
+    best = 1e9;
+    size_t printed = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        double start = now();
+        printed = ejson_print(root, out, max);
+        double time = now() - start;
+        if (printed >= max) {
+            fprintf(stderr, "Error: Output truncated\n");
+            exit(-1);
+        }
+        if (time < best)
+            best = time;
+    }
+    record(corpus->name, "ejson_print", printed, nodes, best);
+
+    ejson_value *copy = ejson_parse(t.data, t.size, &error, &arena2);
+    if (copy == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        exit(-1);
+    }
+    best = 1e9;
+    for (int r = 0; r < ROUNDS; r++) {
+        double start = now();
+        bool equal = ejson_valcmp(root, copy);
+        double time = now() - start;
+        if (!equal) {
+            fprintf(stderr, "Error: The copies differ\n");
+            exit(-1);
+        }
+        if (time < best)
+            best = time;
+    }
+    record(corpus->name, "ejson_valcmp", t.size, nodes, best);
+
+    best = 1e9;
+    for (int r = 0; r < ROUNDS; r++) {
+        double start = now();
+        lookup_all(root);
+        double time = now() - start;
+        if (time < best)
+            best = time;
+    }
+    record(corpus->name, "ejson_seekbykey2", t.size, nodes, best);
+
+    best = 1e9;
+    for (int r = 0; r < ROUNDS; r++) {
+        ejson_value *unpacked[4];
+        double start = now();
+        for (ejson_value *item = root->when_array.head; item; item = item->next) {
+            if (ejson_match_and_unpack(item, corpus->format, unpacked) != EJSON_MATCH) {
+                fprintf(stderr, "Error: No match in %s\n", corpus->name);
+                exit(-1);
+            }
+        }
+        double time = now() - start;
+        if (time < best)
+            best = time;
+    }
+    record(corpus->name, "ejson_match_and_unpack", t.size, nodes, best);
+
+    free(out);
+    free(arena1.base);
+    free(arena2.base);
+    free(t.data);
+}
+
+// Baseline result of the same corpus and operation, or NULL
+static ejson_value *find_baseline(ejson_value *base, const char *corpus, const char *op)
+{
+    ejson_value *list = ejson_seekbykey(base, "results");
+    if (list == NULL || list->type != EJSON_ARRAY)
+        return NULL;
+    for (ejson_value *item = list->when_array.head; item; item = item->next) {
+        ejson_value *c = ejson_seekbykey(item, "corpus");
+        ejson_value *o = ejson_seekbykey(item, "op");
+        if (c && o && c->type == EJSON_STRING && o->type == EJSON_STRING
+         && c->when_string.size == strlen(corpus) && !memcmp(c->when_string.base, corpus, strlen(corpus))
+         && o->when_string.size == strlen(op) && !memcmp(o->when_string.base, op, strlen(op)))
+            return item;
+    }
+    return NULL;
+}
+
+// Percentage by which the time per value changed since the baseline.
+// Returns false when the baseline has no such result.
+static bool change_since(ejson_value *base, const result_t *r, double *change)
+{
+    ejson_value *old = base ? find_baseline(base, r->corpus, r->op) : NULL;
+    ejson_value *ns = old ? ejson_seekbykey(old, "ns_per_node") : NULL;
+    if (ns == NULL || ns->type != EJSON_NUMBER || ns->when_number.as_flt <= 0)
+        return false;
+    *change = (ns_per_node(r) / ns->when_number.as_flt - 1) * 100;
+    return true;
+}
+
+static void print_table(ejson_value *base)
+{
+    printf("%-8s %-23s %9s %9s%s\n", "corpus", "operation", "MB/s", "ns/node",
+           base ? "    change" : "");
+    for (size_t i = 0; i < num_results; i++) {
+        result_t *r = &results[i];
+        printf("%-8s %-23s %9.1f %9.2f", r->corpus, r->op, mb_per_s(r), ns_per_node(r));
+
+        double change;
+        if (change_since(base, r, &change))
+            printf(" %+8.1f%%", change);
+        printf("\n");
+    }
+    printf("\n%-8s %10s %10s %16s\n", "corpus", "MB", "nodes", "arena bytes/byte");
+    for (size_t i = 0; i < NUM_CORPORA; i++) {
+        summary_t *s = &summaries[i];
+        printf("%-8s %10.1f %10zu %16.2f\n", s->name, s->bytes / 1e6, s->nodes, s->arena_per_byte);
+    }
+}
+
+static void print_json(ejson_value *base)
+{
+    printf("{\n  \"corpora\": [\n");
+    for (size_t i = 0; i < NUM_CORPORA; i++) {
+        summary_t *s = &summaries[i];
+        printf("    {\"name\": \"%s\", \"bytes\": %zu, \"nodes\": %zu, \"arena_per_byte\": %.4f}%s\n",
+               s->name, s->bytes, s->nodes, s->arena_per_byte, i+1 < NUM_CORPORA ? "," : "");
+    }
+    printf("  ],\n  \"results\": [\n");
+    for (size_t i = 0; i < num_results; i++) {
+        result_t *r = &results[i];
+        printf("    {\"corpus\": \"%s\", \"op\": \"%s\", \"mb_per_s\": %.2f, \"ns_per_node\": %.3f",
+               r->corpus, r->op, mb_per_s(r), ns_per_node(r));
+        double change;
+        if (change_since(base, r, &change))
+            printf(", \"change\": %.2f", change);
+        printf("}%s\n", i+1 < num_results ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    const char *baseline = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json"))
+            json = true;
+        else if (!strcmp(argv[i], "--baseline") && i+1 < argc)
+            baseline = argv[++i];
+        else {
+            fprintf(stderr, "Usage: %s [--json] [--baseline FILE]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    ejson_arena arena = {.allocator=&ejson_stdalloc};
+    ejson_file file;
+    ejson_value *base = NULL;
+    if (baseline) {
+        ejson_error error;
+        base = ejson_parse_file(baseline, &file, &error, &arena, EJSON_DEFAULT_CONFIGS);
+        if (base == NULL) {
+            fprintf(stderr, "Error: %s\n", error.msg);
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < NUM_CORPORA; i++)
+        run_corpus(&corpora[i], &summaries[i]);
+
+    if (json)
+        print_json(base);
+    else
+        print_table(base);
+
+    if (base)
+        ejson_file_close(&file);
+    ejson_arena_free(&arena);
+    return 0;
+}
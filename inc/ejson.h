@@ -6,13 +6,48 @@
 #include <stdbool.h>
 
 typedef struct ejson_value ejson_value;
+typedef struct ejson_keyindex ejson_keyindex;
+typedef struct ejson_pattern ejson_pattern;
+typedef struct ejson_keydict ejson_keydict;
+typedef struct ejson_pathset ejson_pathset;
+
+typedef struct ejson_arena_block ejson_arena_block;
+
+typedef struct {
+    void *(*alloc)(void *userp, size_t size);
+    void  (*free) (void *userp, void *ptr, size_t size);
+    void   *userp;
+} ejson_allocator;
+
+// Allocator based on malloc and free
+extern const ejson_allocator ejson_stdalloc;
+
+// Allocator that backs blocks of 2 MB or more with huge pages when
+// the system has them, and uses malloc for the smaller ones. Meant
+// for growable arenas holding large documents.
+extern const ejson_allocator ejson_hugealloc;
 
 typedef struct {
     void  *base;
     size_t size;
     size_t used;
+
+    // When an allocator is set, a full arena doesn't fail but
+    // chains a new block from it, each one at least twice as large
+    // as the previous. The initial buffer may be left empty. Blocks
+    // are released with ejson_arena_free.
+    const ejson_allocator *allocator;
+    ejson_arena_block     *blocks;
 } ejson_arena;
 
+// Position in an arena that allocations can be rolled back to
+typedef struct {
+    void              *base;
+    size_t             size;
+    size_t             used;
+    ejson_arena_block *blocks;
+} ejson_arena_mark;
+
 typedef struct {
     char msg[512];
 } ejson_error;
@@ -34,18 +69,46 @@ typedef struct {
 typedef struct {
     int64_t as_int;
     double  as_flt;
+    bool    is_int; // Written as an integer that "as_int" holds exactly
 } ejson_number;
 
 typedef struct {
-    ejson_value *head;
-    size_t       size;
+    ejson_value    *head;
+    size_t          size;
+    ejson_keyindex *index; // Objects only, see ejson_buildindex
+    uint64_t        hash;  // See ejson_hash
 } ejson_array;
 
+enum {
+    // The children of the array or object are stored in
+    // one block, so that ejson_seekbyindex is O(1)
+    EJSON_FLAG_CONTIGUOUS = 1 << 0,
+
+    // The string, or the key, has escape sequences and is
+    // stored as it appears in the source. See ejson_unescape.
+    EJSON_FLAG_ESCAPED     = 1 << 1,
+    EJSON_FLAG_ESCAPED_KEY = 1 << 2,
+
+    // The array or object has its hash in "when_array.hash"
+    EJSON_FLAG_HASHED = 1 << 3,
+
+    // The key is stored in a key dictionary. See ejson_keydict_create.
+    EJSON_FLAG_INTERNED_KEY = 1 << 4,
+
+    // Something in the array or object was edited, so "src" no longer
+    // holds it. Values that weren't parsed from a source buffer, like
+    // those made with ejson_make_*, have an empty "src" instead.
+    EJSON_FLAG_DIRTY = 1 << 5,
+};
+
 struct ejson_value {
     ejson_value **prev;
     ejson_value  *next;
+    ejson_value  *parent;
     ejson_string  key;
+    ejson_string  src; // Slice of the source it was parsed from
     ejson_type    type;
+    uint32_t      flags;
     union {
         ejson_array  when_array;
         ejson_number when_number;
@@ -61,10 +124,150 @@ typedef struct {
     ejson_string key;
 } ejson_iter;
 
+typedef enum {
+    EJSON_KEYINDEX_NONE,  // Objects are searched linearly
+    EJSON_KEYINDEX_LAZY,  // Indexes are built by the first lookup
+    EJSON_KEYINDEX_EAGER, // Indexes are built while parsing
+} ejson_keyindex_mode;
+
 typedef struct {
     bool allow_single_quoted_strings;
+
+    // Hash indexes make ejson_seekbykey O(1) on large objects.
+    // Only objects with at least "key_index_min" keys get one.
+    ejson_keyindex_mode key_index;
+    size_t              key_index_min;
+
+    // Store the children of each array and object in one block
+    // of memory. Indexing becomes O(1) and iterating walks the
+    // memory in order. While parsing, values wait for their parent
+    // on a stack at the end of the arena, so the parser temporarily
+    // needs more arena than the resulting tree.
+    bool contiguous_children;
+
+    // Dictionary keys are interned in while parsing, if any. Keys
+    // with escape sequences aren't interned.
+    ejson_keydict *key_dict;
 } ejson_config;
 
+typedef enum {
+    EJSON_FEED_DONE  =  0,
+    EJSON_FEED_MORE  =  1,
+    EJSON_FEED_ERROR = -1,
+} ejson_feedresult;
+
+typedef struct ejson_parser_frame ejson_parser_frame;
+
+// State of an incremental parse. Only "root" and "end"
+// are meant to be read by the caller.
+typedef struct {
+    ejson_value *root; // Set once the parse is done
+    size_t       end;  // Bytes of the last chunk that were used
+
+    ejson_error        *error;
+    ejson_arena        *arena;
+    ejson_arena_mark    save;
+    ejson_config        config;
+    int                 state;
+    ejson_parser_frame *frames;
+    ejson_parser_frame *spare;
+
+    // Token that may span more chunks. It's built at
+    // the end of the arena.
+    char  *tok;
+    size_t toklen;
+    size_t tokcap;
+    char   quote;
+} ejson_parser;
+
+typedef enum {
+    EJSON_BATCH_LINES,        // One document per line (NDJSON)
+    EJSON_BATCH_CONCATENATED, // Documents one after the other
+} ejson_batch_mode;
+
+typedef struct {
+    ejson_value *root;  // NULL when the document is invalid
+    const char  *error; // Why the document is invalid
+    const char  *src;   // Source of the document
+    size_t       len;
+} ejson_batch_item;
+
+// Result of ejson_parse_batch. Only "items" and "count"
+// are meant to be read by the caller.
+typedef struct {
+    ejson_batch_item *items;
+    size_t            count;
+
+    const ejson_allocator *allocator;
+    size_t                 capacity;
+    ejson_arena           *arenas;
+    size_t                 num_arenas;
+} ejson_batch;
+
+// Receives the output of ejson_write in chunks. Returning
+// false stops the output.
+typedef bool (*ejson_writer)(void *userp, const char *data, size_t len);
+
+typedef struct {
+    int  indent;  // Spaces per level, or 0 to write one line
+    bool compact; // On one line, no space after ',' and ':'
+
+    // Values that weren't edited since they were parsed are copied
+    // from their "src", layout included, instead of being formatted
+    // again, so the source buffer must still be there. Only the edited
+    // arrays and objects are walked, and runs of their children that
+    // were adjacent in the source are copied at once. Changes made to
+    // the values directly rather than through the edit functions
+    // aren't tracked.
+    bool verbatim;
+} ejson_writeopts;
+
+// Growable output of ejson_bufwriter. Starts zeroed, with an optional
+// allocator (ejson_stdalloc when NULL), and is released with
+// ejson_buffer_free. The data is kept null-terminated.
+typedef struct {
+    char  *data;
+    size_t size;
+    size_t capacity;
+    const ejson_allocator *allocator;
+} ejson_buffer;
+
+// Source file mapped by ejson_parse_file
+typedef struct {
+    const char *src;
+    size_t      len;
+} ejson_file;
+
+// Snapshot mapped from a file by ejson_snapshot_open
+typedef struct {
+    ejson_value *root;
+    void        *base;
+    size_t       size;
+} ejson_snapshot;
+
+typedef enum {
+    EJSON_SAX_DONE    =  0,
+    EJSON_SAX_STOPPED =  1,
+    EJSON_SAX_ERROR   = -1,
+} ejson_saxresult;
+
+// Events of ejson_sax. Any of the callbacks may be NULL. Strings
+// and keys are slices of the source, with "escaped" set when they
+// have escape sequences still to be decoded by ejson_unescape_to.
+// Returning false stops the parse.
+typedef struct {
+    bool (*begin_object)(void *userp);
+    bool (*end_object)  (void *userp);
+    bool (*begin_array) (void *userp);
+    bool (*end_array)   (void *userp);
+    bool (*key)         (void *userp, ejson_string key, bool escaped);
+    bool (*string)      (void *userp, ejson_string str, bool escaped);
+    bool (*number)      (void *userp, ejson_number num);
+    bool (*boolean)     (void *userp, bool value);
+    bool (*null)        (void *userp);
+    void  *userp;
+} ejson_handler;
+
 typedef enum {
     EJSON_MATCH     =  0,
     EJSON_NOMATCH   =  1,
@@ -73,10 +276,57 @@ typedef enum {
 
 #define EJSON_DEFAULT_CONFIGS ((ejson_config) { \
         .allow_single_quoted_strings=false,     \
+        .key_index=EJSON_KEYINDEX_NONE,         \
+        .key_index_min=16,                      \
+        .contiguous_children=false,             \
+        .key_dict=NULL,                         \
+    })
+
+#define EJSON_DEFAULT_WRITEOPTS ((ejson_writeopts) { \
+        .indent=0,                                   \
+        .compact=false,                              \
+        .verbatim=false,                             \
     })
 
+// Releases the blocks chained by a growable arena and
+// brings it back to its initial buffer.
+void ejson_arena_free(ejson_arena *arena);
+
 ejson_value *ejson_seekbykey (ejson_value *value, const char *key);
 ejson_value *ejson_seekbykey2(ejson_value *value, const char *key, size_t size);
+ejson_value *ejson_seekbyindex(ejson_value *value, size_t index);
+
+// Value a JSON Pointer (RFC 6901) refers to, like "/items/0/name",
+// or NULL if there's none. The empty pointer refers to the root.
+ejson_value *ejson_seekbypointer(ejson_value *root, const char *ptr, size_t len);
+
+// Same as ejson_seekbykey for a key returned by the dictionary the
+// object was parsed with. Interned keys of the children are compared
+// by pointer, and only the others by content.
+ejson_value *ejson_seekbyinterned(ejson_value *value, const char *key);
+
+// Creates a dictionary of up to "max_keys" keys, shared by any number
+// of documents and parser threads. Keys are added by the first parse
+// that meets them and are only read after that, without locking.
+// Memory comes from the allocator (ejson_stdalloc when NULL). Trees
+// with interned keys point into the dictionary, so it must outlive
+// them.
+ejson_keydict *ejson_keydict_create(size_t max_keys, const ejson_allocator *allocator);
+void           ejson_keydict_free(ejson_keydict *dict);
+
+// Returns the interned copy of the key, adding it if needed. Returns
+// NULL when the dictionary is full or out of memory.
+const char *ejson_keydict_intern(ejson_keydict *dict, const char *key, size_t size);
+
+// Returns the interned copy of the key, or NULL if it's not there
+const char *ejson_keydict_find(ejson_keydict *dict, const char *key, size_t size);
+
+// Builds the key index of an object in the given arena, replacing
+// any previous one. Lookups on the object use it from then on.
+// Lazily built indexes are stored in the arena the document was
+// parsed into, so lookups on such objects aren't thread-safe until
+// the index exists.
+bool ejson_buildindex(ejson_value *value, ejson_arena *arena);
 
 ejson_value *ejson_parse2(const char *src, size_t len, size_t *end,
                           ejson_error *error, ejson_arena *arena,
@@ -85,13 +335,269 @@ ejson_value *ejson_parse2(const char *src, size_t len, size_t *end,
 ejson_value *ejson_parse(const char *src, size_t len,
                          ejson_error *error, ejson_arena *arena);
 
-bool   ejson_valcmp(ejson_value *v1, ejson_value *v2);
+// Maps the file and parses it like ejson_parse2, without copying it.
+// Strings and keys of the tree point into the mapping, which stays
+// until ejson_file_close, so it must outlive the tree. The mapping is
+// released when the parse fails.
+ejson_value *ejson_parse_file(const char *path, ejson_file *file,
+                              ejson_error *error, ejson_arena *arena,
+                              ejson_config config);
+
+void ejson_file_close(ejson_file *file);
+
+// Computes, without allocating, the number of values and arena bytes
+// ejson_parse2 needs to parse the source with the given configuration
+// into an empty fixed arena. Returns false and reports the same error
+// ejson_parse2 would when the source is invalid.
+bool ejson_measure(const char *src, size_t len, size_t *end,
+                   ejson_error *error, ejson_config config,
+                   size_t *nodes, size_t *bytes);
+
+// Strings and keys with escape sequences are decoded only when
+// needed. Until then the value is flagged with EJSON_FLAG_ESCAPED or
+// EJSON_FLAG_ESCAPED_KEY and "when_string" or "key" is the string as
+// it appears in the source. This decodes both into the arena, if
+// they are flagged, and clears the flags. Lookups by key and
+// comparisons work on undecoded strings. Returns false when the
+// arena is full.
+bool ejson_unescape(ejson_value *val, ejson_arena *arena);
+
+// Decodes a raw string into "dst", which needs room for "raw.size"
+// bytes, and returns the decoded length.
+size_t ejson_unescape_to(ejson_string raw, char *dst);
+
+// Parses the source with the same grammar and errors as ejson_parse2,
+// calling the handler for each token instead of building a tree. No
+// memory is allocated, but nesting deeper than 4096 arrays and objects
+// is rejected. Only "allow_single_quoted_strings" of the configuration
+// is used. Returns EJSON_SAX_STOPPED when a callback returned false,
+// with "end" after the token it was called for.
+ejson_saxresult ejson_sax(const char *src, size_t len, size_t *end,
+                          ejson_error *error, ejson_config config,
+                          const ejson_handler *handler);
+
+// Whether the values are equal. Objects are equal when their keys
+// and values are, in the same order, or in any order for
+// ejson_valcmp2 with "any_order" set. Arrays and objects whose hashes
+// were computed by ejson_hash are told apart from the hashes when
+// they differ. Comparing objects in any order hashes them, and pairs
+// their members by key in memory from ejson_stdalloc.
+bool   ejson_valcmp (ejson_value *v1, ejson_value *v2);
+bool   ejson_valcmp2(ejson_value *v1, ejson_value *v2, bool any_order);
+
+// 64-bit hash of the value's structure and contents. Equal values
+// have equal hashes in both modes of ejson_valcmp2, since the hash of
+// an object doesn't depend on the order of its keys. Arrays and
+// objects cache their hash the first time, so like lazy indexes the
+// first call on a tree isn't thread-safe.
+uint64_t ejson_hash(ejson_value *val);
+
 size_t ejson_print(ejson_value *val, char *dst, size_t max);
 
+// Serializes the value in one pass, passing the output to the writer
+// in chunks of a few kilobytes. Returns false if the writer failed.
+bool ejson_write(ejson_value *val, ejson_writer writer, void *userp, ejson_writeopts opts);
+
+// Writer to a file descriptor. "userp" points to an int.
+bool ejson_fdwriter(void *userp, const char *data, size_t len);
+
+// Writer to a growable buffer. "userp" points to an ejson_buffer.
+bool ejson_bufwriter(void *userp, const char *data, size_t len);
+
+void ejson_buffer_free(ejson_buffer *buf);
+
 bool       ejson_next(ejson_iter *iter);
 bool       ejson_hasnext(ejson_value *val);
 ejson_iter ejson_iterover(ejson_value *set);
 
+// Values built from scratch in the arena, detached from any tree.
+// Strings are copied. Numbers that aren't finite are printed as
+// null. Return NULL when the arena is full.
+ejson_value *ejson_make_null  (ejson_arena *arena);
+ejson_value *ejson_make_bool  (ejson_arena *arena, bool value);
+ejson_value *ejson_make_int   (ejson_arena *arena, int64_t value);
+ejson_value *ejson_make_float (ejson_arena *arena, double value);
+ejson_value *ejson_make_string(ejson_arena *arena, const char *str, size_t len);
+ejson_value *ejson_make_array (ejson_arena *arena);
+ejson_value *ejson_make_object(ejson_arena *arena);
+
+// Copies into the arena the key a detached value will have when
+// it's inserted into an object. Returns false if the value isn't
+// detached or the arena is full.
+bool ejson_setkey(ejson_value *val, const char *key, size_t size, ejson_arena *arena);
+
+// Edits of a tree. Inserted values must be detached, like those just
+// made or removed, and may come from other arenas, which then need to
+// live as long as the tree. Edits keep sizes, key indexes and parent
+// links up to date and clear the cached hashes of the ancestors.
+// Children of an edited container are no longer contiguous. All of
+// them are O(1), but for ejson_append which walks to the last child
+// of linked containers: to add many children, keep the last one and
+// use ejson_insert_after. The insertions and ejson_replace return
+// false when the value isn't detached or would end up inside itself.
+bool ejson_append       (ejson_value *parent,  ejson_value *val);
+bool ejson_insert_before(ejson_value *sibling, ejson_value *val);
+bool ejson_insert_after (ejson_value *sibling, ejson_value *val);
+
+// Unlinks the value from its parent, leaving it detached
+void ejson_remove(ejson_value *val);
+
+// Puts the value where "old" is, with the same key, and
+// detaches "old". Returns false if "old" is a root.
+bool ejson_replace(ejson_value *old, ejson_value *val);
+
+// Replaces the child of the object with the given key, or appends the
+// value with a copy of the key when there's none. With a key index,
+// replacing is O(1).
+bool ejson_setbykey(ejson_value *obj, const char *key, size_t size,
+                    ejson_value *val, ejson_arena *arena);
+
+// Deep copy of the value, detached, with the children of each array
+// and object stored contiguously. Strings and keys aren't copied but
+// point where those of the original do. Returns NULL when the arena
+// is full.
+ejson_value *ejson_copy(ejson_value *val, ejson_arena *arena);
+
+// Builds in the arena a JSON Patch (RFC 6902) that turns "from" into
+// "to", as an array of "add", "remove" and "replace" operations.
+// Values in the patch are copies of those of "to" made by ejson_copy.
+// Equal subtrees are found by their hashes and members are paired by
+// key, so the time is about linear in the size of the documents.
+// Elements of arrays are aligned on the longest run of equal ones in
+// the same order, after which the others are diffed in pairs. Both
+// trees get their hashes cached, as with ejson_hash. Scratch memory
+// comes from the allocator (ejson_stdalloc when NULL). Returns NULL
+// when memory runs out.
+ejson_value *ejson_diff(ejson_value *from, ejson_value *to, ejson_arena *arena,
+                        const ejson_allocator *allocator);
+
+// Applies a JSON Patch (RFC 6902) to the document in place, through
+// the edit functions. The root is changed by operations on the empty
+// pointer. Values are copied from the patch into the arena with
+// ejson_copy, so the patch's strings must live as long as the
+// document. When an operation fails, those before it are reverted
+// and the error tells which one failed and why. The tree is then as
+// it was, but the containers that were edited keep no cached hash and
+// count as edited for verbatim writes. Scratch memory comes from the
+// allocator (ejson_stdalloc when NULL).
+bool ejson_patch_apply(ejson_value **doc, ejson_value *patch, ejson_arena *arena,
+                       const ejson_allocator *allocator, ejson_error *error);
+
+// Incremental parsing. Chunks of the source are passed to ejson_feed
+// as they become available and don't need to outlive the call, so
+// strings and keys are copied into the arena. ejson_feed returns
+// EJSON_FEED_MORE until a whole value has been read, then
+// EJSON_FEED_DONE. A chunk of length 0 marks the end of the source,
+// which is needed when the value is a bare number. The configuration
+// is the same as ejson_parse2, but children are never stored
+// contiguously.
+void ejson_parser_init(ejson_parser *parser, ejson_error *error,
+                       ejson_arena *arena, ejson_config config);
+
+ejson_feedresult ejson_feed(ejson_parser *parser, const char *chunk, size_t len);
+
+// Splits the source into documents and parses them on "threads"
+// threads, or one per processor when 0. Each thread parses into its
+// own arena from the allocator (ejson_stdalloc when NULL), and the
+// items are in the order the documents appear in the source, whether
+// they are valid or not. Lines with only whitespace are skipped. When
+// some threads can't be started, those that did, including the
+// calling one, parse their share. Returns false if it runs out of
+// memory. Either way the batch must be released with ejson_batch_free.
+bool ejson_parse_batch(const char *src, size_t len, ejson_batch_mode mode,
+                       ejson_config config, size_t threads,
+                       const ejson_allocator *allocator, ejson_batch *batch);
+
+void ejson_batch_free(ejson_batch *batch);
+
+// Same as ejson_parse2, but when the root is a large array its
+// elements are built by "threads" threads (0 for one per processor)
+// after a first pass locates them. Other documents, and invalid ones,
+// are parsed serially, and so are documents of 4 GB or more, whose
+// offsets don't fit the first pass, and any document when single
+// quoted strings are allowed. Growable arenas receive the blocks
+// filled by each thread, so their allocator must be thread safe,
+// while fixed ones are split after measuring how much each thread
+// needs and may be left with small gaps. Scratch memory comes from
+// the allocator (ejson_stdalloc when NULL), and without enough of it
+// the document is parsed serially.
+ejson_value *ejson_parse_parallel(const char *src, size_t len, size_t *end,
+                                  ejson_error *error, ejson_arena *arena,
+                                  ejson_config config, size_t threads,
+                                  const ejson_allocator *allocator);
+
+// Writes an image of the tree that can be used in place without
+// parsing, strings and key indexes included. Pointers in the image
+// are offsets from the address it's expected to be loaded at, and
+// children are stored contiguously. Unbuilt lazy indexes are left
+// out. Scratch memory comes from the allocator (ejson_stdalloc when
+// NULL). Returns false if the writer failed or memory ran out.
+bool ejson_snapshot_write(ejson_value *val, ejson_writer writer, void *userp,
+                          const ejson_allocator *allocator);
+
+// Turns an image in writable memory aligned like an ejson_value into
+// a tree, relocating its pointers unless it's at the address it was
+// written for. The tree lives in the image. Returns NULL and reports
+// why when the buffer doesn't hold an image.
+ejson_value *ejson_snapshot_load(void *image, size_t len, ejson_error *error);
+
+// Maps an image file privately, at the address it was written for
+// when it's free, and loads it. The tree is valid until
+// ejson_snapshot_close.
+bool ejson_snapshot_open(const char *path, ejson_snapshot *snap, ejson_error *error);
+void ejson_snapshot_close(ejson_snapshot *snap);
+
 ejson_matchresult ejson_match_and_unpack(ejson_value *val, const char *fmt, ejson_value **out);
 
+// Compiles a format of ejson_match_and_unpack into a program that
+// can be run on any number of values. The format is copied into the
+// arena with its keys and literals already decoded. Unlike with
+// ejson_match_and_unpack, the whole format must be valid. Returns
+// NULL and reports why if it isn't or if the arena is full.
+ejson_pattern *ejson_pattern_compile(const char *fmt, ejson_error *error, ejson_arena *arena);
+
+// Number of "$" in the pattern, which is the size of
+// the "out" array passed to ejson_pattern_exec.
+size_t ejson_pattern_outputs(const ejson_pattern *pattern);
+
+// Same as ejson_match_and_unpack with a compiled format, but neither
+// parses nor allocates. Arrays and objects in the pattern match any
+// array or object that has at least the items they list.
+ejson_matchresult ejson_pattern_exec(const ejson_pattern *pattern, ejson_value *val, ejson_value **out);
+
+// Matches the pattern against a document while parsing it, building
+// only the values unpacked by a "$" and skipping the rest. Skipped
+// arrays and objects are only checked for balanced brackets and
+// closed strings. Returns EJSON_BADFORMAT and reports why when the
+// source is invalid.
+ejson_matchresult ejson_parse_and_unpack(const char *src, size_t len, size_t *end,
+                                         ejson_error *error, ejson_arena *arena,
+                                         ejson_config config, const ejson_pattern *pattern,
+                                         ejson_value **out);
+
+// Compiles a set of JSON Pointers (RFC 6901) to be looked up together.
+// Paths with a common prefix share it, so a document is walked once
+// for the whole set, and each child of an object is matched against
+// all the keys that can follow in constant time. The set is built in
+// the arena. Returns NULL and reports why if a path isn't a valid
+// pointer or if the arena is full.
+ejson_pathset *ejson_pathset_compile(const char *const *paths, size_t count,
+                                     ejson_error *error, ejson_arena *arena);
+
+// Stores in "out[i]" the value the i-th path of the set refers to in
+// the tree, like ejson_seekbypointer would, or NULL if there's none.
+// Objects with a key index are looked up through it, the others are
+// walked once.
+void ejson_pathset_exec(const ejson_pathset *set, ejson_value *root, ejson_value **out);
+
+// Same as ejson_pathset_exec while parsing the source, like
+// ejson_parse_and_unpack. Only the values the paths lead to are
+// built, and the rest is skipped, as are arrays and objects once
+// the paths through them were followed. Returns false and reports
+// why when the source is invalid.
+bool ejson_parse_paths(const char *src, size_t len, size_t *end,
+                       ejson_error *error, ejson_arena *arena,
+                       ejson_config config, const ejson_pathset *set,
+                       ejson_value **out);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdalign.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+// Header at the start of each chained block. It remembers
+// the state the arena was in before the block was added.
+struct ejson_arena_block {
+    ejson_arena_block *prev;
+    size_t             size;
+    void              *prev_base;
+    size_t             prev_size;
+    size_t             prev_used;
+};
+
+#define MIN_BLOCK_SIZE 4096
+
+// Size of the huge pages ejson_hugealloc asks for
+#define HUGE_PAGE_SIZE (2 << 20)
+
+#define HEADER_SIZE ((sizeof(ejson_arena_block) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+static void *std_alloc(void *userp, size_t size)
+{
+    (void) userp;
+    return malloc(size);
+}
+
+static void std_free(void *userp, void *ptr, size_t size)
+{
+    (void) userp;
+    (void) size;
+    free(ptr);
+}
+
+const ejson_allocator ejson_stdalloc = {
+    .alloc=std_alloc,
+    .free=std_free,
+    .userp=NULL,
+};
+
+static size_t huge_round(size_t size)
+{
+    return (size + HUGE_PAGE_SIZE - 1) & ~(size_t) (HUGE_PAGE_SIZE - 1);
+}
+
+// Requests smaller than a huge page go to malloc. Larger ones are
+// mapped from the reserved huge pages or, when there are none, from
+// normal pages the kernel is asked to back with transparent huge
+// pages. The size passed to free tells which one it was.
+static void *huge_alloc(void *userp, size_t size)
+{
+    (void) userp;
+    if (size < HUGE_PAGE_SIZE)
+        return malloc(size);
+
+    size = huge_round(size);
+    void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    }
+    return ptr;
+}
+
+static void huge_free(void *userp, void *ptr, size_t size)
+{
+    (void) userp;
+    if (size < HUGE_PAGE_SIZE)
+        free(ptr);
+    else
+        munmap(ptr, huge_round(size));
+}
+
+const ejson_allocator ejson_hugealloc = {
+    .alloc=huge_alloc,
+    .free=huge_free,
+    .userp=NULL,
+};
+
+static bool grow(ejson_arena *arena, size_t size, size_t align)
+{
+    const ejson_allocator *allocator = arena->allocator;
+    if (allocator == NULL)
+        return false;
+
+    // Enough for the request even after padding it
+    size_t need = size + align;
+    if (need < size || need > SIZE_MAX - HEADER_SIZE)
+        return false;
+    need += HEADER_SIZE;
+
+    size_t last = arena->blocks ? arena->blocks->size : arena->size;
+    size_t want = last > SIZE_MAX / 2 ? SIZE_MAX : 2 * last;
+    if (want < MIN_BLOCK_SIZE)
+        want = MIN_BLOCK_SIZE;
+    if (want < need)
+        want = need;
+
+    ejson_arena_block *block = allocator->alloc(allocator->userp, want);
+    if (block == NULL)
+        return false;
+
+    block->prev = arena->blocks;
+    block->size = want;
+    block->prev_base = arena->base;
+    block->prev_size = arena->size;
+    block->prev_used = arena->used;
+
+    arena->blocks = block;
+    arena->base = (char*) block + HEADER_SIZE;
+    arena->size = want - HEADER_SIZE;
+    arena->used = 0;
+    return true;
+}
+
+// Bytes needed after the used ones for the next allocation to be
+// aligned. The buffer itself may not be.
+static size_t padding(ejson_arena *arena, size_t align)
+{
+    return -((uintptr_t) arena->base + arena->used) & (align-1);
+}
+
+void *ejson_arena_alloc(ejson_arena *arena, size_t size, size_t align)
+{
+    size_t pad = padding(arena, align);
+    
+    if (arena->used + pad + size > arena->size) {
+        if (!grow(arena, size, align))
+            return NULL;
+        pad = padding(arena, align);
+    }
+    arena->used += pad;
+
+    void *p = arena->base + arena->used;
+    arena->used += size;
+
+    return p;
+}
+
+ejson_arena_mark ejson_arena_save(ejson_arena *arena)
+{
+    return (ejson_arena_mark) {
+        .base=arena->base,
+        .size=arena->size,
+        .used=arena->used,
+        .blocks=arena->blocks,
+    };
+}
+
+void ejson_arena_restore(ejson_arena *arena, ejson_arena_mark mark)
+{
+    while (arena->blocks != mark.blocks) {
+        ejson_arena_block *block = arena->blocks;
+        arena->blocks = block->prev;
+        arena->allocator->free(arena->allocator->userp, block, block->size);
+    }
+    arena->base = mark.base;
+    arena->size = mark.size;
+    arena->used = mark.used;
+}
+
+void ejson_arena_free(ejson_arena *arena)
+{
+    ejson_arena_block *block = arena->blocks;
+    while (block) {
+        ejson_arena_block *prev = block->prev;
+        arena->base = block->prev_base;
+        arena->size = block->prev_size;
+        arena->used = block->prev_used;
+        arena->allocator->free(arena->allocator->userp, block, block->size);
+        block = prev;
+    }
+    arena->blocks = NULL;
+}
+
+void ejson_arena_adopt(ejson_arena *arena, ejson_arena *other)
+{
+    ejson_arena_block *newest = other->blocks;
+    if (newest == NULL)
+        return;
+
+    // Releasing an adopted block brings the arena
+    // back to the state it's in now.
+    ejson_arena_block *oldest = newest;
+    for (;;) {
+        oldest->prev_base = arena->base;
+        oldest->prev_size = arena->size;
+        oldest->prev_used = arena->used;
+        if (oldest->prev == NULL)
+            break;
+        oldest = oldest->prev;
+    }
+    oldest->prev = arena->blocks;
+    arena->blocks = newest;
+
+    other->base = NULL;
+    other->size = 0;
+    other->used = 0;
+    other->blocks = NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef EJSON_ARENA_H
+#define EJSON_ARENA_H
+
+#include "ejson.h"
+
+// Bump-allocates "size" bytes aligned to "align" (a power of two)
+// from the arena. Returns NULL when the arena is full and can't
+// grow.
+void *ejson_arena_alloc(ejson_arena *arena, size_t size, size_t align);
+
+ejson_arena_mark ejson_arena_save(ejson_arena *arena);
+
+// Frees everything allocated after the mark was taken
+void ejson_arena_restore(ejson_arena *arena, ejson_arena_mark mark);
+
+// Moves the blocks of "other", which must have no initial buffer
+// and the same allocator, into "arena". The memory they hold is
+// then released with the arena.
+void ejson_arena_adopt(ejson_arena *arena, ejson_arena *other);
+
+#endif
@@ -0,0 +1,277 @@
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ejson.h"
+#include "scan.h"
+#include "arena.h"
+
+// Number of items a worker claims at a time
+#define ITEMS_PER_CLAIM 64
+
+typedef struct {
+    ejson_batch   *batch;
+    ejson_config   config;
+    atomic_size_t  next;
+} shared_t;
+
+typedef struct {
+    shared_t    *shared;
+    ejson_arena *arena;
+} worker_t;
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t'
+        || c == '\r' || c == '\n';
+}
+
+static bool is_delimiter(char c)
+{
+    return is_space(c) || c == '{' || c == '}' || c == '['
+        || c == ']' || c == ',' || c == ':' || c == '"' || c == '\'';
+}
+
+static void *grow_array(const ejson_allocator *allocator, void *old,
+                        size_t num, size_t *cap, size_t size)
+{
+    size_t new_cap = *cap ? 2 * *cap : 1024;
+    void *mem = allocator->alloc(allocator->userp, new_cap * size);
+    if (mem == NULL)
+        return NULL;
+    if (old) {
+        memcpy(mem, old, num * size);
+        allocator->free(allocator->userp, old, *cap * size);
+    }
+    *cap = new_cap;
+    return mem;
+}
+
+static bool add_item(ejson_batch *batch, const char *src, size_t len)
+{
+    if (batch->count == batch->capacity) {
+        ejson_batch_item *items = grow_array(batch->allocator, batch->items,
+            batch->count, &batch->capacity, sizeof(ejson_batch_item));
+        if (items == NULL)
+            return false;
+        batch->items = items;
+    }
+    ejson_batch_item *item = &batch->items[batch->count++];
+    item->root  = NULL;
+    item->error = NULL;
+    item->src   = src;
+    item->len   = len;
+    return true;
+}
+
+static bool split_lines(ejson_batch *batch, const char *src, size_t len)
+{
+    size_t cur = 0;
+    while (cur < len) {
+        const char *nl = memchr(src + cur, '\n', len - cur);
+        size_t end = nl ? (size_t) (nl - src) : len;
+        if (ejson_scan_spaces(src, cur, end) < end)
+            if (!add_item(batch, src + cur, end - cur))
+                return false;
+        cur = end + 1;
+    }
+    return true;
+}
+
+// Finds where the value starting at "cur" ends by balancing brackets
+// and skipping strings. Malformed values are left to the parser.
+static size_t skip_value(const char *src, size_t cur, size_t len, ejson_config config)
+{
+    char c = src[cur];
+
+    if (c == '{' || c == '[') {
+        if (!config.allow_single_quoted_strings) {
+            cur = ejson_scan_skip(src, cur+1, len);
+            return cur < len ? cur+1 : len;
+        }
+        size_t depth = 0;
+        while (cur < len) {
+            c = src[cur];
+            if (c == '"' || (c == '\'' && config.allow_single_quoted_strings)) {
+                cur = ejson_scan_string(src, cur+1, len, c);
+                if (cur < len)
+                    cur++;
+                continue;
+            }
+            if (c == '{' || c == '[')
+                depth++;
+            else if (c == '}' || c == ']') {
+                if (--depth == 0)
+                    return cur+1;
+            }
+            cur++;
+        }
+        return len;
+    }
+
+    if (c == '"' || (c == '\'' && config.allow_single_quoted_strings)) {
+        cur = ejson_scan_string(src, cur+1, len, c);
+        return cur < len ? cur+1 : len;
+    }
+
+    // Numbers and words end at the first delimiter
+    do
+        cur++;
+    while (cur < len && !is_delimiter(src[cur]));
+    return cur;
+}
+
+static bool split_values(ejson_batch *batch, const char *src, size_t len, ejson_config config)
+{
+    size_t cur = ejson_scan_spaces(src, 0, len);
+    while (cur < len) {
+        size_t end = skip_value(src, cur, len, config);
+        if (!add_item(batch, src + cur, end - cur))
+            return false;
+        cur = ejson_scan_spaces(src, end, len);
+    }
+    return true;
+}
+
+static const char *copy_error(ejson_arena *arena, const char *msg)
+{
+    size_t len = strlen(msg);
+    char *copy = ejson_arena_alloc(arena, len+1, 1);
+    if (copy == NULL)
+        return "Out of arena";
+    memcpy(copy, msg, len+1);
+    return copy;
+}
+
+static void parse_item(ejson_batch_item *item, ejson_arena *arena, ejson_config config)
+{
+    ejson_error error;
+    size_t end;
+    item->root = ejson_parse2(item->src, item->len, &end, &error, arena, config);
+    if (item->root == NULL) {
+        item->error = copy_error(arena, error.msg);
+        return;
+    }
+
+    end = ejson_scan_spaces(item->src, end, item->len);
+    if (end < item->len) {
+        // The tree stays in the arena, but the
+        // document as a whole is invalid.
+        item->root  = NULL;
+        item->error = "Unexpected data after value";
+    }
+}
+
+static void *work(void *arg)
+{
+    worker_t *worker = arg;
+    shared_t *shared = worker->shared;
+    ejson_batch *batch = shared->batch;
+
+    for (;;) {
+        size_t first = atomic_fetch_add(&shared->next, ITEMS_PER_CLAIM);
+        if (first >= batch->count)
+            break;
+        size_t last = first + ITEMS_PER_CLAIM;
+        if (last > batch->count)
+            last = batch->count;
+        for (size_t i = first; i < last; i++)
+            parse_item(&batch->items[i], worker->arena, shared->config);
+    }
+    return NULL;
+}
+
+static size_t count_processors(void)
+{
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return num > 0 ? (size_t) num : 1;
+}
+
+bool ejson_parse_batch(const char *src, size_t len, ejson_batch_mode mode,
+                       ejson_config config, size_t threads,
+                       const ejson_allocator *allocator, ejson_batch *batch)
+{
+    if (allocator == NULL)
+        allocator = &ejson_stdalloc;
+
+    batch->items = NULL;
+    batch->count = 0;
+    batch->allocator = allocator;
+    batch->capacity = 0;
+    batch->arenas = NULL;
+    batch->num_arenas = 0;
+
+    bool ok;
+    if (mode == EJSON_BATCH_LINES)
+        ok = split_lines(batch, src, len);
+    else
+        ok = split_values(batch, src, len, config);
+    if (!ok)
+        return false;
+
+    if (threads == 0)
+        threads = count_processors();
+    if (threads > batch->count / ITEMS_PER_CLAIM + 1)
+        threads = batch->count / ITEMS_PER_CLAIM + 1;
+
+    ejson_arena *arenas = allocator->alloc(allocator->userp, threads * sizeof(ejson_arena));
+    if (arenas == NULL)
+        return false;
+    for (size_t i = 0; i < threads; i++)
+        arenas[i] = (ejson_arena) {.allocator=allocator};
+    batch->arenas = arenas;
+    batch->num_arenas = threads;
+
+    worker_t  *workers = allocator->alloc(allocator->userp, threads * sizeof(worker_t));
+    pthread_t *handles = allocator->alloc(allocator->userp, threads * sizeof(pthread_t));
+    if (workers == NULL || handles == NULL) {
+        if (workers)
+            allocator->free(allocator->userp, workers, threads * sizeof(worker_t));
+        if (handles)
+            allocator->free(allocator->userp, handles, threads * sizeof(pthread_t));
+        return false;
+    }
+
+    shared_t shared = {
+        .batch=batch,
+        .config=config,
+    };
+    atomic_init(&shared.next, 0);
+
+    // The calling thread is the first worker. If some of the
+    // others can't be started, the ones that did pick up their
+    // share of the work.
+    size_t started = 1;
+    for (size_t i = 0; i < threads; i++) {
+        workers[i].shared = &shared;
+        workers[i].arena  = &arenas[i];
+        if (i > 0 && pthread_create(&handles[started], NULL, work, &workers[i]) == 0)
+            started++;
+    }
+    work(&workers[0]);
+
+    for (size_t i = 1; i < started; i++)
+        pthread_join(handles[i], NULL);
+
+    allocator->free(allocator->userp, workers, threads * sizeof(worker_t));
+    allocator->free(allocator->userp, handles, threads * sizeof(pthread_t));
+    return true;
+}
+
+void ejson_batch_free(ejson_batch *batch)
+{
+    const ejson_allocator *allocator = batch->allocator;
+
+    for (size_t i = 0; i < batch->num_arenas; i++)
+        ejson_arena_free(&batch->arenas[i]);
+
+    if (batch->arenas)
+        allocator->free(allocator->userp, batch->arenas, batch->num_arenas * sizeof(ejson_arena));
+    if (batch->items)
+        allocator->free(allocator->userp, batch->items, batch->capacity * sizeof(ejson_batch_item));
+
+    batch->items = NULL;
+    batch->count = 0;
+    batch->arenas = NULL;
+    batch->num_arenas = 0;
+}
@@ -1,8 +1,269 @@
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdalign.h>
 #include "ejson.h"
+#include "arena.h"
+#include "index.h"
+#include "escape.h"
+#include "keydict.h"
 
-bool ejson_valcmp(ejson_value *v1, ejson_value *v2)
+#define HASH_K1 0x9E3779B97F4A7C15ULL
+#define HASH_K2 0xC2B2AE3D27D4EB4FULL
+
+// Seeds that keep values of different types apart
+#define SEED_NULL    0x6E756C6CULL
+#define SEED_TRUE    0x74727565ULL
+#define SEED_FALSE   0x66616C73ULL
+#define SEED_NUMBER  0x6E756D62ULL
+#define SEED_STRING  0x73747269ULL
+#define SEED_ARRAY   0x61727261ULL
+#define SEED_OBJECT  0x6F626A65ULL
+
+static uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t mix(uint64_t h, uint64_t w)
+{
+    return rotl(h ^ (w * HASH_K1), 31) * HASH_K2;
+}
+
+static uint64_t finish(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Hashes a string 8 bytes at a time. The bytes are the same
+// whether they come in one piece or many, so strings with escapes
+// can be decoded on the fly.
+typedef struct {
+    uint64_t h;
+    uint64_t word;
+    size_t   num;
+} hasher_t;
+
+static void hash_bytes(hasher_t *hs, const char *src, size_t len)
+{
+    size_t i = 0;
+    while (i < len && hs->num % 8 != 0) {
+        hs->word |= (uint64_t) (unsigned char) src[i++] << (8 * (hs->num % 8));
+        if (++hs->num % 8 == 0) {
+            hs->h = mix(hs->h, hs->word);
+            hs->word = 0;
+        }
+    }
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, 8);
+        hs->h = mix(hs->h, word);
+        hs->num += 8;
+    }
+    for (; i < len; i++)
+        hs->word |= (uint64_t) (unsigned char) src[i] << (8 * (hs->num++ % 8));
+}
+
+static uint64_t hash_string(ejson_string str, bool raw)
+{
+    hasher_t hs = {.h=SEED_STRING};
+    if (!raw)
+        hash_bytes(&hs, str.base, str.size);
+    else {
+        size_t cur = 0;
+        while (cur < str.size) {
+            char buf[64];
+            size_t num = 0;
+            while (cur < str.size && num + 4 <= sizeof(buf))
+                num += ejson_unescape_next(str.base, str.size, &cur, buf + num);
+            hash_bytes(&hs, buf, num);
+        }
+    }
+    if (hs.num % 8 != 0)
+        hs.h = mix(hs.h, hs.word);
+    return finish(mix(hs.h, hs.num));
+}
+
+static uint64_t hash_number(ejson_number num)
+{
+    // Equal numbers have the same double, but
+    // zeros can have either sign.
+    double flt = num.as_flt == 0 ? 0 : num.as_flt;
+    uint64_t bits;
+    memcpy(&bits, &flt, sizeof(bits));
+    return finish(mix(SEED_NUMBER, bits));
+}
+
+// Hash of a child as a member of its object
+static uint64_t pair_hash(ejson_value *child)
+{
+    uint64_t key = hash_string(child->key, child->flags & EJSON_FLAG_ESCAPED_KEY);
+    return finish(mix(key, ejson_hash(child)));
+}
+
+uint64_t ejson_hash(ejson_value *val)
+{
+    switch (val->type) {
+
+        case EJSON_NULL:
+        return finish(SEED_NULL);
+
+        case EJSON_BOOLEAN:
+        return finish(val->when_boolean ? SEED_TRUE : SEED_FALSE);
+
+        case EJSON_NUMBER:
+        return hash_number(val->when_number);
+
+        case EJSON_STRING:
+        return hash_string(val->when_string, val->flags & EJSON_FLAG_ESCAPED);
+
+        case EJSON_ARRAY:
+        case EJSON_OBJECT:
+        break;
+    }
+
+    if (val->flags & EJSON_FLAG_HASHED)
+        return val->when_array.hash;
+
+    uint64_t h;
+    if (val->type == EJSON_ARRAY) {
+        h = SEED_ARRAY;
+        for (ejson_value *child = val->when_array.head; child; child = child->next)
+            h = mix(h, ejson_hash(child));
+    } else {
+        // Pairs are summed so that their order doesn't matter
+        uint64_t sum = 0;
+        for (ejson_value *child = val->when_array.head; child; child = child->next)
+            sum += pair_hash(child);
+        h = mix(SEED_OBJECT, sum);
+    }
+    h = finish(mix(h, val->when_array.size));
+
+    val->when_array.hash = h;
+    val->flags |= EJSON_FLAG_HASHED;
+    return h;
+}
+
+static bool same_key(ejson_value *v1, ejson_value *v2)
+{
+    if (ejson_keys_interned_together(v1, v2))
+        return v1->key.base == v2->key.base;
+    return ejson_strings_equal(v1->key, v1->flags & EJSON_FLAG_ESCAPED_KEY,
+                               v2->key, v2->flags & EJSON_FLAG_ESCAPED_KEY);
+}
+
+static bool same_pair(ejson_value *v1, ejson_value *v2, bool any_order)
+{
+    return same_key(v1, v2) && ejson_valcmp2(v1, v2, any_order);
+}
+
+// Number of children of "val" forming a pair equal to "child"
+static size_t count_equal(ejson_value *val, ejson_value *child)
+{
+    size_t num = 0;
+    for (ejson_value *cur = val->when_array.head; cur; cur = cur->next)
+        if (same_pair(cur, child, true))
+            num++;
+    return num;
+}
+
+// Compares the objects without allocating, for when there's no
+// memory to pair their children with: they're equal when every
+// pair is found as many times in both.
+static bool count_pairs(ejson_value *v1, ejson_value *v2)
+{
+    for (ejson_value *cur = v1->when_array.head; cur; cur = cur->next)
+        if (count_equal(v1, cur) != count_equal(v2, cur))
+            return false;
+    return true;
+}
+
+typedef struct {
+    uint64_t     hash;
+    ejson_value *child;
+} pair_t;
+
+static int compare_pairs(const void *a, const void *b)
+{
+    uint64_t h1 = ((const pair_t*) a)->hash;
+    uint64_t h2 = ((const pair_t*) b)->hash;
+    return (h1 > h2) - (h1 < h2);
+}
+
+// Pairs the children of objects where some key is repeated, which
+// can't be paired by key alone. The children of the second object
+// are sorted by hash, so that each child of the first one is only
+// compared with those hashing like it. Equality is transitive, so
+// taking the first free match is always right.
+static bool pair_by_hash(ejson_value *v1, ejson_value *v2, ejson_arena *scratch)
+{
+    size_t size = v2->when_array.size;
+    pair_t *pairs = ejson_arena_alloc(scratch, (size + 1) * sizeof(pair_t), alignof(pair_t));
+    if (pairs == NULL)
+        return count_pairs(v1, v2);
+
+    size_t num = 0;
+    for (ejson_value *cur = v2->when_array.head; cur; cur = cur->next)
+        pairs[num++] = (pair_t) {.hash=pair_hash(cur), .child=cur};
+    qsort(pairs, num, sizeof(pair_t), compare_pairs);
+
+    for (ejson_value *cur = v1->when_array.head; cur; cur = cur->next) {
+        uint64_t hash = pair_hash(cur);
+        size_t lo = 0, hi = num;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (pairs[mid].hash < hash)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        while (lo < num && pairs[lo].hash == hash
+           && (pairs[lo].child == NULL || !same_pair(cur, pairs[lo].child, true)))
+            lo++;
+        if (lo == num || pairs[lo].hash != hash)
+            return false;
+        pairs[lo].child = NULL; // Taken
+    }
+    return true;
+}
+
+// Pairs each child of the first object with the one of the second
+// holding the same key, through throwaway indexes. Hashing the two
+// objects first caches the hashes of everything below them, so that
+// unequal members are mostly told apart without walking them.
+static bool objects_equal_any_order(ejson_value *v1, ejson_value *v2)
+{
+    if (ejson_hash(v1) != ejson_hash(v2))
+        return false;
+
+    ejson_arena scratch = {.allocator=&ejson_stdalloc};
+    ejson_keyindex index1;
+    ejson_keyindex index2;
+    bool equal;
+    if (!ejson_keyindex_build(&index1, v1, &scratch)
+     || !ejson_keyindex_build(&index2, v2, &scratch))
+        equal = count_pairs(v1, v2);
+    else if (index1.dups || index2.dups)
+        equal = pair_by_hash(v1, v2, &scratch);
+    else {
+        // With no repeated keys and as many children on both
+        // sides, the pairing is one-to-one when every key is found.
+        equal = true;
+        for (ejson_value *cur = v1->when_array.head; equal && cur; cur = cur->next) {
+            ejson_value *other = ejson_keyindex_find(&index2, cur);
+            equal = other && ejson_valcmp2(cur, other, true);
+        }
+    }
+    ejson_arena_free(&scratch);
+    return equal;
+}
+
+bool ejson_valcmp2(ejson_value *v1, ejson_value *v2, bool any_order)
 {
     if (v1->type != v2->type)
         return false;
@@ -17,11 +278,18 @@ bool ejson_valcmp(ejson_value *v1, ejson_value *v2)
         {
             if (v1->when_array.size != v2->when_array.size)
                 return false;
+            if ((v1->flags & v2->flags & EJSON_FLAG_HASHED)
+             && v1->when_array.hash != v2->when_array.hash)
+                return false;
+            if (v1->type == EJSON_OBJECT && any_order)
+                return objects_equal_any_order(v1, v2);
             ejson_value *cur1 = v1->when_array.head;
             ejson_value *cur2 = v2->when_array.head;
             while (cur1) {
                 assert(cur2);
-                if (!ejson_valcmp(cur1, cur2))
+                if (v1->type == EJSON_OBJECT && !same_key(cur1, cur2))
+                    return false;
+                if (!ejson_valcmp2(cur1, cur2, any_order))
                     return false;
                 cur1 = cur1->next;
                 cur2 = cur2->next;
@@ -34,11 +302,16 @@ bool ejson_valcmp(ejson_value *v1, ejson_value *v2)
             && v1->when_number.as_flt == v2->when_number.as_flt;
         
         case EJSON_STRING:
-        return v1->when_string.size == v2->when_string.size
-            && !strncmp(v1->when_string.base, v2->when_string.base, v1->when_string.size);
+        return ejson_strings_equal(v1->when_string, v1->flags & EJSON_FLAG_ESCAPED,
+                                   v2->when_string, v2->flags & EJSON_FLAG_ESCAPED);
 
         case EJSON_BOOLEAN:
         return v1->when_boolean == v2->when_boolean;
     }
     return false;
-}
\ No newline at end of file
+}
+
+bool ejson_valcmp(ejson_value *v1, ejson_value *v2)
+{
+    return ejson_valcmp2(v1, v2, false);
+}
@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdalign.h>
+#include "value.h"
+#include "index.h"
+#include "arena.h"
+#include "escape.h"
+
+#define NONE SIZE_MAX
+
+// Location of a value in the target document, as a chain of
+// segments going up to the root. Members are named by the key of
+// "member" and elements by "index".
+typedef struct path_t path_t;
+struct path_t {
+    const path_t *up;
+    ejson_value  *member;
+    size_t        index;
+};
+
+typedef struct {
+    ejson_arena *arena;   // Where the patch is built
+    ejson_arena  scratch; // Tables, released after each container
+    ejson_value *patch;
+    ejson_value *last;    // Last operation of the patch
+} differ_t;
+
+static bool diff_any(differ_t *d, ejson_value *a, ejson_value *b, const path_t *path);
+
+static bool same(ejson_value *a, ejson_value *b)
+{
+    return ejson_hash(a) == ejson_hash(b) && ejson_valcmp(a, b);
+}
+
+// Writes the key of the member as a reference token, escaping '~'
+// and '/', or only counts its bytes when "dst" is NULL
+static size_t put_key(ejson_value *member, char *dst)
+{
+    bool escaped = member->flags & EJSON_FLAG_ESCAPED_KEY;
+
+    size_t num = 0;
+    size_t cur = 0;
+    while (cur < member->key.size) {
+        char buf[4];
+        size_t len = 1;
+        if (escaped)
+            len = ejson_unescape_next(member->key.base, member->key.size, &cur, buf);
+        else
+            buf[0] = member->key.base[cur++];
+
+        for (size_t i = 0; i < len; i++) {
+            char c = buf[i];
+            if (c == '~' || c == '/') {
+                if (dst) {
+                    dst[num+0] = '~';
+                    dst[num+1] = (c == '~') ? '0' : '1';
+                }
+                num += 2;
+            } else {
+                if (dst) dst[num] = c;
+                num++;
+            }
+        }
+    }
+    return num;
+}
+
+static size_t put_segment(const path_t *path, char *dst)
+{
+    if (path->member)
+        return put_key(path->member, dst);
+
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%zu", path->index);
+    if (dst) memcpy(dst, buf, len);
+    return len;
+}
+
+// Renders the path as a JSON Pointer in the arena. Segments
+// are written from the last one back.
+static bool make_pointer(differ_t *d, const path_t *path, ejson_string *out)
+{
+    size_t len = 0;
+    for (const path_t *p = path; p; p = p->up)
+        len += 1 + put_segment(p, NULL);
+
+    *out = EMPTY_STRING;
+    if (len == 0)
+        return true;
+
+    char *str = ejson_arena_alloc(d->arena, len, 1);
+    if (str == NULL)
+        return false;
+
+    size_t end = len;
+    for (const path_t *p = path; p; p = p->up) {
+        end -= put_segment(p, NULL);
+        put_segment(p, str + end);
+        str[--end] = '/';
+    }
+    *out = (ejson_string) {.base=str, .size=len};
+    return true;
+}
+
+static ejson_value *make_str(differ_t *d, ejson_string str)
+{
+    ejson_value *val = ejson_arena_alloc(d->arena, sizeof(ejson_value), alignof(ejson_value));
+    if (val) init_val_for_str(val, str);
+    return val;
+}
+
+// Gives a detached value one of the keys of an operation
+static void set_name(ejson_value *val, const char *name)
+{
+    val->key = (ejson_string) {.base=name, .size=strlen(name)};
+    val->flags &= ~(EJSON_FLAG_ESCAPED_KEY | EJSON_FLAG_INTERNED_KEY);
+}
+
+// Appends an operation to the patch. Values are copied
+// from the target document.
+static bool emit(differ_t *d, const char *op, const path_t *path, ejson_value *value)
+{
+    ejson_string ptr;
+    if (!make_pointer(d, path, &ptr))
+        return false;
+
+    ejson_value *obj   = ejson_make_object(d->arena);
+    ejson_value *name  = make_str(d, (ejson_string) {.base=op, .size=strlen(op)});
+    ejson_value *where = make_str(d, ptr);
+    ejson_value *copy  = value ? ejson_copy(value, d->arena) : NULL;
+    if (obj == NULL || name == NULL || where == NULL || (value && copy == NULL))
+        return false;
+
+    set_name(name, "op");
+    set_name(where, "path");
+    ejson_append(obj, name);
+    ejson_insert_after(name, where);
+    if (copy) {
+        set_name(copy, "value");
+        ejson_insert_after(where, copy);
+    }
+
+    if (d->last)
+        ejson_insert_after(d->last, obj);
+    else
+        ejson_append(d->patch, obj);
+    d->last = obj;
+    return true;
+}
+
+// Members are paired by key through two throwaway indexes, so that
+// objects are compared in linear time. Objects with duplicate keys
+// are compared by the first member with each key.
+static bool diff_obj(differ_t *d, ejson_value *a, ejson_value *b, const path_t *path)
+{
+    ejson_arena_mark save = ejson_arena_save(&d->scratch);
+
+    ejson_keyindex index_a;
+    ejson_keyindex index_b;
+    bool ok = ejson_keyindex_build(&index_a, a, &d->scratch)
+           && ejson_keyindex_build(&index_b, b, &d->scratch);
+
+    for (ejson_value *cur = b->when_array.head; ok && cur; cur = cur->next) {
+        if (ejson_keyindex_find(&index_b, cur) != cur)
+            continue;
+        path_t sub = {.up=path, .member=cur};
+        ejson_value *old = ejson_keyindex_find(&index_a, cur);
+        if (old)
+            ok = diff_any(d, old, cur, &sub);
+        else
+            ok = emit(d, "add", &sub, cur);
+    }
+
+    for (ejson_value *cur = a->when_array.head; ok && cur; cur = cur->next) {
+        if (ejson_keyindex_find(&index_a, cur) != cur
+         || ejson_keyindex_find(&index_b, cur) != NULL)
+            continue;
+        path_t sub = {.up=path, .member=cur};
+        ok = emit(d, "remove", &sub, NULL);
+    }
+
+    ejson_arena_restore(&d->scratch, save);
+    return ok;
+}
+
+static ejson_value **list_children(differ_t *d, ejson_value *val)
+{
+    size_t size = val->when_array.size;
+    ejson_value **list = ejson_arena_alloc(&d->scratch, (size + 1) * sizeof(ejson_value*), alignof(ejson_value*));
+    if (list == NULL)
+        return NULL;
+
+    size_t i = 0;
+    for (ejson_value *cur = val->when_array.head; cur; cur = cur->next)
+        list[i++] = cur;
+    return list;
+}
+
+// Pairs elements of "a" with equal ones of "b" by their hashes, each
+// with the first free one, and stores in "match" the position in
+// "b" of each element of "a", or NONE.
+static bool match_elements(differ_t *d, ejson_value **a, size_t n,
+                           ejson_value **b, size_t m, size_t *match)
+{
+    size_t num = ejson_keyindex_slots(m);
+    size_t mask = num-1;
+
+    uint64_t *hashes = ejson_arena_alloc(&d->scratch, num * sizeof(uint64_t), alignof(uint64_t));
+    size_t   *heads  = ejson_arena_alloc(&d->scratch, num * sizeof(size_t), alignof(size_t));
+    size_t   *chain  = ejson_arena_alloc(&d->scratch, (m + 1) * sizeof(size_t), alignof(size_t));
+    if (hashes == NULL || heads == NULL || chain == NULL)
+        return false;
+    for (size_t k = 0; k < num; k++)
+        heads[k] = NONE;
+
+    // Positions with the same hash are chained in increasing order
+    for (size_t j = m; j-- > 0; ) {
+        uint64_t h = ejson_hash(b[j]);
+        size_t k = h & mask;
+        while (heads[k] != NONE && hashes[k] != h)
+            k = (k + 1) & mask;
+        hashes[k] = h;
+        chain[j] = heads[k];
+        heads[k] = j;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t h = ejson_hash(a[i]);
+        size_t k = h & mask;
+        while (heads[k] != NONE && hashes[k] != h)
+            k = (k + 1) & mask;
+
+        size_t j = heads[k];
+        if (j != NONE && ejson_valcmp(a[i], b[j])) {
+            heads[k] = chain[j];
+            match[i] = j;
+        } else
+            match[i] = NONE;
+    }
+    return true;
+}
+
+// Longest run of matched elements that appear in the same order in
+// both arrays, which are the ones left in place. Stores in "keep"
+// their positions in "a" and returns how many there are.
+static size_t longest_run(differ_t *d, const size_t *match, size_t n, size_t *keep)
+{
+    size_t *tails = ejson_arena_alloc(&d->scratch, (n + 1) * sizeof(size_t), alignof(size_t));
+    size_t *pred  = ejson_arena_alloc(&d->scratch, (n + 1) * sizeof(size_t), alignof(size_t));
+    if (tails == NULL || pred == NULL)
+        return NONE;
+
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (match[i] == NONE)
+            continue;
+
+        // First run whose last element can be followed by this one
+        size_t lo = 0;
+        size_t hi = len;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (match[tails[mid]] < match[i])
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        pred[i] = lo ? tails[lo-1] : NONE;
+        tails[lo] = i;
+        if (lo == len)
+            len++;
+    }
+
+    size_t i = len ? tails[len-1] : NONE;
+    for (size_t k = len; k-- > 0; i = pred[i])
+        keep[k] = i;
+    return len;
+}
+
+// Common elements at the ends are skipped, and the rest are aligned
+// on the longest run of equal elements in the same order. Elements
+// between those are diffed in pairs, with the extra ones removed or
+// added. Indexes in the paths are those the elements have when the
+// previous operations have been applied.
+static bool diff_arr(differ_t *d, ejson_value *a, ejson_value *b, const path_t *path)
+{
+    ejson_arena_mark save = ejson_arena_save(&d->scratch);
+
+    size_t n = a->when_array.size;
+    size_t m = b->when_array.size;
+    ejson_value **list_a = list_children(d, a);
+    ejson_value **list_b = list_children(d, b);
+    if (list_a == NULL || list_b == NULL) {
+        ejson_arena_restore(&d->scratch, save);
+        return false;
+    }
+
+    size_t prefix = 0;
+    while (prefix < n && prefix < m && same(list_a[prefix], list_b[prefix]))
+        prefix++;
+    list_a += prefix; n -= prefix;
+    list_b += prefix; m -= prefix;
+
+    while (n > 0 && m > 0 && same(list_a[n-1], list_b[m-1])) {
+        n--;
+        m--;
+    }
+
+    size_t *match = ejson_arena_alloc(&d->scratch, (n + 1) * sizeof(size_t), alignof(size_t));
+    size_t *keep  = ejson_arena_alloc(&d->scratch, (n + 1) * sizeof(size_t), alignof(size_t));
+    size_t  kept  = 0;
+    bool ok = match && keep;
+    if (ok && n > 0 && m > 0) {
+        ok = match_elements(d, list_a, n, list_b, m, match);
+        if (ok) {
+            kept = longest_run(d, match, n, keep);
+            ok = (kept != NONE);
+        }
+    }
+
+    size_t pos = prefix;
+    size_t i0 = 0;
+    size_t j0 = 0;
+    for (size_t k = 0; ok && k <= kept; k++) {
+
+        // The end works as one more element kept
+        size_t i1 = (k < kept) ? keep[k] : n;
+        size_t j1 = (k < kept) ? match[i1] : m;
+
+        size_t q = 0;
+        for (; ok && i0 + q < i1 && j0 + q < j1; q++) {
+            path_t sub = {.up=path, .index=pos++};
+            ok = diff_any(d, list_a[i0 + q], list_b[j0 + q], &sub);
+        }
+        for (size_t r = i0 + q; ok && r < i1; r++) {
+            path_t sub = {.up=path, .index=pos};
+            ok = emit(d, "remove", &sub, NULL);
+        }
+        for (size_t r = j0 + q; ok && r < j1; r++) {
+            path_t sub = {.up=path, .index=pos++};
+            ok = emit(d, "add", &sub, list_b[r]);
+        }
+        pos++;
+        i0 = i1 + 1;
+        j0 = j1 + 1;
+    }
+
+    ejson_arena_restore(&d->scratch, save);
+    return ok;
+}
+
+static bool diff_any(differ_t *d, ejson_value *a, ejson_value *b, const path_t *path)
+{
+    if (same(a, b))
+        return true;
+
+    if (a->type == EJSON_OBJECT && b->type == EJSON_OBJECT)
+        return diff_obj(d, a, b, path);
+
+    if (a->type == EJSON_ARRAY && b->type == EJSON_ARRAY)
+        return diff_arr(d, a, b, path);
+
+    return emit(d, "replace", path, b);
+}
+
+ejson_value *ejson_diff(ejson_value *from, ejson_value *to, ejson_arena *arena,
+                        const ejson_allocator *allocator)
+{
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    differ_t d = {
+        .arena   = arena,
+        .scratch = {.allocator = allocator ? allocator : &ejson_stdalloc},
+        .patch   = ejson_make_array(arena),
+        .last    = NULL,
+    };
+    bool ok = d.patch && diff_any(&d, from, to, NULL);
+    ejson_arena_free(&d.scratch);
+
+    if (!ok) {
+        ejson_arena_restore(arena, save);
+        return NULL;
+    }
+    return d.patch;
+}
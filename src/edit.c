@@ -0,0 +1,308 @@
+#include <math.h>
+#include <string.h>
+#include <stdalign.h>
+#include "value.h"
+#include "index.h"
+#include "arena.h"
+#include "number.h"
+
+static ejson_value *alloc_val(ejson_arena *arena)
+{
+    return ejson_arena_alloc(arena, sizeof(ejson_value), alignof(ejson_value));
+}
+
+static const char *copy_str(ejson_arena *arena, const char *str, size_t len, bool *ok)
+{
+    *ok = true;
+    if (len == 0)
+        return NULL;
+    char *copy = ejson_arena_alloc(arena, len, 1);
+    if (copy == NULL) {
+        *ok = false;
+        return NULL;
+    }
+    memcpy(copy, str, len);
+    return copy;
+}
+
+ejson_value *ejson_make_null(ejson_arena *arena)
+{
+    ejson_value *val = alloc_val(arena);
+    if (val) init_val_for_null(val);
+    return val;
+}
+
+ejson_value *ejson_make_bool(ejson_arena *arena, bool value)
+{
+    ejson_value *val = alloc_val(arena);
+    if (val == NULL)
+        return NULL;
+    if (value)
+        init_val_for_true(val);
+    else
+        init_val_for_false(val);
+    return val;
+}
+
+ejson_value *ejson_make_int(ejson_arena *arena, int64_t value)
+{
+    ejson_value *val = alloc_val(arena);
+    if (val) init_val_for_num(val, (ejson_number) {.as_int=value, .as_flt=(double) value, .is_int=true});
+    return val;
+}
+
+ejson_value *ejson_make_float(ejson_arena *arena, double value)
+{
+    ejson_value *val = alloc_val(arena);
+    if (val == NULL)
+        return NULL;
+    int64_t as_int = isnan(value) ? 0 : ejson_saturate(value);
+    init_val_for_num(val, (ejson_number) {.as_int=as_int, .as_flt=value, .is_int=false});
+    return val;
+}
+
+ejson_value *ejson_make_string(ejson_arena *arena, const char *str, size_t len)
+{
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    ejson_value *val = alloc_val(arena);
+    if (val == NULL)
+        return NULL;
+
+    bool ok;
+    const char *copy = copy_str(arena, str, len, &ok);
+    if (!ok) {
+        ejson_arena_restore(arena, save);
+        return NULL;
+    }
+    init_val_for_str(val, (ejson_string) {.base=copy, .size=len});
+    return val;
+}
+
+ejson_value *ejson_make_array(ejson_arena *arena)
+{
+    ejson_value *val = alloc_val(arena);
+    if (val) init_val_for_arr(val, NULL, 0);
+    return val;
+}
+
+ejson_value *ejson_make_object(ejson_arena *arena)
+{
+    ejson_value *val = alloc_val(arena);
+    if (val) init_val_for_obj(val, NULL, 0);
+    return val;
+}
+
+static bool is_container(ejson_value *val)
+{
+    return val->type == EJSON_ARRAY || val->type == EJSON_OBJECT;
+}
+
+static bool is_detached(ejson_value *val)
+{
+    return val->parent == NULL && val->prev == NULL;
+}
+
+bool ejson_setkey(ejson_value *val, const char *key, size_t size, ejson_arena *arena)
+{
+    if (!is_detached(val))
+        return false;
+
+    bool ok;
+    const char *copy = copy_str(arena, key, size, &ok);
+    if (!ok)
+        return false;
+    val->key = (ejson_string) {.base=copy, .size=size};
+    val->flags &= ~(EJSON_FLAG_ESCAPED_KEY | EJSON_FLAG_INTERNED_KEY);
+    return true;
+}
+
+// Called when the children of a container change
+static void touch(ejson_value *parent)
+{
+    // Removing or inserting a child breaks the block
+    parent->flags &= ~EJSON_FLAG_CONTIGUOUS;
+
+    // Hashes are cached for whole subtrees and the ancestors of
+    // dirty values are dirty, so the walk can stop at the first
+    // ancestor that is dirty and has no hash.
+    for (ejson_value *val = parent; val; val = val->parent) {
+        if ((val->flags & (EJSON_FLAG_HASHED | EJSON_FLAG_DIRTY)) == EJSON_FLAG_DIRTY)
+            break;
+        val->flags &= ~EJSON_FLAG_HASHED;
+        val->flags |= EJSON_FLAG_DIRTY;
+    }
+}
+
+// Whether "val" can be made a child of "parent"
+static bool can_adopt(ejson_value *parent, ejson_value *val)
+{
+    if (!is_container(parent) || !is_detached(val))
+        return false;
+
+    // No container can end up inside itself
+    for (ejson_value *anc = parent; anc; anc = anc->parent)
+        if (anc == val)
+            return false;
+    return true;
+}
+
+// Links "val" where "link" points, which is the
+// "next" of a child or the head of the parent.
+static void link_at(ejson_value *parent, ejson_value **link, ejson_value *val)
+{
+    val->parent = parent;
+    val->prev = link;
+    val->next = *link;
+    if (val->next)
+        val->next->prev = &val->next;
+    *link = val;
+
+    parent->when_array.size++;
+    if (parent->type == EJSON_OBJECT)
+        ejson_keyindex_added(parent, val);
+    touch(parent);
+}
+
+bool ejson_append(ejson_value *parent, ejson_value *val)
+{
+    if (!can_adopt(parent, val))
+        return false;
+
+    ejson_value **link = &parent->when_array.head;
+    if (parent->flags & EJSON_FLAG_CONTIGUOUS) {
+        if (parent->when_array.size > 0)
+            link = &parent->when_array.head[parent->when_array.size-1].next;
+    } else {
+        while (*link)
+            link = &(*link)->next;
+    }
+    link_at(parent, link, val);
+    return true;
+}
+
+bool ejson_insert_before(ejson_value *sibling, ejson_value *val)
+{
+    if (sibling->parent == NULL || !can_adopt(sibling->parent, val))
+        return false;
+    link_at(sibling->parent, sibling->prev, val);
+    return true;
+}
+
+bool ejson_insert_after(ejson_value *sibling, ejson_value *val)
+{
+    if (sibling->parent == NULL || !can_adopt(sibling->parent, val))
+        return false;
+    link_at(sibling->parent, &sibling->next, val);
+    return true;
+}
+
+void ejson_remove(ejson_value *val)
+{
+    ejson_value *parent = val->parent;
+    if (parent == NULL)
+        return;
+
+    if (parent->type == EJSON_OBJECT)
+        ejson_keyindex_removed(parent, val);
+
+    *val->prev = val->next;
+    if (val->next)
+        val->next->prev = val->prev;
+    parent->when_array.size--;
+    touch(parent);
+
+    val->parent = NULL;
+    val->prev = NULL;
+    val->next = NULL;
+}
+
+bool ejson_replace(ejson_value *old, ejson_value *val)
+{
+    ejson_value *parent = old->parent;
+    if (parent == NULL || old == val || !can_adopt(parent, val))
+        return false;
+
+    // The key goes with the position
+    uint32_t key_flags = EJSON_FLAG_ESCAPED_KEY | EJSON_FLAG_INTERNED_KEY;
+    val->key = old->key;
+    val->flags = (val->flags & ~key_flags) | (old->flags & key_flags);
+
+    if (parent->type == EJSON_OBJECT)
+        ejson_keyindex_replaced(parent, old, val);
+
+    val->parent = parent;
+    val->prev = old->prev;
+    val->next = old->next;
+    *val->prev = val;
+    if (val->next)
+        val->next->prev = &val->next;
+    touch(parent);
+
+    old->parent = NULL;
+    old->prev = NULL;
+    old->next = NULL;
+    return true;
+}
+
+bool ejson_setbykey(ejson_value *obj, const char *key, size_t size,
+                    ejson_value *val, ejson_arena *arena)
+{
+    if (obj->type != EJSON_OBJECT || !can_adopt(obj, val))
+        return false;
+
+    ejson_value *old = ejson_seekbykey2(obj, key, size);
+    if (old)
+        return ejson_replace(old, val);
+
+    if (!ejson_setkey(val, key, size, arena))
+        return false;
+    return ejson_append(obj, val);
+}
+
+// Copies "src" into "dst", which stays where it is so that its
+// first child can point back at it.
+static bool copy_into(ejson_value *dst, ejson_value *src, ejson_arena *arena)
+{
+    *dst = *src;
+    dst->prev   = NULL;
+    dst->next   = NULL;
+    dst->parent = NULL;
+
+    if (!is_container(src))
+        return true;
+
+    size_t size = src->when_array.size;
+    dst->when_array.head  = NULL;
+    dst->when_array.index = NULL;
+    dst->flags |= EJSON_FLAG_CONTIGUOUS;
+    if (size == 0)
+        return true;
+
+    ejson_value *block = ejson_arena_alloc(arena, size * sizeof(ejson_value), alignof(ejson_value));
+    if (block == NULL)
+        return false;
+
+    ejson_value *child = src->when_array.head;
+    for (size_t i = 0; i < size; i++, child = child->next) {
+        if (!copy_into(&block[i], child, arena))
+            return false;
+        block[i].parent = dst;
+        block[i].prev = i ? &block[i-1].next : &dst->when_array.head;
+        block[i].next = i+1 < size ? &block[i+1] : NULL;
+    }
+    dst->when_array.head = block;
+    return true;
+}
+
+ejson_value *ejson_copy(ejson_value *val, ejson_arena *arena)
+{
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    ejson_value *copy = alloc_val(arena);
+    if (copy == NULL || !copy_into(copy, val, arena)) {
+        ejson_arena_restore(arena, save);
+        return NULL;
+    }
+    return copy;
+}
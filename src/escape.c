@@ -0,0 +1,201 @@
+#include <string.h>
+#include "arena.h"
+#include "escape.h"
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool ejson_check_escape(const char *src, size_t len, size_t *cur)
+{
+    size_t i = *cur + 1; // Skip the backslash
+    if (i == len) {
+        *cur = i;
+        return false;
+    }
+
+    switch (src[i]) {
+        case '"': case '\'': case '\\': case '/':
+        case 'b': case 'f':  case 'n':  case 'r': case 't':
+        *cur = i + 1;
+        return true;
+
+        case 'u':
+        i++;
+        for (int k = 0; k < 4; k++, i++) {
+            if (i == len || hex_value(src[i]) < 0) {
+                *cur = i;
+                return false;
+            }
+        }
+        *cur = i;
+        return true;
+    }
+    *cur = i;
+    return false;
+}
+
+static unsigned int read_hex4(const char *src)
+{
+    unsigned int code = 0;
+    for (int k = 0; k < 4; k++)
+        code = (code << 4) | hex_value(src[k]);
+    return code;
+}
+
+static size_t encode_utf8(unsigned int code, char *dst)
+{
+    if (code < 0x80) {
+        dst[0] = code;
+        return 1;
+    }
+    if (code < 0x800) {
+        dst[0] = 0xC0 | (code >> 6);
+        dst[1] = 0x80 | (code & 0x3F);
+        return 2;
+    }
+    if (code < 0x10000) {
+        dst[0] = 0xE0 | (code >> 12);
+        dst[1] = 0x80 | ((code >> 6) & 0x3F);
+        dst[2] = 0x80 | (code & 0x3F);
+        return 3;
+    }
+    dst[0] = 0xF0 | (code >> 18);
+    dst[1] = 0x80 | ((code >> 12) & 0x3F);
+    dst[2] = 0x80 | ((code >> 6) & 0x3F);
+    dst[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
+
+size_t ejson_unescape_next(const char *src, size_t len, size_t *cur, char *dst)
+{
+    size_t i = *cur;
+    if (src[i] != '\\') {
+        *cur = i + 1;
+        dst[0] = src[i];
+        return 1;
+    }
+
+    char c = src[i+1];
+    *cur = i + 2;
+    switch (c) {
+        case 'b': dst[0] = '\b'; return 1;
+        case 'f': dst[0] = '\f'; return 1;
+        case 'n': dst[0] = '\n'; return 1;
+        case 'r': dst[0] = '\r'; return 1;
+        case 't': dst[0] = '\t'; return 1;
+        case 'u': break;
+        default:  dst[0] = c;    return 1;
+    }
+
+    unsigned int code = read_hex4(src + i + 2);
+    *cur = i + 6;
+
+    if (code >= 0xD800 && code < 0xDC00) {
+        // High surrogate, which needs a low one right after
+        if (i + 12 <= len && src[i+6] == '\\' && src[i+7] == 'u') {
+            unsigned int low = read_hex4(src + i + 8);
+            if (low >= 0xDC00 && low < 0xE000) {
+                *cur = i + 12;
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                return encode_utf8(code, dst);
+            }
+        }
+        code = 0xFFFD;
+    } else if (code >= 0xDC00 && code < 0xE000)
+        code = 0xFFFD;
+
+    return encode_utf8(code, dst);
+}
+
+size_t ejson_unescape_to(ejson_string raw, char *dst)
+{
+    size_t num = 0;
+    size_t cur = 0;
+    while (cur < raw.size) {
+        // Copy up to the next escape in one go
+        const char *next = memchr(raw.base + cur, '\\', raw.size - cur);
+        size_t end = next ? (size_t) (next - raw.base) : raw.size;
+        memcpy(dst + num, raw.base + cur, end - cur);
+        num += end - cur;
+        cur = end;
+        if (cur < raw.size)
+            num += ejson_unescape_next(raw.base, raw.size, &cur, dst + num);
+    }
+    return num;
+}
+
+bool ejson_strings_equal(ejson_string str1, bool raw1, ejson_string str2, bool raw2)
+{
+    if (!raw1 && !raw2)
+        return str1.size == str2.size
+            && (str1.size == 0 || !memcmp(str1.base, str2.base, str1.size));
+
+    // Decoded strings aren't longer than raw ones
+    if (!raw1 && str1.size > str2.size)
+        return false;
+    if (!raw2 && str2.size > str1.size)
+        return false;
+
+    // Characters are decoded one at a time and their
+    // bytes compared as they become available.
+    char buf1[4], buf2[4];
+    size_t cur1 = 0, cur2 = 0;
+    size_t num1 = 0, num2 = 0;
+    size_t off1 = 0, off2 = 0;
+    for (;;) {
+        if (off1 == num1 && cur1 < str1.size) {
+            if (raw1)
+                num1 = ejson_unescape_next(str1.base, str1.size, &cur1, buf1);
+            else {
+                buf1[0] = str1.base[cur1++];
+                num1 = 1;
+            }
+            off1 = 0;
+        }
+        if (off2 == num2 && cur2 < str2.size) {
+            if (raw2)
+                num2 = ejson_unescape_next(str2.base, str2.size, &cur2, buf2);
+            else {
+                buf2[0] = str2.base[cur2++];
+                num2 = 1;
+            }
+            off2 = 0;
+        }
+        bool end1 = (off1 == num1);
+        bool end2 = (off2 == num2);
+        if (end1 || end2)
+            return end1 && end2;
+        if (buf1[off1++] != buf2[off2++])
+            return false;
+    }
+}
+
+static bool unescape_string(ejson_string *str, ejson_arena *arena)
+{
+    char *dst = ejson_arena_alloc(arena, str->size, 1);
+    if (dst == NULL && str->size > 0)
+        return false;
+    str->size = ejson_unescape_to(*str, dst);
+    str->base = dst;
+    return true;
+}
+
+bool ejson_unescape(ejson_value *val, ejson_arena *arena)
+{
+    if (val->flags & EJSON_FLAG_ESCAPED) {
+        if (!unescape_string(&val->when_string, arena))
+            return false;
+        val->flags &= ~EJSON_FLAG_ESCAPED;
+    }
+    if (val->flags & EJSON_FLAG_ESCAPED_KEY) {
+        if (!unescape_string(&val->key, arena))
+            return false;
+        val->flags &= ~EJSON_FLAG_ESCAPED_KEY;
+    }
+    return true;
+}
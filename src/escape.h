@@ -0,0 +1,30 @@
+#ifndef EJSON_ESCAPE_H
+#define EJSON_ESCAPE_H
+
+#include "ejson.h"
+
+// Strings with escape sequences are stored as they appear in the
+// source, between the quotes, and flagged. These functions check
+// and decode them. Decoding never makes a string longer.
+
+// Checks the escape sequence whose backslash is at "*cur" and moves
+// past it. On failure "cur" is left at the offending byte, which is
+// "len" when the source ends within the sequence.
+bool ejson_check_escape(const char *src, size_t len, size_t *cur);
+
+// Decodes the character of a raw string at "*cur", escaped or not,
+// into "dst" as UTF-8 and moves past it. Returns the number of bytes
+// written, at most 4. Unpaired surrogates decode to U+FFFD.
+size_t ejson_unescape_next(const char *src, size_t len, size_t *cur, char *dst);
+
+// Compares two strings, each one decoded first when it's raw
+bool ejson_strings_equal(ejson_string str1, bool raw1, ejson_string str2, bool raw2);
+
+// Whether the key of the value is "key"
+static inline bool ejson_key_equals(const ejson_value *val, const char *key, size_t size)
+{
+    ejson_string plain = {.base=key, .size=size};
+    return ejson_strings_equal(val->key, val->flags & EJSON_FLAG_ESCAPED_KEY, plain, false);
+}
+
+#endif
@@ -0,0 +1,238 @@
+#include <string.h>
+#include "ejson.h"
+#include "walk.h"
+#include "arena.h"
+#include "pattern.h"
+#include "escape.h"
+
+// Runs a compiled pattern while walking the source. Only the values
+// unpacked by a "$" are built, while the rest of the document is
+// skipped.
+
+typedef struct {
+    ejson_walker walker;
+    ejson_arena *arena;
+    ejson_value **out;
+
+    // Cleared by the first mismatch. From then on
+    // the rest of the source is only skipped.
+    bool matching;
+} context_t;
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Type of the value at the cursor, judging by its first
+// character. It's only trusted once the value is parsed.
+static ejson_type type_at(context_t *ctx)
+{
+    ejson_walker *w = &ctx->walker;
+    char c = w->src[w->cur];
+    if (c == '"' || (c == '\'' && w->config.allow_single_quoted_strings))
+        return EJSON_STRING;
+    if (c == '[') return EJSON_ARRAY;
+    if (c == '{') return EJSON_OBJECT;
+    if (c == 't' || c == 'f') return EJSON_BOOLEAN;
+    if (is_digit(c) || c == '-') return EJSON_NUMBER;
+    return EJSON_NULL;
+}
+
+static bool mismatch(context_t *ctx)
+{
+    ctx->matching = false;
+    return ejson_walk_skip(&ctx->walker);
+}
+
+static bool walk_unpack(context_t *ctx, const instr_t *ins)
+{
+    if (type_at(ctx) != ins->type)
+        return mismatch(ctx);
+
+    ejson_walker *w = &ctx->walker;
+    size_t end;
+    ejson_value *val = ejson_parse2(w->src + w->cur, w->len - w->cur,
+                                    &end, w->error, ctx->arena, w->config);
+    if (val == NULL)
+        return false;
+    w->cur += end;
+
+    ctx->out[ins->slot] = val;
+    return true;
+}
+
+static bool walk_literal(context_t *ctx, const instr_t *ins)
+{
+    ejson_type type = type_at(ctx);
+    if (type == EJSON_ARRAY || type == EJSON_OBJECT)
+        return mismatch(ctx);
+
+    // Scalars take a single value, so it's
+    // parsed on the stack.
+    ejson_walker *w = &ctx->walker;
+    ejson_value scratch;
+    ejson_arena arena = {.base=&scratch, .size=sizeof(scratch)};
+    ejson_config config = w->config;
+    config.contiguous_children = false;
+
+    size_t end;
+    ejson_value *val = ejson_parse2(w->src + w->cur, w->len - w->cur,
+                                    &end, w->error, &arena, config);
+    if (val == NULL)
+        return false;
+    w->cur += end;
+
+    if (!ejson_valcmp(val, ins->literal))
+        ctx->matching = false;
+    return true;
+}
+
+// Items of the array or object instruction
+// the source is being matched against
+typedef struct {
+    context_t     *ctx;
+    const instr_t *ins;
+    const instr_t *item; // Next item of an array
+    size_t         num;  // Elements of the array so far
+    bool          *seen; // Items of an object already matched
+    size_t         left; // and how many aren't
+} items_t;
+
+static const void *array_item(void *state, size_t index, ejson_string key, bool escaped)
+{
+    (void) key;
+    (void) escaped;
+    items_t *items = state;
+    items->num = index + 1;
+
+    // Elements after the last item aren't needed
+    if (index >= items->ins->count)
+        return NULL;
+    const instr_t *item = items->item;
+    items->item += item->length;
+    return item;
+}
+
+static bool array_done(void *state)
+{
+    items_t *items = state;
+    return items->num >= items->ins->count || !items->ctx->matching;
+}
+
+// Only the first value with a given key counts,
+// like for ejson_seekbykey.
+static const void *object_item(void *state, size_t index, ejson_string key, bool escaped)
+{
+    (void) index;
+    items_t *items = state;
+    const instr_t *item = items->ins + 1;
+    for (size_t i = 0; i < items->ins->count; i++) {
+        if (!items->seen[i] && ejson_strings_equal(key, escaped, item->key, false)) {
+            items->seen[i] = true;
+            items->left--;
+            return item;
+        }
+        item += item->length;
+    }
+    return NULL;
+}
+
+static bool object_done(void *state)
+{
+    items_t *items = state;
+    return items->left == 0 || !items->ctx->matching;
+}
+
+static const ejson_walk_children array_items  = {array_item,  array_done};
+static const ejson_walk_children object_items = {object_item, object_done};
+
+static bool walk_arr(context_t *ctx, const instr_t *ins)
+{
+    items_t items = {.ctx=ctx, .ins=ins, .item=ins + 1};
+    if (!ejson_walk_array(&ctx->walker, &array_items, &items))
+        return false;
+
+    if (items.num < ins->count)
+        ctx->matching = false;
+    return true;
+}
+
+static bool walk_obj(context_t *ctx, const instr_t *ins)
+{
+    bool seen[ins->count + 1];
+    memset(seen, 0, sizeof(seen));
+
+    items_t items = {.ctx=ctx, .ins=ins, .seen=seen, .left=ins->count};
+    if (!ejson_walk_object(&ctx->walker, &object_items, &items))
+        return false;
+
+    if (items.left > 0)
+        ctx->matching = false;
+    return true;
+}
+
+static bool walk(ejson_walker *w, const void *node)
+{
+    context_t *ctx = w->userp;
+    const instr_t *ins = node;
+
+    if (ins->op == OP_ANY || !ctx->matching)
+        return ejson_walk_skip(w);
+
+    switch (ins->op) {
+
+        case OP_UNPACK:
+        return walk_unpack(ctx, ins);
+
+        case OP_LITERAL:
+        return walk_literal(ctx, ins);
+
+        case OP_ARRAY:
+        if (w->src[w->cur] != '[')
+            return mismatch(ctx);
+        if (ins->count == 0)
+            return ejson_walk_skip(w);
+        return walk_arr(ctx, ins);
+
+        case OP_OBJECT:
+        if (w->src[w->cur] != '{')
+            return mismatch(ctx);
+        if (ins->count == 0)
+            return ejson_walk_skip(w);
+        return walk_obj(ctx, ins);
+    }
+    return ejson_walk_skip(w);
+}
+
+ejson_matchresult ejson_parse_and_unpack(const char *src, size_t len, size_t *end,
+                                         ejson_error *error, ejson_arena *arena,
+                                         ejson_config config, const ejson_pattern *pattern,
+                                         ejson_value **out)
+{
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    context_t ctx = {
+        .walker = {
+            .error = error,
+            .src = src,
+            .cur = 0,
+            .len = len,
+            .config = config,
+            .value = walk,
+        },
+        .arena = arena,
+        .out = out,
+        .matching = true,
+    };
+    ctx.walker.userp = &ctx;
+
+    if (!ejson_walk_value(&ctx.walker, pattern->code)) {
+        ejson_arena_restore(arena, save);
+        return EJSON_BADFORMAT;
+    }
+
+    if (end)
+        *end = ctx.walker.cur;
+    return ctx.matching ? EJSON_MATCH : EJSON_NOMATCH;
+}
@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <string.h>
+#include <stdalign.h>
+#include "ejson.h"
+#include "scan.h"
+#include "arena.h"
+#include "index.h"
+#include "value.h"
+#include "number.h"
+#include "keydict.h"
+#include "parse.h"
+
+// The grammar and the error messages are the same as the recursive
+// parser of parse.c, but the position in the grammar is kept in
+// "state" and the open containers in a stack of frames, so that
+// parsing can stop at the end of a chunk and resume with the next.
+// Tokens are only scanned for where they end, then read by the
+// lexers of parse.c once they are whole.
+
+enum {
+    STATE_VALUE,     // Before a value
+    STATE_ARR_FIRST, // After "["
+    STATE_ARR_NEXT,  // After "," in an array
+    STATE_OBJ_FIRST, // After "{"
+    STATE_OBJ_NEXT,  // After "," in an object
+    STATE_KEY,       // Inside a key
+    STATE_KEY_ESC,   // After a backslash in a key
+    STATE_COLON,     // After a key
+    STATE_AFTER,     // After a value in a container
+    STATE_STRING,    // Inside a string value
+    STATE_STRING_ESC,// After a backslash in a string value
+    STATE_NUMBER,    // Inside a number
+    STATE_WORD,      // Inside null, true or false
+    STATE_DONE,
+    STATE_ERROR,
+};
+
+struct ejson_parser_frame {
+    ejson_parser_frame *outer;
+    ejson_type          type;
+    ejson_value        *head;
+    ejson_value       **tail;
+    size_t              size;
+    ejson_string        key; // Key of the value being parsed
+    bool                key_escaped;
+    bool                key_interned;
+};
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool is_alpha(char c)
+{
+    return (c >= 'a' && c <= 'z')
+        || (c >= 'A' && c <= 'Z');
+}
+
+static bool is_printable(char c)
+{
+    return c >= 32 && c < 127;
+}
+
+static void report(ejson_error *error, const char *fmt, ...)
+{
+    if (!error)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error->msg, sizeof(error->msg), fmt, args);
+    va_end(args);
+}
+
+static void *alloc_or_report(ejson_parser *parser, size_t size, size_t align)
+{
+    void *mem = ejson_arena_alloc(parser->arena, size, align);
+    if (mem == NULL) {
+        report(parser->error, "Out of arena");
+        return NULL;
+    }
+    return mem;
+}
+
+static void tok_begin(ejson_parser *parser)
+{
+    parser->tok = NULL;
+    parser->toklen = 0;
+    parser->tokcap = 0;
+}
+
+static bool tok_is_last(ejson_parser *parser)
+{
+    ejson_arena *arena = parser->arena;
+    return parser->tok && parser->tok + parser->tokcap == (char*) arena->base + arena->used;
+}
+
+static bool tok_append(ejson_parser *parser, const char *src, size_t len)
+{
+    size_t need = parser->toklen + len;
+    if (need > parser->tokcap) {
+
+        ejson_arena *arena = parser->arena;
+
+        // Nothing else is allocated while a token is being built,
+        // so it can usually grow in place.
+        if (tok_is_last(parser) && need - parser->tokcap <= arena->size - arena->used) {
+            arena->used += need - parser->tokcap;
+            parser->tokcap = need;
+        } else {
+            size_t cap = 2 * parser->tokcap;
+            if (cap < need) cap = need;
+            if (cap < 16)   cap = 16;
+            char *tok = alloc_or_report(parser, cap, 1);
+            if (tok == NULL)
+                return false;
+            if (parser->toklen > 0)
+                memcpy(tok, parser->tok, parser->toklen);
+            parser->tok = tok;
+            parser->tokcap = cap;
+        }
+    }
+    if (len > 0)
+        memcpy(parser->tok + parser->toklen, src, len);
+    parser->toklen = need;
+    return true;
+}
+
+// Gives back the unused capacity of the token
+static void tok_keep(ejson_parser *parser)
+{
+    if (tok_is_last(parser))
+        parser->arena->used -= parser->tokcap - parser->toklen;
+}
+
+static void tok_drop(ejson_parser *parser)
+{
+    if (tok_is_last(parser))
+        parser->arena->used -= parser->tokcap;
+}
+
+static bool push_frame(ejson_parser *parser, ejson_type type)
+{
+    ejson_parser_frame *frame = parser->spare;
+    if (frame)
+        parser->spare = frame->outer;
+    else {
+        frame = alloc_or_report(parser, sizeof(ejson_parser_frame), alignof(ejson_parser_frame));
+        if (frame == NULL)
+            return false;
+    }
+    frame->outer = parser->frames;
+    frame->type = type;
+    frame->head = NULL;
+    frame->tail = &frame->head;
+    frame->size = 0;
+    frame->key  = EMPTY_STRING;
+    frame->key_escaped = false;
+    frame->key_interned = false;
+    parser->frames = frame;
+    return true;
+}
+
+static ejson_value *make_val(ejson_parser *parser)
+{
+    return alloc_or_report(parser, sizeof(ejson_value), alignof(ejson_value));
+}
+
+static void complete_value(ejson_parser *parser, ejson_value *val)
+{
+    ejson_parser_frame *frame = parser->frames;
+    if (frame == NULL) {
+        parser->root = val;
+        parser->state = STATE_DONE;
+        return;
+    }
+
+    // Insert the value into the container
+    if (frame->type == EJSON_OBJECT) {
+        val->key = frame->key;
+        if (frame->key_escaped)
+            val->flags |= EJSON_FLAG_ESCAPED_KEY;
+        if (frame->key_interned)
+            val->flags |= EJSON_FLAG_INTERNED_KEY;
+    }
+    val->prev = frame->tail;
+    *frame->tail = val;
+    frame->tail = &val->next;
+    frame->size++;
+
+    parser->state = STATE_AFTER;
+}
+
+static bool close_container(ejson_parser *parser)
+{
+    ejson_parser_frame *frame = parser->frames;
+    *frame->tail = NULL;
+
+    ejson_value *val = make_val(parser);
+    if (val == NULL)
+        return false;
+
+    if (frame->type == EJSON_OBJECT)
+        init_val_for_obj(val, frame->head, frame->size);
+    else
+        init_val_for_arr(val, frame->head, frame->size);
+    adopt_children(val);
+
+    if (frame->type == EJSON_OBJECT) {
+        ejson_config *config = &parser->config;
+        if (!ejson_keyindex_attach(val, parser->arena, parser->arena, config->key_index, config->key_index_min)) {
+            report(parser->error, "Out of arena");
+            return false;
+        }
+    }
+
+    parser->frames = frame->outer;
+    frame->outer = parser->spare;
+    parser->spare = frame;
+
+    complete_value(parser, val);
+    return true;
+}
+
+// Strings, numbers and words are read as tokens,
+// which start with the first character.
+static bool begin_token(ejson_parser *parser, int state, char c)
+{
+    parser->state = state;
+    tok_begin(parser);
+    return tok_append(parser, &c, 1);
+}
+
+static bool begin_value(ejson_parser *parser, char c)
+{
+    if (c == '"' || (c == '\'' && parser->config.allow_single_quoted_strings)) {
+        parser->quote = c;
+        return begin_token(parser, STATE_STRING, c);
+    }
+
+    if (c == '{') {
+        parser->state = STATE_OBJ_FIRST;
+        return push_frame(parser, EJSON_OBJECT);
+    }
+
+    if (c == '[') {
+        parser->state = STATE_ARR_FIRST;
+        return push_frame(parser, EJSON_ARRAY);
+    }
+
+    if (is_digit(c) || c == '-')
+        return begin_token(parser, STATE_NUMBER, c);
+
+    if (is_alpha(c))
+        return begin_token(parser, STATE_WORD, c);
+
+    // Nothing else starts a value, which
+    // the lexer of words reports.
+    size_t cur = 0;
+    bool value;
+    ejson_type type;
+    return ejson_lex_word(&c, 1, &cur, parser->error, &type, &value);
+}
+
+static bool begin_key(ejson_parser *parser, char c)
+{
+    if (c != '"') {
+        if (is_printable(c))
+            report(parser->error, "Missing key (character '%c' instead)", c);
+        else
+            report(parser->error, "Invalid byte %x in object", c);
+        return false;
+    }
+    parser->quote = c;
+    return begin_token(parser, STATE_KEY, c);
+}
+
+// Reads the number once it can't grow any more, which is when the
+// token is "whole" or the number ends before the end of the token.
+// A whole token has the byte that stopped it as its last, so that
+// errors about that byte are the same as in parse.c. The bytes of the
+// token after the number are stored in "back" to be scanned again.
+static bool finish_number(ejson_parser *parser, bool whole, size_t *back)
+{
+    *back = 0;
+
+    ejson_number num;
+    if (!whole) {
+        size_t end;
+        ejson_parse_number(parser->tok, parser->toklen, &end, &num);
+        if (end == parser->toklen)
+            return true; // May still grow
+    }
+
+    size_t cur = 0;
+    if (!ejson_lex_number(parser->tok, parser->toklen, &cur, parser->error, &num))
+        return false;
+    *back = parser->toklen - cur;
+    tok_drop(parser);
+
+    ejson_value *val = make_val(parser);
+    if (val == NULL)
+        return false;
+    init_val_for_num(val, num);
+
+    complete_value(parser, val);
+    return true;
+}
+
+static bool finish_word(ejson_parser *parser)
+{
+    size_t cur = 0;
+    bool value;
+    ejson_type type;
+    if (!ejson_lex_word(parser->tok, parser->toklen, &cur, parser->error, &type, &value))
+        return false;
+    tok_drop(parser);
+
+    ejson_value *val = make_val(parser);
+    if (val == NULL)
+        return false;
+    if (type == EJSON_NULL)
+        init_val_for_null(val);
+    else if (value)
+        init_val_for_true(val);
+    else
+        init_val_for_false(val);
+
+    complete_value(parser, val);
+    return true;
+}
+
+// The chunks are only scanned past escape sequences, so the string
+// is read once it's whole, quotes included. At the end of the source
+// it has no closing quote, and reading it reports why.
+static bool finish_string(ejson_parser *parser)
+{
+    size_t cur = 0;
+    bool escaped;
+    ejson_string str;
+    if (!ejson_lex_string(parser->tok, parser->toklen, &cur, parser->error, &str, &escaped))
+        return false;
+
+    if (parser->state == STATE_KEY) {
+        ejson_parser_frame *frame = parser->frames;
+
+        // Interned keys don't need a copy in the arena
+        const char *interned = NULL;
+        if (parser->config.key_dict && !escaped)
+            interned = ejson_keydict_intern_after(parser->config.key_dict,
+                                                  frame->key_interned ? frame->key.base : NULL,
+                                                  str.base, str.size);
+        if (interned) {
+            str.base = interned;
+            tok_drop(parser);
+        } else
+            tok_keep(parser);
+        frame->key = str;
+        frame->key_escaped = escaped;
+        frame->key_interned = (interned != NULL);
+        parser->state = STATE_COLON;
+        return true;
+    }
+
+    tok_keep(parser);
+
+    ejson_value *val = make_val(parser);
+    if (val == NULL)
+        return false;
+    init_val_for_str(val, str);
+    if (escaped)
+        val->flags |= EJSON_FLAG_ESCAPED;
+
+    complete_value(parser, val);
+    return true;
+}
+
+// Moves past the bytes that may belong to a number and
+// tells whether they were all digits.
+static size_t scan_number(const char *src, size_t cur, size_t len, bool *digits)
+{
+    *digits = true;
+    for (; cur < len; cur++) {
+        char c = src[cur];
+        if (is_digit(c))
+            continue;
+        if (c != '.' && c != 'e' && c != 'E' && c != '+' && c != '-')
+            break;
+        *digits = false;
+    }
+    return cur;
+}
+
+static size_t scan_alpha(const char *src, size_t cur, size_t len)
+{
+    while (cur < len && is_alpha(src[cur]))
+        cur++;
+    return cur;
+}
+
+// Runs the state machine over the chunk until it's
+// consumed or the value is complete.
+static bool step(ejson_parser *parser, const char *src, size_t len, size_t *pcur)
+{
+    size_t cur = *pcur;
+
+    while (cur < len && parser->state != STATE_DONE) {
+
+        ejson_parser_frame *frame = parser->frames;
+        size_t off, back;
+        bool whole, digits, leading;
+        char c;
+
+        switch (parser->state) {
+
+            case STATE_VALUE:
+            case STATE_ARR_NEXT:
+            cur = ejson_scan_spaces(src, cur, len);
+            if (cur == len)
+                break;
+            if (!begin_value(parser, src[cur++]))
+                return false;
+            break;
+
+            case STATE_ARR_FIRST:
+            cur = ejson_scan_spaces(src, cur, len);
+            if (cur == len)
+                break;
+            if (src[cur] == ']') {
+                cur++;
+                if (!close_container(parser))
+                    return false;
+            } else
+                parser->state = STATE_VALUE;
+            break;
+
+            case STATE_OBJ_FIRST:
+            case STATE_OBJ_NEXT:
+            cur = ejson_scan_spaces(src, cur, len);
+            if (cur == len)
+                break;
+            if (src[cur] == '}' && parser->state == STATE_OBJ_FIRST) {
+                cur++;
+                if (!close_container(parser))
+                    return false;
+                break;
+            }
+            if (!begin_key(parser, src[cur++]))
+                return false;
+            break;
+
+            case STATE_KEY_ESC:
+            case STATE_STRING_ESC:
+            // The byte after a backslash can't close the string
+            if (!tok_append(parser, src + cur, 1))
+                return false;
+            cur++;
+            parser->state = (parser->state == STATE_KEY_ESC) ? STATE_KEY : STATE_STRING;
+            break;
+
+            case STATE_KEY:
+            case STATE_STRING:
+            off = cur;
+            for (;;) {
+                cur = ejson_scan_quote(src, cur, len, parser->quote);
+                if (cur == len || src[cur] == parser->quote)
+                    break;
+                cur++; // Skip the backslash
+                if (cur == len) {
+                    parser->state = (parser->state == STATE_KEY) ? STATE_KEY_ESC : STATE_STRING_ESC;
+                    break;
+                }
+                cur++; // Skip the escaped byte
+            }
+            whole = (cur < len);
+            if (whole)
+                cur++; // The closing quote goes with the string
+            if (!tok_append(parser, src + off, cur - off))
+                return false;
+            if (whole && !finish_string(parser))
+                return false;
+            break;
+
+            case STATE_COLON:
+            cur = ejson_scan_spaces(src, cur, len);
+            if (cur == len)
+                break;
+            c = src[cur];
+            if (c != ':') {
+                if (is_printable(c))
+                    report(parser->error, "Missing ':' after key (character '%c' instead)", c);
+                else
+                    report(parser->error, "Invalid byte %x in object (after key)", c);
+                return false;
+            }
+            cur++;
+            parser->state = STATE_VALUE;
+            break;
+
+            case STATE_AFTER:
+            cur = ejson_scan_spaces(src, cur, len);
+            if (cur == len)
+                break;
+            c = src[cur];
+            if (frame->type == EJSON_OBJECT) {
+                if (c == '}') {
+                    cur++;
+                    if (!close_container(parser))
+                        return false;
+                    break;
+                }
+                if (c != ',') {
+                    if (is_printable(c))
+                        report(parser->error, "Missing ',' or '}' after value (character '%c' instead)", c);
+                    else
+                        report(parser->error, "Invalid byte %x in object (after value)", c);
+                    return false;
+                }
+                parser->state = STATE_OBJ_NEXT;
+            } else {
+                if (c == ']') {
+                    cur++;
+                    if (!close_container(parser))
+                        return false;
+                    break;
+                }
+                if (c != ',') {
+                    if (is_printable(c))
+                        report(parser->error, "Missing ',' or ']' after value (character '%c' instead)", c);
+                    else
+                        report(parser->error, "Invalid byte %x in array (after value)", c);
+                    return false;
+                }
+                parser->state = STATE_ARR_NEXT;
+            }
+            cur++; // Consume the ","
+            break;
+
+            case STATE_NUMBER:
+            // A number can only end before a byte other than a digit,
+            // or before a digit after a leading zero, so it's only
+            // read again when the chunk adds one of those. This keeps
+            // the bytes after it in the chunk where it ended.
+            off = cur;
+            leading = (parser->toklen <= 2); // May be "0" or "-0"
+            cur = scan_number(src, cur, len, &digits);
+            whole = (cur < len);
+            if (whole)
+                cur++; // The byte that stopped the number goes with it
+            if (!tok_append(parser, src + off, cur - off))
+                return false;
+            if (whole || !digits || leading) {
+                if (!finish_number(parser, whole, &back))
+                    return false;
+                assert(back <= cur - off);
+                cur -= back;
+            }
+            break;
+
+            case STATE_WORD:
+            off = cur;
+            cur = scan_alpha(src, cur, len);
+            if (!tok_append(parser, src + off, cur - off))
+                return false;
+            if (cur < len && !finish_word(parser))
+                return false;
+            break;
+        }
+    }
+
+    *pcur = cur;
+    return true;
+}
+
+// Handles the end of the source
+static bool finish(ejson_parser *parser)
+{
+    size_t back;
+    if (parser->state == STATE_NUMBER) {
+        if (!finish_number(parser, true, &back))
+            return false;
+    } else if (parser->state == STATE_WORD) {
+        if (!finish_word(parser))
+            return false;
+    }
+
+    ejson_parser_frame *frame = parser->frames;
+    switch (parser->state) {
+        case STATE_DONE: return true;
+        case STATE_VALUE:     report(parser->error, "Missing value"); break;
+        case STATE_ARR_FIRST: report(parser->error, "Source end in array"); break;
+        case STATE_ARR_NEXT:  report(parser->error, "Source end in array (after ',')"); break;
+        case STATE_OBJ_FIRST: report(parser->error, "Source end in object"); break;
+        case STATE_OBJ_NEXT:  report(parser->error, "Source end in object (after ',')"); break;
+        case STATE_COLON:     report(parser->error, "Source end in object (after key)"); break;
+        case STATE_KEY:
+        case STATE_KEY_ESC:
+        case STATE_STRING:
+        case STATE_STRING_ESC:
+        finish_string(parser);
+        break;
+        case STATE_AFTER:
+        if (frame->type == EJSON_OBJECT)
+            report(parser->error, "Source end in object (after value)");
+        else
+            report(parser->error, "Source end in array (after value)");
+        break;
+    }
+    return false;
+}
+
+void ejson_parser_init(ejson_parser *parser, ejson_error *error,
+                       ejson_arena *arena, ejson_config config)
+{
+    parser->root   = NULL;
+    parser->end    = 0;
+    parser->error  = error;
+    parser->arena  = arena;
+    parser->save   = ejson_arena_save(arena);
+    parser->config = config;
+    parser->state  = STATE_VALUE;
+    parser->frames = NULL;
+    parser->spare  = NULL;
+    tok_begin(parser);
+}
+
+ejson_feedresult ejson_feed(ejson_parser *parser, const char *chunk, size_t len)
+{
+    if (parser->state == STATE_ERROR)
+        return EJSON_FEED_ERROR;
+
+    if (parser->state == STATE_DONE) {
+        parser->end = 0;
+        return EJSON_FEED_DONE;
+    }
+
+    size_t cur = 0;
+    bool ok = (len == 0) ? finish(parser) : step(parser, chunk, len, &cur);
+    if (!ok) {
+        ejson_arena_restore(parser->arena, parser->save);
+        parser->root = NULL;
+        parser->state = STATE_ERROR;
+        return EJSON_FEED_ERROR;
+    }
+    parser->end = cur;
+
+    if (parser->state == STATE_DONE)
+        return EJSON_FEED_DONE;
+    return EJSON_FEED_MORE;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ejson.h"
+
+static void report(ejson_error *error, const char *fmt, ...)
+{
+    if (!error)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error->msg, sizeof(error->msg), fmt, args);
+    va_end(args);
+}
+
+ejson_value *ejson_parse_file(const char *path, ejson_file *file,
+                              ejson_error *error, ejson_arena *arena,
+                              ejson_config config)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        report(error, "Couldn't open '%s'", path);
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        report(error, "Couldn't read '%s'", path);
+        close(fd);
+        return NULL;
+    }
+    size_t len = info.st_size;
+
+    // Empty files can't be mapped, but they're
+    // still parsed to report the missing value.
+    const char *src = "";
+    if (len > 0) {
+        void *addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            report(error, "Couldn't map '%s'", path);
+            close(fd);
+            return NULL;
+        }
+        // The parser reads the source front to back, so the kernel
+        // can read ahead further than it would by default.
+        madvise(addr, len, MADV_SEQUENTIAL);
+        src = addr;
+    }
+    close(fd);
+
+    file->src = src;
+    file->len = len;
+
+    ejson_value *root = ejson_parse2(src, len, NULL, error, arena, config);
+    if (root == NULL)
+        ejson_file_close(file);
+    return root;
+}
+
+void ejson_file_close(ejson_file *file)
+{
+    if (file->len > 0)
+        munmap((void*) file->src, file->len);
+    file->src = NULL;
+    file->len = 0;
+}
@@ -0,0 +1,377 @@
+#include <math.h>
+#include <string.h>
+#include "number.h"
+
+// Doubles are formatted with Grisu2 by Florian Loitsch, as described
+// in "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers". It always produces digits that round trip and, for
+// nearly all doubles, the shortest ones.
+
+typedef struct {
+    uint64_t f;
+    int      e;
+} diyfp_t;
+
+typedef struct {
+    uint64_t f;
+    int      e;
+    int      k;
+} cached_power_t;
+
+// Normalized 64-bit approximations of 10^k, for k from -300 to 340
+// in steps of 8, with their binary exponent.
+#define CACHED_POWERS_MIN_K -300
+#define CACHED_POWERS_STEP    8
+static const cached_power_t cached_powers[] = {
+    {0xAB70FE17C79AC6CA, -1060, -300},
+    {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C,  -980, -276},
+    {0xD3515C2831559A83,  -954, -268},
+    {0x9D71AC8FADA6C9B5,  -927, -260},
+    {0xEA9C227723EE8BCB,  -901, -252},
+    {0xAECC49914078536D,  -874, -244},
+    {0x823C12795DB6CE57,  -847, -236},
+    {0xC21094364DFB5637,  -821, -228},
+    {0x9096EA6F3848984F,  -794, -220},
+    {0xD77485CB25823AC7,  -768, -212},
+    {0xA086CFCD97BF97F4,  -741, -204},
+    {0xEF340A98172AACE5,  -715, -196},
+    {0xB23867FB2A35B28E,  -688, -188},
+    {0x84C8D4DFD2C63F3B,  -661, -180},
+    {0xC5DD44271AD3CDBA,  -635, -172},
+    {0x936B9FCEBB25C996,  -608, -164},
+    {0xDBAC6C247D62A584,  -582, -156},
+    {0xA3AB66580D5FDAF6,  -555, -148},
+    {0xF3E2F893DEC3F126,  -529, -140},
+    {0xB5B5ADA8AAFF80B8,  -502, -132},
+    {0x87625F056C7C4A8B,  -475, -124},
+    {0xC9BCFF6034C13053,  -449, -116},
+    {0x964E858C91BA2655,  -422, -108},
+    {0xDFF9772470297EBD,  -396, -100},
+    {0xA6DFBD9FB8E5B88F,  -369,  -92},
+    {0xF8A95FCF88747D94,  -343,  -84},
+    {0xB94470938FA89BCF,  -316,  -76},
+    {0x8A08F0F8BF0F156B,  -289,  -68},
+    {0xCDB02555653131B6,  -263,  -60},
+    {0x993FE2C6D07B7FAC,  -236,  -52},
+    {0xE45C10C42A2B3B06,  -210,  -44},
+    {0xAA242499697392D3,  -183,  -36},
+    {0xFD87B5F28300CA0E,  -157,  -28},
+    {0xBCE5086492111AEB,  -130,  -20},
+    {0x8CBCCC096F5088CC,  -103,  -12},
+    {0xD1B71758E219652C,   -77,   -4},
+    {0x9C40000000000000,   -50,    4},
+    {0xE8D4A51000000000,   -24,   12},
+    {0xAD78EBC5AC620000,     3,   20},
+    {0x813F3978F8940984,    30,   28},
+    {0xC097CE7BC90715B3,    56,   36},
+    {0x8F7E32CE7BEA5C70,    83,   44},
+    {0xD5D238A4ABE98068,   109,   52},
+    {0x9F4F2726179A2245,   136,   60},
+    {0xED63A231D4C4FB27,   162,   68},
+    {0xB0DE65388CC8ADA8,   189,   76},
+    {0x83C7088E1AAB65DB,   216,   84},
+    {0xC45D1DF942711D9A,   242,   92},
+    {0x924D692CA61BE758,   269,  100},
+    {0xDA01EE641A708DEA,   295,  108},
+    {0xA26DA3999AEF774A,   322,  116},
+    {0xF209787BB47D6B85,   348,  124},
+    {0xB454E4A179DD1877,   375,  132},
+    {0x865B86925B9BC5C2,   402,  140},
+    {0xC83553C5C8965D3D,   428,  148},
+    {0x952AB45CFA97A0B3,   455,  156},
+    {0xDE469FBD99A05FE3,   481,  164},
+    {0xA59BC234DB398C25,   508,  172},
+    {0xF6C69A72A3989F5C,   534,  180},
+    {0xB7DCBF5354E9BECE,   561,  188},
+    {0x88FCF317F22241E2,   588,  196},
+    {0xCC20CE9BD35C78A5,   614,  204},
+    {0x98165AF37B2153DF,   641,  212},
+    {0xE2A0B5DC971F303A,   667,  220},
+    {0xA8D9D1535CE3B396,   694,  228},
+    {0xFB9B7CD9A4A7443C,   720,  236},
+    {0xBB764C4CA7A44410,   747,  244},
+    {0x8BAB8EEFB6409C1A,   774,  252},
+    {0xD01FEF10A657842C,   800,  260},
+    {0x9B10A4E5E9913129,   827,  268},
+    {0xE7109BFBA19C0C9D,   853,  276},
+    {0xAC2820D9623BF429,   880,  284},
+    {0x80444B5E7AA7CF85,   907,  292},
+    {0xBF21E44003ACDD2D,   933,  300},
+    {0x8E679C2F5E44FF8F,   960,  308},
+    {0xD433179D9C8CB841,   986,  316},
+    {0x9E19DB92B4E31BA9,  1013,  324},
+    {0xEB96BF6EBADF77D9,  1039,  332},
+    {0xAF87023B9BF0EE6B,  1066,  340},
+};
+
+// Range of binary exponents the scaled boundaries are brought into,
+// so that their integer part fits in 32 bits.
+#define ALPHA -60
+#define GAMMA -32
+
+static const char digit_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+size_t ejson_format_int(int64_t value, char *dst)
+{
+    // Digits are produced from the last one
+    char tmp[20];
+    char *end = tmp + sizeof(tmp);
+    char *cur = end;
+
+    uint64_t mag = value < 0 ? -(uint64_t) value : (uint64_t) value;
+    while (mag >= 100) {
+        cur -= 2;
+        memcpy(cur, &digit_pairs[2 * (mag % 100)], 2);
+        mag /= 100;
+    }
+    if (mag >= 10) {
+        cur -= 2;
+        memcpy(cur, &digit_pairs[2 * mag], 2);
+    } else
+        *--cur = '0' + mag;
+
+    size_t num = 0;
+    if (value < 0)
+        dst[num++] = '-';
+    memcpy(dst + num, cur, end - cur);
+    return num + (end - cur);
+}
+
+static diyfp_t diyfp_sub(diyfp_t x, diyfp_t y)
+{
+    return (diyfp_t) {.f=x.f - y.f, .e=x.e};
+}
+
+// Product rounded to the upper 64 bits
+static diyfp_t diyfp_mul(diyfp_t x, diyfp_t y)
+{
+    unsigned __int128 p = (unsigned __int128) x.f * y.f;
+    uint64_t high = (uint64_t) (p >> 64);
+    uint64_t low  = (uint64_t) p;
+    return (diyfp_t) {.f=high + (low >> 63), .e=x.e + y.e + 64};
+}
+
+static diyfp_t diyfp_normalize(diyfp_t x)
+{
+    int s = __builtin_clzll(x.f);
+    return (diyfp_t) {.f=x.f << s, .e=x.e - s};
+}
+
+static diyfp_t diyfp_normalize_to(diyfp_t x, int e)
+{
+    return (diyfp_t) {.f=x.f << (x.e - e), .e=e};
+}
+
+// Computes the value and the boundaries of the interval of reals
+// that round to it, all normalized and the boundaries with the
+// same exponent.
+static void compute_boundaries(double value, diyfp_t *w, diyfp_t *minus, diyfp_t *plus)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const uint64_t hidden = (uint64_t) 1 << 52;
+    uint64_t F = bits & (hidden - 1);
+    int      E = (int) (bits >> 52);
+
+    diyfp_t v;
+    if (E == 0)
+        v = (diyfp_t) {.f=F, .e=1 - 1075};
+    else
+        v = (diyfp_t) {.f=F + hidden, .e=E - 1075};
+
+    // The lower boundary is closer when the value is a
+    // power of two, as the exponent below is smaller.
+    bool lower_closer = (F == 0 && E > 1);
+
+    diyfp_t m_plus = {.f=2 * v.f + 1, .e=v.e - 1};
+    diyfp_t m_minus;
+    if (lower_closer)
+        m_minus = (diyfp_t) {.f=4 * v.f - 1, .e=v.e - 2};
+    else
+        m_minus = (diyfp_t) {.f=2 * v.f - 1, .e=v.e - 1};
+
+    *plus  = diyfp_normalize(m_plus);
+    *minus = diyfp_normalize_to(m_minus, plus->e);
+    *w     = diyfp_normalize(v);
+}
+
+// Picks the cached power c = 10^-k such that the exponent of
+// a number with binary exponent "e" times c is in [ALPHA, GAMMA].
+static cached_power_t cached_power_for(int e)
+{
+    int f = ALPHA - e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0); // ceil(f * log10(2))
+    int index = (-CACHED_POWERS_MIN_K + k + (CACHED_POWERS_STEP - 1)) / CACHED_POWERS_STEP;
+    return cached_powers[index];
+}
+
+// Number of digits of "n" and the power of 10 of the first one
+static int largest_pow10(uint32_t n, uint32_t *pow)
+{
+    static const uint32_t pows[] = {
+        1, 10, 100, 1000, 10000, 100000,
+        1000000, 10000000, 100000000, 1000000000,
+    };
+    int k = 10;
+    while (k > 1 && n < pows[k-1])
+        k--;
+    *pow = pows[k-1];
+    return k;
+}
+
+// Moves the last digit down while that brings the digits
+// closer to the value and keeps them in the interval.
+static void grisu2_round(char *buf, int len, uint64_t dist, uint64_t delta,
+                         uint64_t rest, uint64_t ten_k)
+{
+    while (rest < dist && delta - rest >= ten_k
+        && (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+        buf[len-1]--;
+        rest += ten_k;
+    }
+}
+
+// Generates the digits of a number in [minus, plus] close to "w",
+// stopping as soon as they identify one.
+static int grisu2_digit_gen(char *buf, int *exponent, diyfp_t minus, diyfp_t w, diyfp_t plus)
+{
+    uint64_t delta = diyfp_sub(plus, minus).f;
+    uint64_t dist  = diyfp_sub(plus, w).f;
+
+    // Split the upper boundary into integer and fractional part
+    diyfp_t one = {.f=(uint64_t) 1 << -plus.e, .e=plus.e};
+    uint32_t p1 = (uint32_t) (plus.f >> -one.e);
+    uint64_t p2 = plus.f & (one.f - 1);
+
+    int len = 0;
+
+    uint32_t pow10;
+    int n = largest_pow10(p1, &pow10);
+    while (n > 0) {
+        buf[len++] = '0' + p1 / pow10;
+        p1 %= pow10;
+        n--;
+
+        uint64_t rest = ((uint64_t) p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *exponent += n;
+            grisu2_round(buf, len, dist, delta, rest, (uint64_t) pow10 << -one.e);
+            return len;
+        }
+        pow10 /= 10;
+    }
+
+    // The integer part wasn't enough, so
+    // digits of the fraction are needed.
+    int m = 0;
+    for (;;) {
+        p2 *= 10;
+        buf[len++] = '0' + (p2 >> -one.e);
+        p2 &= one.f - 1;
+        m++;
+
+        delta *= 10;
+        dist  *= 10;
+        if (p2 <= delta)
+            break;
+    }
+    *exponent -= m;
+    grisu2_round(buf, len, dist, delta, p2, one.f);
+    return len;
+}
+
+// Digits of a positive finite double, such that
+// it equals digits * 10^exponent.
+static int grisu2(double value, char *buf, int *exponent)
+{
+    diyfp_t w, minus, plus;
+    compute_boundaries(value, &w, &minus, &plus);
+
+    cached_power_t cached = cached_power_for(plus.e);
+    diyfp_t c = {.f=cached.f, .e=cached.e};
+
+    diyfp_t w_scaled     = diyfp_mul(w, c);
+    diyfp_t minus_scaled = diyfp_mul(minus, c);
+    diyfp_t plus_scaled  = diyfp_mul(plus, c);
+
+    // The products may be off by one ulp, so the
+    // interval is shrunk to stay on the safe side.
+    minus_scaled.f++;
+    plus_scaled.f--;
+
+    *exponent = -cached.k;
+    return grisu2_digit_gen(buf, exponent, minus_scaled, w_scaled, plus_scaled);
+}
+
+// Places the decimal point in the digits the way JavaScript does,
+// switching to exponent notation past 21 integer digits or below
+// 1e-6.
+static size_t place_point(char *dst, const char *digits, int len, int exponent)
+{
+    int n = len + exponent;
+
+    if (len <= n && n <= 21) {
+        memcpy(dst, digits, len);
+        memset(dst + len, '0', n - len);
+        return n;
+    }
+
+    if (0 < n && n <= 21) {
+        memcpy(dst, digits, n);
+        dst[n] = '.';
+        memcpy(dst + n + 1, digits + n, len - n);
+        return len + 1;
+    }
+
+    if (-6 < n && n <= 0) {
+        dst[0] = '0';
+        dst[1] = '.';
+        memset(dst + 2, '0', -n);
+        memcpy(dst + 2 - n, digits, len);
+        return 2 - n + len;
+    }
+
+    size_t num = 0;
+    dst[num++] = digits[0];
+    if (len > 1) {
+        dst[num++] = '.';
+        memcpy(dst + num, digits + 1, len - 1);
+        num += len - 1;
+    }
+    dst[num++] = 'e';
+    if (n - 1 >= 0)
+        dst[num++] = '+';
+    num += ejson_format_int(n - 1, dst + num);
+    return num;
+}
+
+size_t ejson_format_double(double value, char *dst)
+{
+    if (isnan(value) || isinf(value)) {
+        memcpy(dst, "null", 4);
+        return 4;
+    }
+
+    size_t num = 0;
+    if (signbit(value)) {
+        dst[num++] = '-';
+        value = -value;
+    }
+    if (value == 0) {
+        dst[num++] = '0';
+        return num;
+    }
+
+    char digits[20];
+    int exponent;
+    int len = grisu2(value, digits, &exponent);
+    return num + place_point(dst + num, digits, len, exponent);
+}
@@ -0,0 +1,274 @@
+#include <string.h>
+#include <stdalign.h>
+#include "index.h"
+#include "arena.h"
+#include "escape.h"
+#include "keydict.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+static uint64_t hash_key(const char *key, size_t size)
+{
+    // FNV-1a
+    uint64_t h = FNV_OFFSET;
+    for (size_t i = 0; i < size; i++) {
+        h ^= (unsigned char) key[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+uint64_t ejson_keyindex_hash(ejson_string key, bool escaped)
+{
+    if (!escaped)
+        return hash_key(key.base, key.size);
+
+    uint64_t h = FNV_OFFSET;
+    size_t cur = 0;
+    while (cur < key.size) {
+        char buf[4];
+        size_t num = ejson_unescape_next(key.base, key.size, &cur, buf);
+        for (size_t i = 0; i < num; i++) {
+            h ^= (unsigned char) buf[i];
+            h *= FNV_PRIME;
+        }
+    }
+    return h;
+}
+
+static uint64_t hash_child_key(ejson_value *child)
+{
+    return ejson_keyindex_hash(child->key, child->flags & EJSON_FLAG_ESCAPED_KEY);
+}
+
+static bool same_key(ejson_value *child, const char *key, size_t size)
+{
+    if (child->flags & EJSON_FLAG_ESCAPED_KEY)
+        return ejson_key_equals(child, key, size);
+    return child->key.size == size && !memcmp(child->key.base, key, size);
+}
+
+static bool same_keys(ejson_value *child1, ejson_value *child2)
+{
+    if (ejson_keys_interned_together(child1, child2))
+        return child1->key.base == child2->key.base;
+    return ejson_strings_equal(child1->key, child1->flags & EJSON_FLAG_ESCAPED_KEY,
+                               child2->key, child2->flags & EJSON_FLAG_ESCAPED_KEY);
+}
+
+size_t ejson_keyindex_slots(size_t keys)
+{
+    // Keep the load factor at or below 1/2
+    size_t num = 1;
+    while (num < 2 * keys)
+        num <<= 1;
+    return num;
+}
+
+static bool build_slots(ejson_keyindex *index, ejson_value *value, ejson_arena *arena)
+{
+    size_t num = ejson_keyindex_slots(value->when_array.size);
+
+    ejson_value **slots = ejson_arena_alloc(arena, num * sizeof(ejson_value*), alignof(ejson_value*));
+    if (slots == NULL)
+        return false;
+    memset(slots, 0, num * sizeof(ejson_value*));
+
+    size_t mask = num-1;
+    bool dups = false;
+    for (ejson_value *child = value->when_array.head; child; child = child->next) {
+        size_t i = hash_child_key(child) & mask;
+        while (slots[i] && !same_keys(slots[i], child))
+            i = (i + 1) & mask;
+        // With duplicate keys the first one wins,
+        // like it does with a linear search.
+        if (slots[i] == NULL)
+            slots[i] = child;
+        else
+            dups = true;
+    }
+
+    index->slots = slots;
+    index->mask  = mask;
+    index->dups  = dups;
+    return true;
+}
+
+bool ejson_keyindex_defer(ejson_value *value, ejson_arena *arena, ejson_arena *home)
+{
+    ejson_keyindex *index = ejson_arena_alloc(arena, sizeof(ejson_keyindex), alignof(ejson_keyindex));
+    if (index == NULL)
+        return false;
+    index->arena = home;
+    index->slots = NULL;
+    index->mask  = 0;
+    index->dups  = false;
+    value->when_array.index = index;
+    return true;
+}
+
+bool ejson_buildindex(ejson_value *value, ejson_arena *arena)
+{
+    if (value->type != EJSON_OBJECT)
+        return false;
+
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    ejson_keyindex *index = ejson_arena_alloc(arena, sizeof(ejson_keyindex), alignof(ejson_keyindex));
+    if (index == NULL || !build_slots(index, value, arena)) {
+        ejson_arena_restore(arena, save);
+        return false;
+    }
+    index->arena = arena;
+    value->when_array.index = index;
+    return true;
+}
+
+bool ejson_keyindex_attach(ejson_value *value, ejson_arena *arena, ejson_arena *home,
+                           ejson_keyindex_mode mode, size_t min)
+{
+    if (value->when_array.size < min)
+        return true;
+
+    switch (mode) {
+        case EJSON_KEYINDEX_LAZY:  return ejson_keyindex_defer(value, arena, home);
+        case EJSON_KEYINDEX_EAGER: return ejson_buildindex(value, arena);
+        default: break;
+    }
+    return true;
+}
+
+bool ejson_keyindex_lookup(ejson_value *value, const char *key, size_t size,
+                           ejson_value **found)
+{
+    ejson_keyindex *index = value->when_array.index;
+    if (index == NULL)
+        return false;
+
+    if (index->slots == NULL) {
+        // If the arena is full the object is just
+        // searched linearly.
+        if (index->arena == NULL || !build_slots(index, value, index->arena)) {
+            index->arena = NULL;
+            return false;
+        }
+    }
+
+    size_t i = hash_key(key, size) & index->mask;
+    while (index->slots[i]) {
+        if (same_key(index->slots[i], key, size)) {
+            *found = index->slots[i];
+            return true;
+        }
+        i = (i + 1) & index->mask;
+    }
+    *found = NULL;
+    return true;
+}
+
+bool ejson_keyindex_build(ejson_keyindex *index, ejson_value *value, ejson_arena *arena)
+{
+    index->arena = NULL;
+    return build_slots(index, value, arena);
+}
+
+// Slot holding the key of "child", or the free slot where it would go
+static size_t find_slot(ejson_keyindex *index, ejson_value *child)
+{
+    size_t i = hash_child_key(child) & index->mask;
+    while (index->slots[i] && !same_keys(index->slots[i], child))
+        i = (i + 1) & index->mask;
+    return i;
+}
+
+ejson_value *ejson_keyindex_find(ejson_keyindex *index, ejson_value *child)
+{
+    return index->slots[find_slot(index, child)];
+}
+
+size_t ejson_keyindex_slot(ejson_value *value, ejson_value *child)
+{
+    ejson_keyindex *index = value->when_array.index;
+    size_t i = find_slot(index, child);
+    return index->slots[i] == child ? i : SIZE_MAX;
+}
+
+static void drop_slots(ejson_keyindex *index)
+{
+    index->slots = NULL;
+    index->mask  = 0;
+    index->dups  = false;
+}
+
+void ejson_keyindex_added(ejson_value *value, ejson_value *child)
+{
+    ejson_keyindex *index = value->when_array.index;
+    if (index == NULL || index->slots == NULL)
+        return;
+
+    // Past the load factor the index is rebuilt larger
+    if (2 * value->when_array.size > index->mask + 1) {
+        drop_slots(index);
+        return;
+    }
+
+    size_t i = hash_child_key(child) & index->mask;
+    while (index->slots[i]) {
+        if (same_keys(index->slots[i], child)) {
+            // The slot stays with the first child holding the
+            // key, which is only known when the new one is last.
+            index->dups = true;
+            if (child->next)
+                drop_slots(index);
+            return;
+        }
+        i = (i + 1) & index->mask;
+    }
+    index->slots[i] = child;
+}
+
+void ejson_keyindex_removed(ejson_value *value, ejson_value *child)
+{
+    ejson_keyindex *index = value->when_array.index;
+    if (index == NULL || index->slots == NULL)
+        return;
+
+    size_t i = ejson_keyindex_slot(value, child);
+    if (i == SIZE_MAX)
+        return;
+
+    // The slot would go to the next child with the same key
+    if (index->dups) {
+        drop_slots(index);
+        return;
+    }
+
+    // Fill the hole with the entries after it that can be moved
+    // back, so that no probe sequence is cut short.
+    size_t mask = index->mask;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        ejson_value *entry = index->slots[j];
+        if (entry == NULL)
+            break;
+        size_t home = hash_child_key(entry) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            index->slots[i] = entry;
+            i = j;
+        }
+    }
+    index->slots[i] = NULL;
+}
+
+void ejson_keyindex_replaced(ejson_value *value, ejson_value *child, ejson_value *with)
+{
+    ejson_keyindex *index = value->when_array.index;
+    if (index == NULL || index->slots == NULL)
+        return;
+
+    size_t i = ejson_keyindex_slot(value, child);
+    if (i != SIZE_MAX)
+        index->slots[i] = with;
+}
@@ -0,0 +1,60 @@
+#ifndef EJSON_INDEX_H
+#define EJSON_INDEX_H
+
+#include "ejson.h"
+
+// Open-addressing table over the children of an object. The slots
+// are left NULL by lazily indexed objects until the first lookup,
+// which builds them in "arena".
+struct ejson_keyindex {
+    ejson_arena  *arena;
+    ejson_value **slots;
+    size_t        mask;
+    bool          dups; // Some key is held by more than one child
+};
+
+// Hash of a key as the index sees it. Keys that are still escaped
+// are decoded on the fly, so they hash like their decoded form.
+uint64_t ejson_keyindex_hash(ejson_string key, bool escaped);
+
+// Number of slots of the index of an object with "keys" keys
+size_t ejson_keyindex_slots(size_t keys);
+
+// Attaches to the object the index required by the configuration,
+// if any, allocating it from "arena". Returns false when the arena
+// is full. Unbuilt indexes will be built in "home", which is where
+// the document ends up.
+bool ejson_keyindex_attach(ejson_value *value, ejson_arena *arena, ejson_arena *home,
+                           ejson_keyindex_mode mode, size_t min);
+
+// Attaches an unbuilt index to the object. Returns false
+// when the arena is full.
+bool ejson_keyindex_defer(ejson_value *value, ejson_arena *arena, ejson_arena *home);
+
+// Looks "key" up through the index of the object, building it if
+// necessary. Returns false when the object has no usable index,
+// in which case the caller needs to scan the children.
+bool ejson_keyindex_lookup(ejson_value *value, const char *key, size_t size,
+                           ejson_value **found);
+
+// Builds in "arena" an index of the object that isn't attached to
+// it, for a one-off use. Returns false when the arena is full.
+bool ejson_keyindex_build(ejson_keyindex *index, ejson_value *value, ejson_arena *arena);
+
+// Child of the indexed object holding the same key as "child",
+// which may belong to another object, or NULL if there's none
+ejson_value *ejson_keyindex_find(ejson_keyindex *index, ejson_value *child);
+
+// Slot of a built index holding the child of the object, or SIZE_MAX
+// when an earlier child with the same key holds it instead.
+size_t ejson_keyindex_slot(ejson_value *value, ejson_value *child);
+
+// Keep a built index in sync with the children of the object. The
+// child was just linked, is about to be unlinked, or is about to be
+// replaced by one with the same key. Edits that can't be applied in
+// place drop the slots, which the next lookup then rebuilds.
+void ejson_keyindex_added   (ejson_value *value, ejson_value *child);
+void ejson_keyindex_removed (ejson_value *value, ejson_value *child);
+void ejson_keyindex_replaced(ejson_value *value, ejson_value *child, ejson_value *with);
+
+#endif
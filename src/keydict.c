@@ -0,0 +1,157 @@
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include "arena.h"
+#include "keydict.h"
+
+// Open-addressing table of keys that only grows. Slots are set once
+// and never change, so lookups read them without locking, while
+// insertions are serialized by the mutex. The table has a fixed
+// size, and past "max" keys new ones aren't interned anymore.
+struct ejson_keydict {
+    const ejson_allocator *allocator;
+    pthread_mutex_t        mutex;
+    ejson_arena            arena; // Records and key bytes
+    size_t                 count;
+    size_t                 max;
+    size_t                 mask;
+    _Atomic(ejson_keyrecord*) first; // See ejson_keyrecord.next
+    _Atomic(ejson_keyrecord*) slots[];
+};
+
+// Keys are hashed 8 bytes at a time, since
+// every key parsed with the dictionary is.
+static uint64_t hash_key(const char *key, size_t size)
+{
+    uint64_t h = size * 0x9E3779B97F4A7C15ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, key + i, 8);
+        h = (h ^ word) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= h >> 29;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        for (size_t j = 0; i + j < size; j++)
+            word |= (uint64_t) (unsigned char) key[i+j] << (8 * j);
+        h = (h ^ word) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= h >> 29;
+    }
+    return h ^ (h >> 32);
+}
+
+ejson_keydict *ejson_keydict_create(size_t max_keys, const ejson_allocator *allocator)
+{
+    if (allocator == NULL)
+        allocator = &ejson_stdalloc;
+
+    size_t num = 16;
+    while (num < 2 * max_keys)
+        num <<= 1;
+
+    size_t size = sizeof(ejson_keydict) + num * sizeof(ejson_keyrecord*);
+    ejson_keydict *dict = allocator->alloc(allocator->userp, size);
+    if (dict == NULL)
+        return NULL;
+
+    if (pthread_mutex_init(&dict->mutex, NULL)) {
+        allocator->free(allocator->userp, dict, size);
+        return NULL;
+    }
+    dict->allocator = allocator;
+    dict->arena = (ejson_arena) {.allocator=allocator};
+    dict->count = 0;
+    dict->max   = max_keys;
+    dict->mask  = num - 1;
+    atomic_init(&dict->first, NULL);
+    for (size_t i = 0; i < num; i++)
+        atomic_init(&dict->slots[i], NULL);
+    return dict;
+}
+
+void ejson_keydict_free(ejson_keydict *dict)
+{
+    const ejson_allocator *allocator = dict->allocator;
+    pthread_mutex_destroy(&dict->mutex);
+    ejson_arena_free(&dict->arena);
+    allocator->free(allocator->userp, dict, sizeof(ejson_keydict) + (dict->mask + 1) * sizeof(ejson_keyrecord*));
+}
+
+// Slot of the key, or of the empty slot where it would go
+static size_t probe(ejson_keydict *dict, const char *key, size_t size,
+                    uint64_t hash, ejson_keyrecord **found)
+{
+    size_t i = hash & dict->mask;
+    for (;;) {
+        ejson_keyrecord *rec = atomic_load_explicit(&dict->slots[i], memory_order_acquire);
+        if (rec == NULL || (rec->hash == hash && rec->size == size && !memcmp(rec + 1, key, size))) {
+            *found = rec;
+            return i;
+        }
+        i = (i + 1) & dict->mask;
+    }
+}
+
+const char *ejson_keydict_find(ejson_keydict *dict, const char *key, size_t size)
+{
+    ejson_keyrecord *rec;
+    probe(dict, key, size, hash_key(key, size), &rec);
+    return rec ? (const char*) (rec + 1) : NULL;
+}
+
+const char *ejson_keydict_intern(ejson_keydict *dict, const char *key, size_t size)
+{
+    uint64_t hash = hash_key(key, size);
+
+    ejson_keyrecord *rec;
+    probe(dict, key, size, hash, &rec);
+    if (rec)
+        return (const char*) (rec + 1);
+
+    pthread_mutex_lock(&dict->mutex);
+
+    // Another thread may have added it in the meantime
+    size_t i = probe(dict, key, size, hash, &rec);
+    if (rec == NULL && dict->count < dict->max) {
+        rec = ejson_arena_alloc(&dict->arena, sizeof(ejson_keyrecord) + size, alignof(ejson_keyrecord));
+        if (rec) {
+            rec->dict = dict;
+            rec->hash = hash;
+            rec->size = size;
+            atomic_init(&rec->next, NULL);
+            memcpy(rec + 1, key, size);
+            atomic_store_explicit(&dict->slots[i], rec, memory_order_release);
+            dict->count++;
+        }
+    }
+
+    pthread_mutex_unlock(&dict->mutex);
+    return rec ? (const char*) (rec + 1) : NULL;
+}
+
+const char *ejson_keydict_intern_after(ejson_keydict *dict, const char *prev,
+                                       const char *key, size_t size)
+{
+    _Atomic(ejson_keyrecord*) *hint = prev
+        ? &((ejson_keyrecord*) ejson_keyrecord_of(prev))->next
+        : &dict->first;
+
+    ejson_keyrecord *rec = atomic_load_explicit(hint, memory_order_acquire);
+    if (rec && rec->size == size && !memcmp(rec + 1, key, size))
+        return (const char*) (rec + 1);
+
+    // The hint is only set once, so that threads parsing documents
+    // with keys in different orders don't keep writing to the shared
+    // records, which lookups then read without contention.
+    const char *interned = ejson_keydict_intern(dict, key, size);
+    if (interned && rec == NULL) {
+        ejson_keyrecord *expected = NULL;
+        atomic_compare_exchange_strong_explicit(hint, &expected,
+            (ejson_keyrecord*) ejson_keyrecord_of(interned),
+            memory_order_release, memory_order_relaxed);
+    }
+    return interned;
+}
@@ -0,0 +1,40 @@
+#ifndef EJSON_KEYDICT_H
+#define EJSON_KEYDICT_H
+
+#include <stdatomic.h>
+#include "ejson.h"
+
+// Interned keys are stored after a record, so the dictionary
+// and the hash of a key can be found from the key itself.
+typedef struct ejson_keyrecord ejson_keyrecord;
+struct ejson_keyrecord {
+    ejson_keydict *dict;
+    uint64_t       hash;
+    size_t         size;
+
+    // Key that came after this one the first time,
+    // which is usually the next one again
+    _Atomic(ejson_keyrecord*) next;
+};
+
+static inline const ejson_keyrecord *ejson_keyrecord_of(const char *key)
+{
+    return (const ejson_keyrecord*) key - 1;
+}
+
+// Whether the keys of two values, both interned in the same
+// dictionary, can be compared by pointer
+static inline bool ejson_keys_interned_together(const ejson_value *v1, const ejson_value *v2)
+{
+    return (v1->flags & v2->flags & EJSON_FLAG_INTERNED_KEY)
+        && ejson_keyrecord_of(v1->key.base)->dict == ejson_keyrecord_of(v2->key.base)->dict;
+}
+
+// Same as ejson_keydict_intern for the key that follows "prev" in an
+// object, or the first one when "prev" is NULL. Objects of the same
+// schema have the same keys in the same order, so the key is first
+// compared with the one that first followed "prev".
+const char *ejson_keydict_intern_after(ejson_keydict *dict, const char *prev,
+                                       const char *key, size_t size);
+
+#endif
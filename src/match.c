@@ -82,6 +82,8 @@ static ejson_value *parse_next_value_in_fmt(context_t *ctx, char *mem, size_t ma
     
     size_t num;    
     ejson_value *key = ejson_parse2(substr, sublen, &num, NULL, &arena, config);
+    if (key && !ejson_unescape(key, &arena))
+        key = NULL;
     if (key) ctx->cur += num;
     
     return key;
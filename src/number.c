@@ -0,0 +1,288 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "number.h"
+#include "pow5.h"
+
+// Significant digits that always fit in 64 bits
+#define MAX_DIGITS 19
+
+// Significant digits passed to strtod by the fallback. No more than
+// 768 are ever needed to tell which double is nearest, so the others
+// only matter for being zeros or not.
+#define MAX_FALLBACK_DIGITS 800
+
+// Exponents far past the range of doubles are all the same
+#define MAX_EXPONENT 100000
+
+// Powers of 10 that are exact doubles
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static double from_bits(uint64_t bits)
+{
+    union { uint64_t bits; double value; } u = {.bits=bits};
+    return u.value;
+}
+
+// Rounds w * 10^q to the nearest double with the algorithm by Eisel
+// and Lemire. The 128-bit truncated power of 5 is always precise
+// enough when w holds every digit of the number.
+static double eisel_lemire(uint64_t w, int64_t q)
+{
+    if (w == 0 || q < POW5_MIN)
+        return 0;
+    if (q > POW5_MAX)
+        return INFINITY;
+
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+
+    const uint64_t *pow5 = pow5_table[q - POW5_MIN];
+    unsigned __int128 first = (unsigned __int128) w * pow5[0];
+    uint64_t high = (uint64_t) (first >> 64);
+    uint64_t low  = (uint64_t) first;
+
+    // Only the top 55 bits of the product are kept. If the ones
+    // below them are all set, the low word of the power could
+    // carry into them.
+    if ((high & 0x1FF) == 0x1FF) {
+        unsigned __int128 second = (unsigned __int128) w * pow5[1];
+        uint64_t carry = (uint64_t) (second >> 64);
+        low += carry;
+        if (low < carry)
+            high++;
+    }
+
+    int upper = (int) (high >> 63);
+    uint64_t mantissa = high >> (upper + 9);
+
+    // Binary exponent of 10^q is about q * log2(10)
+    int64_t power2 = (((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;
+
+    if (power2 <= 0) {
+        // Subnormal
+        if (-power2 + 1 >= 64)
+            return 0;
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = (mantissa < ((uint64_t) 1 << 52)) ? 0 : 1;
+        return from_bits(mantissa | (uint64_t) power2 << 52);
+    }
+
+    // Exactly halfway between two doubles, which can only
+    // happen for small powers. Ties go to the even one.
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1)
+        if ((mantissa << (upper + 9)) == high)
+            mantissa &= ~(uint64_t) 1;
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= ((uint64_t) 2 << 52)) {
+        mantissa = (uint64_t) 1 << 52;
+        power2++;
+    }
+    mantissa &= ~((uint64_t) 1 << 52);
+
+    if (power2 >= 0x7FF)
+        return INFINITY;
+    return from_bits(mantissa | (uint64_t) power2 << 52);
+}
+
+// Rewrites the magnitude of the number as "<digits>e<exponent>",
+// with the excess digits folded into one, and converts it with
+// strtod. Having no decimal point, it doesn't depend on the locale.
+static double fallback(const char *src, size_t len)
+{
+    char buf[MAX_FALLBACK_DIGITS + 32];
+    size_t num = 0;
+
+    size_t cur = 0;
+    if (src[cur] == '-')
+        cur++;
+
+    int64_t exponent = 0;
+    size_t digits = 0;
+    bool point = false;
+    bool sticky = false;
+    for (; cur < len && src[cur] != 'e' && src[cur] != 'E'; cur++) {
+        char c = src[cur];
+        if (c == '.')
+            point = true;
+        else if (digits == 0 && c == '0') {
+            if (point) exponent--;
+        } else if (digits < MAX_FALLBACK_DIGITS) {
+            buf[num++] = c;
+            digits++;
+            if (point) exponent--;
+        } else {
+            if (!point) exponent++;
+            if (c != '0') sticky = true;
+        }
+    }
+    if (sticky) {
+        buf[num++] = '1';
+        exponent--;
+    }
+    if (num == 0)
+        buf[num++] = '0';
+
+    if (cur < len) {
+        cur++; // Consume the "e"
+        bool negative = false;
+        if (src[cur] == '+' || src[cur] == '-')
+            negative = (src[cur++] == '-');
+        int64_t value = 0;
+        for (; cur < len; cur++)
+            if (value < MAX_EXPONENT)
+                value = 10 * value + (src[cur] - '0');
+        exponent += negative ? -value : value;
+    }
+
+    snprintf(buf + num, sizeof(buf) - num, "e%lld", (long long) exponent);
+    return strtod(buf, NULL);
+}
+
+int64_t ejson_saturate(double value)
+{
+    if (value >= 9223372036854775808.0)
+        return INT64_MAX;
+    if (value < -9223372036854775808.0)
+        return INT64_MIN;
+    return (int64_t) value;
+}
+
+ejson_numberresult ejson_parse_number(const char *src, size_t len, size_t *end, ejson_number *num)
+{
+    size_t cur = 0;
+
+    bool negative = false;
+    if (src[cur] == '-') {
+        negative = true;
+        cur++;
+    }
+
+    // The first MAX_DIGITS significant digits go in the mantissa and
+    // the exponent scales it to the value of the number. Non-zero
+    // digits that don't fit make the mantissa truncated.
+    uint64_t mantissa = 0;
+    int64_t  exponent = 0;
+    size_t   digits = 0;
+    bool     truncated = false;
+    bool     integer = true;
+
+    if (cur == len || !is_digit(src[cur])) {
+        *end = cur;
+        return EJSON_NUMBER_INVALID;
+    }
+    if (src[cur] == '0')
+        cur++; // No leading zeros
+    else {
+        do {
+            int d = src[cur] - '0';
+            if (digits < MAX_DIGITS) {
+                mantissa = 10 * mantissa + d;
+                digits++;
+            } else {
+                exponent++;
+                truncated |= (d != 0);
+            }
+            cur++;
+        } while (cur < len && is_digit(src[cur]));
+    }
+
+    if (cur < len && src[cur] == '.') {
+        integer = false;
+        cur++;
+        if (cur == len || !is_digit(src[cur])) {
+            *end = cur;
+            return EJSON_NUMBER_INVALID;
+        }
+        do {
+            int d = src[cur] - '0';
+            if (digits == 0 && d == 0)
+                exponent--;
+            else if (digits < MAX_DIGITS) {
+                mantissa = 10 * mantissa + d;
+                digits++;
+                exponent--;
+            } else
+                truncated |= (d != 0);
+            cur++;
+        } while (cur < len && is_digit(src[cur]));
+    }
+
+    if (cur < len && (src[cur] == 'e' || src[cur] == 'E')) {
+        integer = false;
+        cur++;
+        bool exp_negative = false;
+        if (cur < len && (src[cur] == '+' || src[cur] == '-'))
+            exp_negative = (src[cur++] == '-');
+        if (cur == len || !is_digit(src[cur])) {
+            *end = cur;
+            return EJSON_NUMBER_INVALID;
+        }
+        int64_t value = 0;
+        do {
+            if (value < MAX_EXPONENT)
+                value = 10 * value + (src[cur] - '0');
+            cur++;
+        } while (cur < len && is_digit(src[cur]));
+        exponent += exp_negative ? -value : value;
+    }
+    *end = cur;
+
+    if (integer && !truncated) {
+        if (!negative && mantissa <= INT64_MAX) {
+            num->as_int = (int64_t) mantissa;
+            num->as_flt = (double) num->as_int;
+            num->is_int = true;
+            return EJSON_NUMBER_OK;
+        }
+        if (negative && mantissa <= (uint64_t) INT64_MAX + 1) {
+            num->as_int = (mantissa > INT64_MAX) ? INT64_MIN : -(int64_t) mantissa;
+            num->as_flt = (mantissa == 0) ? -0.0 : (double) num->as_int;
+            num->is_int = (mantissa != 0); // -0 only exists as a double
+            return EJSON_NUMBER_OK;
+        }
+        // Integers past 64 bits are only kept as doubles
+    }
+
+    double value;
+    if (!truncated && mantissa <= ((uint64_t) 1 << 53) && exponent >= -22 && exponent <= 22) {
+        // Both operands are exact, so the result
+        // is rounded once (Clinger's fast path).
+        value = (double) mantissa;
+        if (exponent < 0)
+            value /= exact_pow10[-exponent];
+        else
+            value *= exact_pow10[exponent];
+    } else {
+        value = eisel_lemire(mantissa, exponent);
+
+        // The digits that were dropped put the number between
+        // the mantissa and the next one. If both round the same
+        // way, so does the number.
+        if (truncated && eisel_lemire(mantissa + 1, exponent) != value)
+            value = fallback(src, cur);
+    }
+
+    if (isinf(value))
+        return EJSON_NUMBER_OVERFLOW;
+
+    if (negative)
+        value = -value;
+    num->as_flt = value;
+    num->as_int = ejson_saturate(value);
+    num->is_int = false;
+    return EJSON_NUMBER_OK;
+}
@@ -0,0 +1,36 @@
+#ifndef EJSON_NUMBER_H
+#define EJSON_NUMBER_H
+
+#include "ejson.h"
+
+typedef enum {
+    EJSON_NUMBER_OK,
+    EJSON_NUMBER_INVALID,  // Not a number by the JSON grammar
+    EJSON_NUMBER_OVERFLOW, // Too large for a double
+} ejson_numberresult;
+
+// Parses the number at the start of "src", which must begin with
+// a digit or "-", and stores in "end" how many bytes it spans, or
+// where it stopped being valid. Integers that fit in 64 bits are
+// exact in "as_int" and flagged with "is_int", while anything else
+// is rounded to the nearest double and "as_int" is its integer part,
+// saturated.
+ejson_numberresult ejson_parse_number(const char *src, size_t len, size_t *end, ejson_number *num);
+
+// Integer part of "value", saturated to the range of int64_t
+int64_t ejson_saturate(double value);
+
+// Room needed by the formatters, terminator excluded
+#define EJSON_NUMBER_MAX 32
+
+// Writes the decimal digits of "value" to "dst" and
+// returns how many bytes were written. No terminator.
+size_t ejson_format_int(int64_t value, char *dst);
+
+// Writes the shortest decimal that parses back to exactly "value",
+// in exponent notation when it's very large or small, and returns
+// how many bytes were written. No terminator. Infinities and NaN
+// have no JSON form and are written as null.
+size_t ejson_format_double(double value, char *dst);
+
+#endif
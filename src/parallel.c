@@ -0,0 +1,311 @@
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include "ejson.h"
+#include "scan.h"
+#include "arena.h"
+#include "parse.h"
+#include "value.h"
+
+// The source is parsed in two stages. The first one marks the
+// structural characters in a bitmap, 64 bytes at a time, and the
+// second walks it to find the elements of the root array. The
+// elements are then split into groups of similar size in bytes and
+// each group is built by its own thread. Anything the stages can't
+// handle goes to ejson_parse2, which also produces the errors.
+
+// Sources shorter than this per thread aren't worth splitting
+#define MIN_BYTES_PER_THREAD (64 << 10)
+
+typedef struct {
+    ejson_elements elems;
+    ejson_arena    arena;
+    bool           measure;
+    bool           ok;
+    bool           started; // On its own thread
+    pthread_t      handle;
+} group_t;
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t'
+        || c == '\r' || c == '\n';
+}
+
+static size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static size_t count_processors(void)
+{
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return num > 0 ? (size_t) num : 1;
+}
+
+// Fills "bounds" with the offsets of the "[" of the root array, of
+// the commas between its elements and of its "]", and returns the
+// number of elements. Returns 0 if the array is empty or doesn't
+// close with a matching "]".
+static size_t find_elements(const char *src, size_t len, size_t root,
+                            const uint64_t *bits, uint32_t *bounds)
+{
+    size_t num = 0;
+    size_t depth = 0;
+    bounds[0] = root;
+
+    for (size_t w = root / 64; w < (len + 63) / 64; w++) {
+        uint64_t word = bits[w];
+        if (w == root / 64)
+            word &= ~(uint64_t) 0 << (root % 64);
+
+        while (word) {
+            size_t i = 64 * w + __builtin_ctzll(word);
+            word &= word - 1;
+
+            char c = src[i];
+            if (c == '[' || c == '{')
+                depth++;
+            else if (c == ']' || c == '}') {
+                if (--depth == 0) {
+                    if (c != ']' || ejson_scan_spaces(src, root+1, i) == i)
+                        return 0;
+                    bounds[++num] = i;
+                    return num;
+                }
+            } else if (c == ',' && depth == 1)
+                bounds[++num] = i;
+        }
+    }
+    return 0;
+}
+
+static void *work(void *arg)
+{
+    group_t *group = arg;
+    group->ok = ejson_parse_elements(&group->elems, group->measure);
+    return NULL;
+}
+
+// Runs every group, the first one on the calling thread. Groups
+// whose thread can't be started are run on the calling thread
+// after it.
+static bool run_groups(group_t *groups, size_t num)
+{
+    for (size_t i = 1; i < num; i++)
+        groups[i].started = pthread_create(&groups[i].handle, NULL, work, &groups[i]) == 0;
+    work(&groups[0]);
+
+    bool ok = groups[0].ok;
+    for (size_t i = 1; i < num; i++) {
+        if (groups[i].started)
+            pthread_join(groups[i].handle, NULL);
+        else
+            work(&groups[i]);
+        ok = ok && groups[i].ok;
+    }
+    return ok;
+}
+
+// Gives each group a sub-arena carved from the fixed arena, as large
+// as the group measured it needs. Returns false if they don't fit.
+static bool carve_arenas(ejson_arena *arena, group_t *groups, size_t num)
+{
+    for (size_t i = 0; i < num; i++) {
+        group_t *group = &groups[i];
+        group->measure = true;
+        group->elems.arena = NULL;
+    }
+    if (!run_groups(groups, num))
+        return false;
+
+    size_t used = arena->used;
+    for (size_t i = 0; i < num; i++) {
+        group_t *group = &groups[i];
+        size_t size = align_up(group->elems.bytes, alignof(max_align_t));
+        used += -((uintptr_t) arena->base + used) & (alignof(max_align_t)-1);
+        if (size > arena->size || used > arena->size - size)
+            return false;
+        group->arena = (ejson_arena) {.base=(char*) arena->base + used, .size=size};
+        group->elems.arena = &group->arena;
+        group->measure = false;
+        used += size;
+    }
+    return true;
+}
+
+static bool build_groups(ejson_arena *arena, group_t *groups, size_t num)
+{
+    if (arena->allocator == NULL) {
+        if (!carve_arenas(arena, groups, num) || !run_groups(groups, num))
+            return false;
+
+        // The tree continues after the last group
+        ejson_arena *last = &groups[num-1].arena;
+        arena->used = (size_t) ((char*) last->base - (char*) arena->base) + last->used;
+        return true;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        group_t *group = &groups[i];
+        group->arena = (ejson_arena) {.allocator=arena->allocator};
+        group->elems.arena = &group->arena;
+        group->measure = false;
+    }
+    bool ok = run_groups(groups, num);
+    for (size_t i = 0; i < num; i++) {
+        if (ok)
+            ejson_arena_adopt(arena, &groups[i].arena);
+        else
+            ejson_arena_free(&groups[i].arena);
+    }
+    return ok;
+}
+
+static ejson_value *link_groups(group_t *groups, size_t num)
+{
+    ejson_value *head = NULL;
+    ejson_value *tail = NULL;
+    for (size_t i = 0; i < num; i++) {
+        ejson_elements *elems = &groups[i].elems;
+        if (elems->head == NULL)
+            continue;
+        if (tail) {
+            tail->next = elems->head;
+            elems->head->prev = &tail->next;
+        } else
+            head = elems->head;
+        tail = elems->tail;
+    }
+    tail->next = NULL;
+    return head;
+}
+
+static void link_slots(ejson_value *slots, size_t num)
+{
+    for (size_t i = 0; i < num; i++) {
+        slots[i].prev = (i == 0) ? NULL : &slots[i-1].next;
+        slots[i].next = (i+1 == num) ? NULL : &slots[i+1];
+    }
+}
+
+// The groups have room for "threads" of them
+static ejson_value *parse_root(const char *src, size_t len, size_t root,
+                               const uint64_t *bits, uint32_t *bounds,
+                               ejson_arena *arena, ejson_config config,
+                               group_t *groups, size_t threads)
+{
+    size_t num = find_elements(src, len, root, bits, bounds);
+    if (num == 0)
+        return NULL;
+
+    if (threads > num)
+        threads = num;
+
+    ejson_value *slots = NULL;
+    if (config.contiguous_children) {
+        slots = ejson_arena_alloc(arena, num * sizeof(ejson_value), alignof(ejson_value));
+        if (slots == NULL)
+            return NULL;
+    }
+
+    // Elements are assigned to a group until it
+    // reaches its share of the bytes.
+    size_t total = bounds[num] - bounds[0];
+    size_t first = 0;
+    size_t count = 0;
+    while (first < num) {
+        size_t limit = bounds[0] + total * (count + 1) / threads;
+        size_t last = first + 1;
+        while (last < num && bounds[last] < limit)
+            last++;
+
+        groups[count++].elems = (ejson_elements) {
+            .src=src,
+            .len=len,
+            .bounds=bounds + first,
+            .num=last - first,
+            .config=config,
+            .home=arena,
+            .slots=slots ? slots + first : NULL,
+        };
+        first = last;
+    }
+
+    if (!build_groups(arena, groups, count))
+        return NULL;
+
+    ejson_value *head;
+    if (config.contiguous_children) {
+        link_slots(slots, num);
+        head = slots;
+    } else
+        head = link_groups(groups, count);
+
+    ejson_value *val = ejson_arena_alloc(arena, sizeof(ejson_value), alignof(ejson_value));
+    if (val == NULL)
+        return NULL;
+    init_val_for_arr(val, head, num);
+    adopt_children(val);
+    if (config.contiguous_children)
+        val->flags |= EJSON_FLAG_CONTIGUOUS;
+
+    // The closing bracket follows the last bound
+    val->src = (ejson_string) {.base=src + root, .size=bounds[num] + 1 - root};
+    return val;
+}
+
+ejson_value *ejson_parse_parallel(const char *src, size_t len, size_t *end,
+                                  ejson_error *error, ejson_arena *arena,
+                                  ejson_config config, size_t threads,
+                                  const ejson_allocator *allocator)
+{
+    if (allocator == NULL)
+        allocator = &ejson_stdalloc;
+    if (threads == 0)
+        threads = count_processors();
+    if (threads > len / MIN_BYTES_PER_THREAD)
+        threads = len / MIN_BYTES_PER_THREAD;
+
+    size_t root = 0;
+    while (root < len && is_space(src[root]))
+        root++;
+
+    // Single quoted strings would need a second quote mask
+    if (threads < 2 || len > UINT32_MAX || root == len || src[root] != '['
+        || config.allow_single_quoted_strings)
+        return ejson_parse2(src, len, end, error, arena, config);
+
+    size_t words = (len + 63) / 64;
+    uint64_t *bits = allocator->alloc(allocator->userp, words * sizeof(uint64_t));
+    if (bits == NULL)
+        return ejson_parse2(src, len, end, error, arena, config);
+    ejson_scan_structurals(src, len, bits);
+
+    // There can't be more elements than structural characters
+    size_t marks = 0;
+    for (size_t i = 0; i < words; i++)
+        marks += __builtin_popcountll(bits[i]);
+
+    ejson_value *val = NULL;
+    uint32_t *bounds = allocator->alloc(allocator->userp, (marks + 1) * sizeof(uint32_t));
+    group_t  *groups = allocator->alloc(allocator->userp, threads * sizeof(group_t));
+    if (bounds && groups) {
+        ejson_arena_mark save = ejson_arena_save(arena);
+        val = parse_root(src, len, root, bits, bounds, arena, config, groups, threads);
+        if (val == NULL)
+            ejson_arena_restore(arena, save);
+        else if (end)
+            *end = bounds[val->when_array.size] + 1;
+    }
+    if (groups)
+        allocator->free(allocator->userp, groups, threads * sizeof(group_t));
+    if (bounds)
+        allocator->free(allocator->userp, bounds, (marks + 1) * sizeof(uint32_t));
+    allocator->free(allocator->userp, bits, words * sizeof(uint64_t));
+
+    if (val == NULL)
+        return ejson_parse2(src, len, end, error, arena, config);
+    return val;
+}
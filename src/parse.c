@@ -4,6 +4,14 @@
 #include <string.h>
 #include <stdalign.h>
 #include "ejson.h"
+#include "scan.h"
+#include "arena.h"
+#include "index.h"
+#include "value.h"
+#include "number.h"
+#include "escape.h"
+#include "keydict.h"
+#include "parse.h"
 
 static bool is_space(char c)
 {
@@ -43,7 +51,16 @@ ejson_value *ejson_seekbykey2(ejson_value *value, const char *key, size_t size)
     if (value->type != EJSON_OBJECT)
         return NULL;
 
+    ejson_value *found;
+    if (ejson_keyindex_lookup(value, key, size, &found))
+        return found;
+
     for (ejson_iter iter = ejson_iterover(value); ejson_next(&iter); ) {
+        if (iter.val->flags & EJSON_FLAG_ESCAPED_KEY) {
+            if (ejson_key_equals(iter.val, key, size))
+                return iter.val;
+            continue;
+        }
         ejson_string iterkey = iter.val->key;
         if (iterkey.size == size && !strncmp(iterkey.base, key, size))
             return iter.val;
@@ -52,6 +69,36 @@ ejson_value *ejson_seekbykey2(ejson_value *value, const char *key, size_t size)
     return NULL;
 }
 
+ejson_value *ejson_seekbyinterned(ejson_value *value, const char *key)
+{
+    const ejson_keyrecord *record = ejson_keyrecord_of(key);
+    if (value->type != EJSON_OBJECT)
+        return NULL;
+
+    ejson_value *found;
+    if (ejson_keyindex_lookup(value, key, record->size, &found))
+        return found;
+
+    // Keys from the dictionary are different
+    // unless they're the same pointer.
+    for (ejson_iter iter = ejson_iterover(value); ejson_next(&iter); ) {
+        ejson_value *child = iter.val;
+        if (child->key.base == key)
+            return child;
+        if (child->flags & EJSON_FLAG_ESCAPED_KEY) {
+            if (ejson_key_equals(child, key, record->size))
+                return child;
+            continue;
+        }
+        if (child->flags & EJSON_FLAG_INTERNED_KEY)
+            continue;
+        if (child->key.size == record->size && !memcmp(child->key.base, key, record->size))
+            return child;
+    }
+
+    return NULL;
+}
+
 ejson_value *ejson_seekbykey(ejson_value *value, const char *key)
 {
     return ejson_seekbykey2(value, key, strlen(key));
@@ -59,18 +106,45 @@ ejson_value *ejson_seekbykey(ejson_value *value, const char *key)
 
 ejson_value *ejson_seekbyindex(ejson_value *value, size_t index)
 {
+    if (value->flags & EJSON_FLAG_CONTIGUOUS) {
+        if (index >= value->when_array.size)
+            return NULL;
+        return value->when_array.head + index;
+    }
+
     for (ejson_iter iter = ejson_iterover(value); ejson_next(&iter); )
         if (index == iter.idx)
             return iter.val;
     return NULL;
 }
 
+// Arena usage simulated by ejson_measure. Values are all
+// parsed into the same scratch node instead of the arena.
+typedef struct {
+    size_t nodes;
+    size_t used;
+    size_t stack;
+    size_t peak;
+    ejson_value scratch;
+} measure_t;
+
 typedef struct {
     ejson_error *error;
     ejson_arena *arena;
+    ejson_arena *home; // Arena the document ends up in
+    measure_t   *measure;
     const char *src;
     size_t cur, len;
     ejson_config config;
+
+    // When storing children contiguously, values are pushed on a
+    // stack until their parent is complete. Slot N of the stack is
+    // at "stack - N - 1". Fixed arenas have the stack carved out of
+    // their top, while growable ones get it from their allocator
+    // with room for "capacity" slots.
+    ejson_value *stack;
+    size_t       depth;
+    size_t       capacity;
 } context_t;
 
 static bool follows_space(context_t *ctx)
@@ -80,53 +154,70 @@ static bool follows_space(context_t *ctx)
 
 static void consume_spaces(context_t *ctx)
 {
-    while (follows_space(ctx))
+    // Most runs of whitespace are a single byte between two
+    // tokens, so only the longer ones go through the kernels.
+    if (follows_space(ctx)) {
         ctx->cur++;
+        if (follows_space(ctx))
+            ctx->cur = ejson_scan_spaces(ctx->src, ctx->cur, ctx->len);
+    }
 }
 
-static bool parse_str(context_t *ctx, ejson_string *str)
+static void report_bad_escape(ejson_error *error, const char *src, size_t len, size_t cur, char quote)
+{
+    if (cur == len)
+        report(error, "No closing %s after string", quote == '"' ? "'\"'" : "'\\''");
+    else if (is_printable(src[cur]))
+        report(error, "Invalid character '%c' in escape sequence", src[cur]);
+    else
+        report(error, "Invalid byte %x in escape sequence", src[cur]);
+}
+
+bool ejson_lex_string(const char *src, size_t len, size_t *pcur,
+                      ejson_error *error, ejson_string *str, bool *escaped)
 {
     assert(str);
-    assert(ctx->cur < ctx->len);
-    
-    char first = ctx->src[ctx->cur];
-    assert(first == '\'' || first == '"');
 
-    ctx->cur++; // Consume the double quotes
+    size_t cur = *pcur;
+    assert(cur < len);
 
-    size_t off = ctx->cur;
-    while (ctx->cur < ctx->len && ctx->src[ctx->cur] != first)
-        ctx->cur++;
-    size_t len = ctx->cur - off;
+    char first = src[cur];
+    assert(first == '\'' || first == '"');
 
-    if (ctx->cur == ctx->len) {
-        report(ctx->error, "No closing %s after string", first == '"' ? "'\"'" : "'\\''");
-        return false;
-    }
-    ctx->cur++; // Consume the "\"" or "'"
+    cur++; // Consume the double quotes
 
-    str->base = ctx->src + off;
-    str->size = len;
+    size_t off = cur;
+    *escaped = false;
+    for (;;) {
+        cur = ejson_scan_quote(src, cur, len, first);
+        if (cur == len) {
+            report(error, "No closing %s after string", first == '"' ? "'\"'" : "'\\''");
+            *pcur = cur;
+            return false;
+        }
+        if (src[cur] == first)
+            break;
+        *escaped = true;
+        if (!ejson_check_escape(src, len, &cur)) {
+            report_bad_escape(error, src, len, cur, first);
+            *pcur = cur;
+            return false;
+        }
+    }
+    str->base = src + off;
+    str->size = cur - off;
+    *pcur = cur + 1; // Consume the "\"" or "'"
     return true;
 }
 
-static void *alloc(ejson_arena *arena, size_t size, size_t align)
+static bool parse_str(context_t *ctx, ejson_string *str, bool *escaped)
 {
-    size_t pad = -arena->used & (align-1);
-    arena->used += pad;
-    
-    if (arena->used + size > arena->size)
-        return NULL;
-
-    void *p = arena->base + arena->used;
-    arena->used += size;
-
-    return p;
+    return ejson_lex_string(ctx->src, ctx->len, &ctx->cur, ctx->error, str, escaped);
 }
 
 static void *alloc_or_report(context_t *ctx, size_t size, size_t align)
 {
-    void *mem = alloc(ctx->arena, size, align);
+    void *mem = ejson_arena_alloc(ctx->arena, size, align);
     if (mem == NULL) {
         report(ctx->error, "Out of arena");
         return NULL;
@@ -134,160 +225,296 @@ static void *alloc_or_report(context_t *ctx, size_t size, size_t align)
     return mem;
 }
 
-#define EMPTY_STRING ((ejson_string) {.base=NULL, .size=0})
-
-static void init_val_for_str(ejson_value *val, ejson_string str)
+static ejson_value *stack_slot(context_t *ctx, size_t idx)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_STRING;
-    val->key  = EMPTY_STRING;
-    val->when_string = str;
+    return ctx->stack - idx - 1;
 }
 
-static void init_val_for_obj(ejson_value *val, ejson_value *head, size_t size)
+static bool stack_grow(context_t *ctx)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_OBJECT;
-    val->key  = EMPTY_STRING;
-    val->when_array.head = head;
-    val->when_array.size = size;
+    const ejson_allocator *allocator = ctx->arena->allocator;
+
+    size_t capacity = ctx->capacity ? 2 * ctx->capacity : 64;
+    if (capacity > SIZE_MAX / sizeof(ejson_value))
+        return false;
+
+    ejson_value *base = allocator->alloc(allocator->userp, capacity * sizeof(ejson_value));
+    if (base == NULL)
+        return false;
+
+    ejson_value *stack = base + capacity;
+    if (ctx->capacity > 0) {
+        memcpy(stack - ctx->depth, ctx->stack - ctx->depth, ctx->depth * sizeof(ejson_value));
+        allocator->free(allocator->userp, ctx->stack - ctx->capacity, ctx->capacity * sizeof(ejson_value));
+    }
+    ctx->stack = stack;
+    ctx->capacity = capacity;
+    return true;
 }
 
-static void init_val_for_arr(ejson_value *val, ejson_value *head, size_t size)
+static void stack_free(context_t *ctx)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_ARRAY;
-    val->key  = EMPTY_STRING;
-    val->when_array.head = head;
-    val->when_array.size = size;
+    const ejson_allocator *allocator = ctx->arena->allocator;
+    if (ctx->capacity > 0)
+        allocator->free(allocator->userp, ctx->stack - ctx->capacity, ctx->capacity * sizeof(ejson_value));
 }
 
-static void init_val_for_int(ejson_value *val, int64_t raw)
+// Places the stack at the end of the fixed arena, shrinking it so
+// that the end is aligned for values whatever the alignment of the
+// buffer. The caller restores the size when done.
+static void stack_at_end(context_t *ctx, ejson_arena *arena)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_NUMBER;
-    val->key  = EMPTY_STRING;
-    val->when_number.as_int = raw;
-    val->when_number.as_flt = raw;
+    uintptr_t base = (uintptr_t) arena->base;
+    uintptr_t top  = (base + arena->size) & ~(uintptr_t) (alignof(ejson_value)-1);
+    arena->size = (top < base + arena->used) ? arena->used : top - base;
+    ctx->stack = (ejson_value*) (base + arena->size);
 }
 
-static void init_val_for_flt(ejson_value *val, double raw)
+static ejson_value *stack_push(context_t *ctx)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_NUMBER;
-    val->key  = EMPTY_STRING;
-    val->when_number.as_int = raw;
-    val->when_number.as_flt = raw;
+    ejson_arena *arena = ctx->arena;
+    if (arena->allocator) {
+        if (ctx->depth == ctx->capacity && !stack_grow(ctx)) {
+            report(ctx->error, "Out of memory");
+            return NULL;
+        }
+    } else {
+        if (arena->used + sizeof(ejson_value) > arena->size) {
+            report(ctx->error, "Out of arena");
+            return NULL;
+        }
+        arena->size -= sizeof(ejson_value);
+    }
+    return stack_slot(ctx, ctx->depth++);
 }
 
-static void init_val_for_null(ejson_value *val)
+static void stack_pop(context_t *ctx, size_t num)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_NULL;
-    val->key  = EMPTY_STRING;
+    assert(ctx->depth >= num);
+    ctx->depth -= num;
+    if (ctx->arena->allocator == NULL)
+        ctx->arena->size += num * sizeof(ejson_value);
 }
 
-static void init_val_for_true(ejson_value *val)
+static void measure_alloc(measure_t *measure, size_t size, size_t align)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_BOOLEAN;
-    val->key  = EMPTY_STRING;
-    val->when_boolean = 1;
+    measure->used += -measure->used & (align-1);
+    measure->used += size;
+    if (measure->peak < measure->used + measure->stack)
+        measure->peak = measure->used + measure->stack;
 }
 
-static void init_val_for_false(ejson_value *val)
+static void measure_push(measure_t *measure, size_t size)
 {
-    val->prev = NULL;
-    val->next = NULL;
-    val->type = EJSON_BOOLEAN;
-    val->key  = EMPTY_STRING;
-    val->when_boolean = 0;
+    measure->stack += size;
+    if (measure->peak < measure->used + measure->stack)
+        measure->peak = measure->used + measure->stack;
 }
 
-static ejson_value *make_val_for_str(context_t *ctx, ejson_string str)
+static ejson_value *alloc_val(context_t *ctx)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
-    if (val) init_val_for_str(val, str);
-    return val;
+    measure_t *measure = ctx->measure;
+    if (measure) {
+        measure->nodes++;
+        if (ctx->config.contiguous_children)
+            measure_push(measure, sizeof(ejson_value));
+        else
+            measure_alloc(measure, sizeof(ejson_value), alignof(ejson_value));
+        return &measure->scratch;
+    }
+
+    if (ctx->config.contiguous_children)
+        return stack_push(ctx);
+    return alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
 }
 
-static ejson_value *make_val_for_obj(context_t *ctx, ejson_value *head, size_t size)
+// Copies a value to its final location, updating
+// the pointers its children have to it.
+static void place_val(ejson_value *dst, ejson_value *src)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
-    if (val) init_val_for_obj(val, head, size);
-    return val;
+    *dst = *src;
+    if (dst->type == EJSON_ARRAY || dst->type == EJSON_OBJECT)
+        adopt_children(dst);
 }
 
-static ejson_value *make_val_for_arr(context_t *ctx, ejson_value *head, size_t size)
+typedef struct {
+    ejson_value  *head;
+    ejson_value **tail;
+    size_t        size;
+    size_t        base;   // Stack depth before the first child
+    ejson_value  *parent; // Set when the children aren't contiguous
+} child_list_t;
+
+static ejson_value *make_val_for_container(context_t *ctx, ejson_type type, child_list_t *list)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
-    if (val) init_val_for_arr(val, head, size);
+    // Linked containers are allocated by begin_children
+    ejson_value *val = (list && list->parent) ? list->parent : alloc_val(ctx);
+    if (val == NULL)
+        return NULL;
+
+    ejson_value *head = list ? list->head : NULL;
+    size_t       size = list ? list->size : 0;
+    if (type == EJSON_OBJECT)
+        init_val_for_obj(val, head, size);
+    else
+        init_val_for_arr(val, head, size);
+
+    // Contiguous containers are still on the stack,
+    // and their children are linked to them by place_val.
+    if (ctx->config.contiguous_children)
+        val->flags |= EJSON_FLAG_CONTIGUOUS;
+    else if (head)
+        head->prev = &val->when_array.head;
     return val;
 }
 
-static ejson_value *make_val_for_int(context_t *ctx, int64_t raw)
+static ejson_value *make_val_for_str(context_t *ctx, ejson_string str)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
-    if (val) init_val_for_int(val, raw);
+    ejson_value *val = alloc_val(ctx);
+    if (val) init_val_for_str(val, str);
     return val;
 }
 
-static ejson_value *make_val_for_flt(context_t *ctx, double raw)
+static ejson_value *make_val_for_num(context_t *ctx, ejson_number num)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
-    if (val) init_val_for_flt(val, raw);
+    ejson_value *val = alloc_val(ctx);
+    if (val) init_val_for_num(val, num);
     return val;
 }
 
 static ejson_value *make_val_for_null(context_t *ctx)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
+    ejson_value *val = alloc_val(ctx);
     if (val) init_val_for_null(val);
     return val;
 }
 
 static ejson_value *make_val_for_true(context_t *ctx)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
+    ejson_value *val = alloc_val(ctx);
     if (val) init_val_for_true(val);
     return val;
 }
 
 static ejson_value *make_val_for_false(context_t *ctx)
 {
-    ejson_value *val = alloc_or_report(ctx, sizeof(ejson_value), alignof(ejson_value));
+    ejson_value *val = alloc_val(ctx);
     if (val) init_val_for_false(val);
     return val;
 }
 
 static ejson_value *make_val_for_empty_obj(context_t *ctx)
 {
-    return make_val_for_obj(ctx, NULL, 0);
+    return make_val_for_container(ctx, EJSON_OBJECT, NULL);
 }
 
 static ejson_value *make_val_for_empty_arr(context_t *ctx)
 {
-    return make_val_for_arr(ctx, NULL, 0);
+    return make_val_for_container(ctx, EJSON_ARRAY, NULL);
 }
 
 static ejson_value *parse_str_2(context_t *ctx)
 {
     ejson_value *val;
     ejson_string str;
-    if (!parse_str(ctx, &str))
+    bool escaped;
+    if (!parse_str(ctx, &str, &escaped))
         val = NULL;
-    else
+    else {
         val = make_val_for_str(ctx, str);
+        if (val && escaped)
+            val->flags |= EJSON_FLAG_ESCAPED;
+    }
     return val;
 }
 
+static bool index_obj(context_t *ctx, ejson_value *obj)
+{
+    if (obj->when_array.size < ctx->config.key_index_min)
+        return true;
+
+    measure_t *measure = ctx->measure;
+    if (measure) {
+        if (ctx->config.key_index != EJSON_KEYINDEX_NONE)
+            measure_alloc(measure, sizeof(ejson_keyindex), alignof(ejson_keyindex));
+        if (ctx->config.key_index == EJSON_KEYINDEX_EAGER) {
+            size_t num = ejson_keyindex_slots(obj->when_array.size);
+            measure_alloc(measure, num * sizeof(ejson_value*), alignof(ejson_value*));
+        }
+        return true;
+    }
+
+    if (!ejson_keyindex_attach(obj, ctx->arena, ctx->home, ctx->config.key_index, 0)) {
+        report(ctx->error, "Out of arena");
+        return false;
+    }
+    return true;
+}
+
+static bool begin_children(context_t *ctx, child_list_t *list)
+{
+    list->head = NULL;
+    list->tail = &list->head;
+    list->size = 0;
+    list->base = ctx->depth;
+    list->parent = NULL;
+
+    // Linked children are given their parent as they
+    // are added, so it's allocated before them.
+    if (!ctx->config.contiguous_children) {
+        list->parent = alloc_val(ctx);
+        if (list->parent == NULL)
+            return false;
+    }
+    return true;
+}
+
+static void add_child(context_t *ctx, child_list_t *list, ejson_value *val)
+{
+    // Contiguous children are linked when they are moved
+    // off the stack. Measured ones are never linked.
+    if (!ctx->config.contiguous_children && !ctx->measure) {
+        val->prev = list->tail;
+        val->parent = list->parent;
+        *list->tail = val;
+        list->tail = &val->next;
+    }
+    list->size++;
+}
+
+static bool end_children(context_t *ctx, child_list_t *list)
+{
+    if (!ctx->config.contiguous_children) {
+        *list->tail = NULL;
+        return true;
+    }
+
+    size_t num = list->size;
+    if (num == 0)
+        return true;
+
+    measure_t *measure = ctx->measure;
+    if (measure) {
+        measure_alloc(measure, num * sizeof(ejson_value), alignof(ejson_value));
+        measure->stack -= num * sizeof(ejson_value);
+        return true;
+    }
+
+    ejson_value *block = alloc_or_report(ctx, num * sizeof(ejson_value), alignof(ejson_value));
+    if (block == NULL)
+        return false;
+
+    for (size_t i = 0; i < num; i++) {
+        place_val(&block[i], stack_slot(ctx, list->base + i));
+        block[i].prev = (i == 0) ? NULL : &block[i-1].next;
+        block[i].next = (i+1 == num) ? NULL : &block[i+1];
+    }
+    stack_pop(ctx, num);
+
+    list->head = block;
+    return true;
+}
+
 static ejson_value *parse_any(context_t *ctx);
 
 static ejson_value *parse_obj(context_t *ctx)
@@ -310,9 +537,12 @@ static ejson_value *parse_obj(context_t *ctx)
     // At this point the cursor refers to the key
     // of the first element.
 
-    ejson_value  *head;
-    ejson_value **tail = &head;
-    size_t size = 0;
+    // Last key interned in the object
+    const char *prev_key = NULL;
+
+    child_list_t list;
+    if (!begin_children(ctx, &list))
+        return NULL;
     do {
         char c;
 
@@ -332,7 +562,8 @@ static ejson_value *parse_obj(context_t *ctx)
         // Parse the key string
 
         ejson_string key;
-        if (!parse_str(ctx, &key))
+        bool key_escaped;
+        if (!parse_str(ctx, &key, &key_escaped))
             return NULL;
 
         // Consume the key-value separator ':'
@@ -357,10 +588,18 @@ static ejson_value *parse_obj(context_t *ctx)
 
         // Insert the value into the object
         val->key = key;
-        val->prev = tail;
-        *tail = val;
-        tail = &val->next;
-        size++;
+        if (key_escaped)
+            val->flags |= EJSON_FLAG_ESCAPED_KEY;
+        else if (ctx->config.key_dict && !ctx->measure) {
+            const char *interned = ejson_keydict_intern_after(ctx->config.key_dict, prev_key,
+                                                              key.base, key.size);
+            if (interned) {
+                val->key.base = interned;
+                val->flags |= EJSON_FLAG_INTERNED_KEY;
+                prev_key = interned;
+            }
+        }
+        add_child(ctx, &list, val);
 
         // Now prepare for the next element
         consume_spaces(ctx);
@@ -390,9 +629,13 @@ static ejson_value *parse_obj(context_t *ctx)
 
     } while (1);
 
-    *tail = NULL;
+    if (!end_children(ctx, &list))
+        return NULL;
 
-    return make_val_for_obj(ctx, head, size);
+    ejson_value *obj = make_val_for_container(ctx, EJSON_OBJECT, &list);
+    if (obj && !index_obj(ctx, obj))
+        return NULL;
+    return obj;
 }
 
 static ejson_value *parse_arr(context_t *ctx)
@@ -412,9 +655,9 @@ static ejson_value *parse_arr(context_t *ctx)
         return make_val_for_empty_arr(ctx);
     }
 
-    ejson_value  *head;
-    ejson_value **tail = &head;
-    size_t size = 0;
+    child_list_t list;
+    if (!begin_children(ctx, &list))
+        return NULL;
 
     for (;;) {
         ejson_value *val = parse_any(ctx);
@@ -422,10 +665,7 @@ static ejson_value *parse_arr(context_t *ctx)
             return NULL;
 
         // Insert the value into the array
-        val->prev = tail;
-        *tail = val;
-        tail = &val->next;
-        size++;
+        add_child(ctx, &list, val);
 
         // Now prepare for the next element
         consume_spaces(ctx);
@@ -454,112 +694,114 @@ static ejson_value *parse_arr(context_t *ctx)
         }
     }
 
-    *tail = NULL;
-    return make_val_for_arr(ctx, head, size);
-}
+    if (!end_children(ctx, &list))
+        return NULL;
 
-static bool follows_digit(context_t *ctx)
-{
-    return ctx->cur < ctx->len && is_digit(ctx->src[ctx->cur]);
+    return make_val_for_container(ctx, EJSON_ARRAY, &list);
 }
 
-static ejson_value *parse_int(context_t *ctx)
+bool ejson_lex_number(const char *src, size_t len, size_t *pcur,
+                      ejson_error *error, ejson_number *num)
 {
-    assert(follows_digit(ctx));
+    size_t cur = *pcur;
+    assert(cur < len);
 
-    int64_t value = 0;
-    do {
-        char c = ctx->src[ctx->cur]; // Digit character
-        int  d = c & 0x0F; // Integer value of the character
-        if (value > (INT64_MAX - d) / 10) {
-            report(ctx->error, "Overflow");
-            return NULL;
-        }
-        value = value * 10 + d;
-        ctx->cur++;
-    } while (follows_digit(ctx));
+    size_t end;
+    switch (ejson_parse_number(src + cur, len - cur, &end, num)) {
 
-    return make_val_for_int(ctx, value);
-}
+        case EJSON_NUMBER_OK:
+        break;
 
-static ejson_value *parse_flt(context_t *ctx)
-{
-    assert(follows_digit(ctx));
-
-    double value = 0;
-    do {
-        char c = ctx->src[ctx->cur]; // Digit character
-        int  d = c & 0x0F; // Integer value of the character
-        value = value * 10 + d;
-        ctx->cur++;
-    } while (follows_digit(ctx));
-
-    assert(ctx->cur < ctx->len && ctx->src[ctx->cur] == '.');
-    ctx->cur++;
-
-    if (follows_digit(ctx)) {
+        case EJSON_NUMBER_INVALID:
+        cur += end;
+        if (cur == len)
+            report(error, "Source end in number");
+        else if (is_printable(src[cur]))
+            report(error, "Invalid character '%c' in number", src[cur]);
+        else
+            report(error, "Invalid byte %x in number", src[cur]);
+        *pcur = cur;
+        return false;
 
-        double q = 1;
-        do {
-            q /= 10;
-            char c = ctx->src[ctx->cur];
-            int  d = c & 0x0F;
-            value += q * d;
-            ctx->cur++;
-        } while (follows_digit(ctx));
+        case EJSON_NUMBER_OVERFLOW:
+        report(error, "Overflow");
+        return false;
     }
-
-    return make_val_for_flt(ctx, value);
+    *pcur = cur + end;
+    return true;
 }
 
-static ejson_value *parse_num(context_t *ctx)
+static bool lex_num(context_t *ctx, ejson_number *num)
 {
-    size_t cur = ctx->cur;
-    while (cur < ctx->len && is_digit(ctx->src[cur]))
-        cur++;
-
-    if (cur < ctx->len && ctx->src[cur] == '.')
-        return parse_flt(ctx);
-    return parse_int(ctx);
+    return ejson_lex_number(ctx->src, ctx->len, &ctx->cur, ctx->error, num);
 }
 
-static bool follows_alpha(context_t *ctx)
+static ejson_value *parse_num(context_t *ctx)
 {
-    return ctx->cur < ctx->len && is_alpha(ctx->src[ctx->cur]);
+    ejson_number num;
+    if (!lex_num(ctx, &num))
+        return NULL;
+    return make_val_for_num(ctx, num);
 }
 
-static ejson_value *parse_oth(context_t *ctx)
+bool ejson_lex_word(const char *src, size_t len, size_t *pcur,
+                    ejson_error *error, ejson_type *type, bool *value)
 {
-    assert(ctx->cur < ctx->len);
+    size_t cur = *pcur;
+    assert(cur < len);
 
-    char c = ctx->src[ctx->cur];
+    char c = src[cur];
     if (!is_alpha(c)) {
         if (is_printable(c))
-            report(ctx->error, "Unexpected character '%c'", c);
+            report(error, "Unexpected character '%c'", c);
         else
-            report(ctx->error, "Invalid byte %x", c);
-        return NULL;
+            report(error, "Invalid byte %x", c);
+        return false;
     }
 
-    size_t off = ctx->cur;
+    size_t off = cur;
     do
-        ctx->cur++;
-    while (follows_alpha(ctx));
-    size_t len = ctx->cur - off;
+        cur++;
+    while (cur < len && is_alpha(src[cur]));
+    size_t wlen = cur - off;
+    *pcur = cur;
 
-    assert(len > 0);
+    if (wlen == 4 && !strncmp("null", src + off, 4)) {
+        *type = EJSON_NULL;
+        return true;
+    }
 
-    if (len == 4 && !strncmp("null", ctx->src + off, 4))
-        return make_val_for_null(ctx);
+    if (wlen == 4 && !strncmp("true", src + off, 4)) {
+        *type = EJSON_BOOLEAN;
+        *value = true;
+        return true;
+    }
 
-    if (len == 4 && !strncmp("true", ctx->src + off, 4))
-        return make_val_for_true(ctx);
+    if (wlen == 5 && !strncmp("false", src + off, 5)) {
+        *type = EJSON_BOOLEAN;
+        *value = false;
+        return true;
+    }
 
-    if (len == 5 && !strncmp("false", ctx->src + off, 5))
-        return make_val_for_false(ctx);
+    report(error, "Invalid token '%.*s'", (int) wlen, src + off);
+    return false;
+}
 
-    report(ctx->error, "Invalid token '%.*s'", (int) len, ctx->src + off);
-    return NULL;
+static bool lex_word(context_t *ctx, ejson_type *type, bool *value)
+{
+    return ejson_lex_word(ctx->src, ctx->len, &ctx->cur, ctx->error, type, value);
+}
+
+static ejson_value *parse_oth(context_t *ctx)
+{
+    bool value;
+    ejson_type type;
+    if (!lex_word(ctx, &type, &value))
+        return NULL;
+
+    if (type == EJSON_NULL)
+        return make_val_for_null(ctx);
+    return value ? make_val_for_true(ctx) : make_val_for_false(ctx);
 }
 
 static ejson_value *parse_any(context_t *ctx)
@@ -571,41 +813,60 @@ static ejson_value *parse_any(context_t *ctx)
         return NULL;
     }
 
-    char c = ctx->src[ctx->cur];
+    size_t start = ctx->cur;
+    char c = ctx->src[start];
 
+    ejson_value *val;
     if (c == '"' || (c == '\'' && ctx->config.allow_single_quoted_strings))
-        return parse_str_2(ctx);
-    
-    if (c == '{')
-        return parse_obj(ctx);
-    
-    if (c == '[')
-        return parse_arr(ctx);
-    
-    if (is_digit(c))
-        return parse_num(ctx);
+        val = parse_str_2(ctx);
+    else if (c == '{')
+        val = parse_obj(ctx);
+    else if (c == '[')
+        val = parse_arr(ctx);
+    else if (is_digit(c) || c == '-')
+        val = parse_num(ctx);
+    else
+        val = parse_oth(ctx);
 
-    return parse_oth(ctx);
+    // Sources with single quotes can't be copied to the output
+    if (val && !ctx->config.allow_single_quoted_strings)
+        val->src = (ejson_string) {.base=ctx->src + start, .size=ctx->cur - start};
+    return val;
 }
 
 ejson_value *ejson_parse2(const char *src, size_t len, size_t *end,
                           ejson_error *error, ejson_arena *arena,
                           ejson_config config)
 {
-    size_t save = arena->used;
+    ejson_arena_mark save = ejson_arena_save(arena);
 
     context_t ctx = {
         .error = error,
         .arena = arena,
+        .home = arena,
         .src = src,
         .len = len,
         .cur = 0,
         .config = config,
     };
 
+    bool fixed_stack = config.contiguous_children && arena->allocator == NULL;
+    if (fixed_stack)
+        stack_at_end(&ctx, arena);
+
     ejson_value *root = parse_any(&ctx);
+    if (root && config.contiguous_children) {
+        // The root is the only value left on the stack
+        ejson_value *dst = alloc_or_report(&ctx, sizeof(ejson_value), alignof(ejson_value));
+        if (dst) place_val(dst, root);
+        root = dst;
+    }
+    if (fixed_stack)
+        arena->size = save.size;
+    stack_free(&ctx);
+
     if (root == NULL)
-        arena->used = save;
+        ejson_arena_restore(arena, save);
     else {
         if (end) 
             *end = ctx.cur;
@@ -613,6 +874,306 @@ ejson_value *ejson_parse2(const char *src, size_t len, size_t *end,
     return root;
 }
 
+bool ejson_measure(const char *src, size_t len, size_t *end,
+                   ejson_error *error, ejson_config config,
+                   size_t *nodes, size_t *bytes)
+{
+    measure_t measure = {0};
+
+    context_t ctx = {
+        .error = error,
+        .arena = NULL,
+        .measure = &measure,
+        .src = src,
+        .len = len,
+        .cur = 0,
+        .config = config,
+    };
+
+    if (parse_any(&ctx) == NULL)
+        return false;
+
+    if (config.contiguous_children) {
+        // Moving the root off the stack
+        measure_alloc(&measure, sizeof(ejson_value), alignof(ejson_value));
+        measure.stack -= sizeof(ejson_value);
+    }
+
+    if (end)   *end   = ctx.cur;
+    if (nodes) *nodes = measure.nodes;
+    if (bytes) *bytes = measure.peak;
+    return true;
+}
+
+bool ejson_parse_elements(ejson_elements *elems, bool measure)
+{
+    measure_t measure_state = {0};
+    ejson_arena *arena = elems->arena;
+    ejson_config config = elems->config;
+
+    context_t ctx = {
+        .error = NULL,
+        .arena = arena,
+        .home = elems->home,
+        .measure = measure ? &measure_state : NULL,
+        .src = elems->src,
+        .len = elems->len,
+        .config = config,
+    };
+
+    size_t save_size = measure ? 0 : arena->size;
+    bool fixed_stack = !measure && config.contiguous_children && arena->allocator == NULL;
+    if (fixed_stack)
+        stack_at_end(&ctx, arena);
+
+    ejson_value *prev = NULL;
+    elems->head = NULL;
+    elems->tail = NULL;
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < elems->num; i++) {
+
+        ctx.cur = elems->bounds[i] + 1;
+
+        ejson_value *val = parse_any(&ctx);
+        if (val == NULL) {
+            ok = false;
+            break;
+        }
+
+        consume_spaces(&ctx);
+        if (ctx.cur != elems->bounds[i+1]) {
+            ok = false;
+            break;
+        }
+
+        if (measure) {
+            if (config.contiguous_children)
+                measure_state.stack -= sizeof(ejson_value);
+        } else if (config.contiguous_children) {
+            place_val(&elems->slots[i], val);
+            stack_pop(&ctx, 1);
+        } else {
+            if (prev) {
+                val->prev = &prev->next;
+                prev->next = val;
+            } else
+                elems->head = val;
+            prev = val;
+        }
+    }
+    elems->tail = prev;
+    elems->bytes = measure_state.peak;
+
+    if (fixed_stack)
+        arena->size = save_size;
+    if (!measure)
+        stack_free(&ctx);
+    return ok;
+}
+
+// Deepest nesting ejson_sax can follow. Each level takes one bit,
+// set when it's an object, so the parse needs a fixed amount of
+// memory whatever the document.
+#define SAX_MAX_DEPTH 4096
+
+// Calls a handler, unless it's NULL. Evaluates to false when the
+// handler asks to stop.
+#define EMIT(handler, name, ...) \
+    ((handler)->name == NULL || (handler)->name((handler)->userp, ##__VA_ARGS__))
+
+static bool sax_key(context_t *ctx, const ejson_handler *handler, bool *stop)
+{
+    assert(ctx->cur < ctx->len);
+
+    char c = ctx->src[ctx->cur];
+    if (c != '"') {
+        if (is_printable(c))
+            report(ctx->error, "Missing key (character '%c' instead)", c);
+        else
+            report(ctx->error, "Invalid byte %x in object", c);
+        return false;
+    }
+
+    ejson_string key;
+    bool escaped;
+    if (!parse_str(ctx, &key, &escaped))
+        return false;
+
+    consume_spaces(ctx);
+    if (ctx->cur == ctx->len) {
+        report(ctx->error, "Source end in object (after key)");
+        return false;
+    }
+    c = ctx->src[ctx->cur];
+    if (c != ':') {
+        if (is_printable(c))
+            report(ctx->error, "Missing ':' after key (character '%c' instead)", c);
+        else
+            report(ctx->error, "Invalid byte %x in object (after key)", c);
+        return false;
+    }
+    ctx->cur++; // Consume the ":"
+
+    *stop = !EMIT(handler, key, key, escaped);
+    return true;
+}
+
+// Reads a scalar, or the opening bracket of an array or object.
+// Opening a non-empty one sets "open".
+static bool sax_value(context_t *ctx, const ejson_handler *handler,
+                      uint64_t *nesting, size_t *depth, bool *open, bool *stop)
+{
+    consume_spaces(ctx);
+    if (ctx->cur == ctx->len) {
+        report(ctx->error, "Missing value");
+        return false;
+    }
+
+    char c = ctx->src[ctx->cur];
+
+    if (c == '{' || c == '[') {
+        if (*depth == SAX_MAX_DEPTH) {
+            report(ctx->error, "Too many nested arrays and objects");
+            return false;
+        }
+        bool obj = (c == '{');
+        uint64_t bit = (uint64_t) 1 << (*depth % 64);
+        if (obj)
+            nesting[*depth / 64] |= bit;
+        else
+            nesting[*depth / 64] &= ~bit;
+        (*depth)++;
+        ctx->cur++; // Consume the "{" or "["
+
+        if (!(obj ? EMIT(handler, begin_object) : EMIT(handler, begin_array))) {
+            *stop = true;
+            return true;
+        }
+
+        consume_spaces(ctx);
+        if (ctx->cur == ctx->len) {
+            report(ctx->error, "Source end in %s", obj ? "object" : "array");
+            return false;
+        }
+        if (ctx->src[ctx->cur] == (obj ? '}' : ']')) {
+            ctx->cur++;
+            (*depth)--;
+            *stop = !(obj ? EMIT(handler, end_object) : EMIT(handler, end_array));
+        } else
+            *open = true;
+        return true;
+    }
+
+    if (c == '"' || (c == '\'' && ctx->config.allow_single_quoted_strings)) {
+        ejson_string str;
+        bool escaped;
+        if (!parse_str(ctx, &str, &escaped))
+            return false;
+        *stop = !EMIT(handler, string, str, escaped);
+        return true;
+    }
+
+    if (is_digit(c) || c == '-') {
+        ejson_number num;
+        if (!lex_num(ctx, &num))
+            return false;
+        *stop = !EMIT(handler, number, num);
+        return true;
+    }
+
+    bool value;
+    ejson_type type;
+    if (!lex_word(ctx, &type, &value))
+        return false;
+    if (type == EJSON_NULL)
+        *stop = !EMIT(handler, null);
+    else
+        *stop = !EMIT(handler, boolean, value);
+    return true;
+}
+
+ejson_saxresult ejson_sax(const char *src, size_t len, size_t *end,
+                          ejson_error *error, ejson_config config,
+                          const ejson_handler *handler)
+{
+    context_t ctx = {
+        .error = error,
+        .src = src,
+        .len = len,
+        .cur = 0,
+        .config = config,
+    };
+
+    uint64_t nesting[SAX_MAX_DEPTH / 64];
+    size_t depth = 0;
+
+    // Each round reads a value, and the key before it when it's
+    // in an object. Then the commas and closing brackets that
+    // follow it are read, up to the next key or value.
+    bool stop = false;
+    for (;;) {
+        bool open = false;
+
+        if (depth > 0 && (nesting[(depth-1) / 64] >> ((depth-1) % 64) & 1)) {
+            if (!sax_key(&ctx, handler, &stop))
+                return EJSON_SAX_ERROR;
+            if (stop)
+                break;
+        }
+
+        if (!sax_value(&ctx, handler, nesting, &depth, &open, &stop))
+            return EJSON_SAX_ERROR;
+        if (stop)
+            break;
+        if (open)
+            continue;
+
+        while (depth > 0) {
+            bool obj = nesting[(depth-1) / 64] >> ((depth-1) % 64) & 1;
+            const char *name = obj ? "object" : "array";
+            char close = obj ? '}' : ']';
+
+            consume_spaces(&ctx);
+            if (ctx.cur == ctx.len) {
+                report(error, "Source end in %s (after value)", name);
+                return EJSON_SAX_ERROR;
+            }
+            char c = ctx.src[ctx.cur];
+            if (c == close) {
+                ctx.cur++;
+                depth--;
+                if (!(obj ? EMIT(handler, end_object) : EMIT(handler, end_array))) {
+                    stop = true;
+                    break;
+                }
+                continue;
+            }
+            if (c != ',') {
+                if (is_printable(c))
+                    report(error, "Missing ',' or '%c' after value (character '%c' instead)", close, c);
+                else
+                    report(error, "Invalid byte %x in %s (after value)", c, name);
+                return EJSON_SAX_ERROR;
+            }
+            ctx.cur++; // Consume the ","
+
+            consume_spaces(&ctx);
+            if (ctx.cur == ctx.len) {
+                report(error, "Source end in %s (after '%c')", name, c);
+                return EJSON_SAX_ERROR;
+            }
+            break;
+        }
+        if (stop || depth == 0)
+            break;
+    }
+
+    if (end)
+        *end = ctx.cur;
+    return stop ? EJSON_SAX_STOPPED : EJSON_SAX_DONE;
+}
+
 ejson_value *ejson_parse(const char *src, size_t len,
                          ejson_error *error, ejson_arena *arena)
 {
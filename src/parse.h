@@ -0,0 +1,49 @@
+#ifndef EJSON_PARSE_H
+#define EJSON_PARSE_H
+
+#include "ejson.h"
+
+// A run of consecutive elements of an array. Element N lies
+// between the delimiters at "bounds[N]" and "bounds[N+1]", which
+// are the "[" or "," before it and the "," or "]" after it.
+typedef struct {
+    const char     *src;
+    size_t          len;
+    const uint32_t *bounds;
+    size_t          num;
+    ejson_config    config;
+    ejson_arena    *arena; // Where the values are allocated
+    ejson_arena    *home;  // Where the document ends up
+    ejson_value    *slots; // Where contiguous elements are placed
+
+    ejson_value *head; // Linked elements
+    ejson_value *tail;
+    size_t       bytes; // Arena needed, when measuring
+} ejson_elements;
+
+// Parses or measures the elements. Linked elements are chained
+// together but their first "prev" and last "next" are left for the
+// caller to set, while contiguous ones aren't linked at all. Returns
+// false if any element is invalid or isn't followed by its delimiter.
+bool ejson_parse_elements(ejson_elements *elems, bool measure);
+
+// Tokens, shared by every parser so that they accept the same ones
+// and report the same errors. Each reads the token at "*cur" and
+// moves the cursor past it, or to where it went wrong.
+
+// Reads the string whose opening quote is at the cursor. It's
+// sliced out of the source, escapes included, and "escaped" is set
+// if there are any.
+bool ejson_lex_string(const char *src, size_t len, size_t *cur,
+                      ejson_error *error, ejson_string *str, bool *escaped);
+
+// Reads the number at the cursor
+bool ejson_lex_number(const char *src, size_t len, size_t *cur,
+                      ejson_error *error, ejson_number *num);
+
+// Reads "null", "true" or "false". The type is EJSON_NULL or
+// EJSON_BOOLEAN, with "value" set for the booleans.
+bool ejson_lex_word(const char *src, size_t len, size_t *cur,
+                    ejson_error *error, ejson_type *type, bool *value);
+
+#endif
@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include "arena.h"
+#include "pointer.h"
+
+typedef enum {
+    UNDO_UNLINK,  // Remove "val", which was inserted
+    UNDO_RELINK,  // Put "val" back after "after", or first in "parent"
+    UNDO_PUTBACK, // Put "other" back where "val" is
+    UNDO_ROOT,    // Make "val" the root again
+} undo_kind;
+
+// Operations that were applied are logged so that they can be
+// reverted, last one first, when a later one fails.
+typedef struct undo_t undo_t;
+struct undo_t {
+    undo_t      *prev;
+    undo_kind    kind;
+    ejson_value *val;
+    ejson_value *other;
+    ejson_value *parent;
+    ejson_value *after;
+    ejson_string key;
+    uint32_t     key_flags;
+};
+
+// Where a pointer leads: the last token is "key", decoded, in the
+// container "parent", and "target" is the value already there, if
+// any. The root has no parent.
+typedef struct {
+    ejson_value *parent;
+    ejson_string key;
+    ejson_value *target;
+} location_t;
+
+typedef struct {
+    ejson_value **doc;
+    ejson_arena  *arena;
+    ejson_arena   scratch; // Decoded strings, released after each operation
+    ejson_arena   log;
+    undo_t       *undo;
+    ejson_error  *error;
+    size_t        op;
+} patcher_t;
+
+static void report(patcher_t *p, const char *fmt, ...)
+{
+    if (!p->error)
+        return;
+
+    int len = snprintf(p->error->msg, sizeof(p->error->msg), "Operation %zu: ", p->op);
+    if (len < 0 || (size_t) len >= sizeof(p->error->msg))
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(p->error->msg + len, sizeof(p->error->msg) - len, fmt, args);
+    va_end(args);
+}
+
+// Entries are allocated before the edit they revert is made,
+// so that no edit goes unlogged when memory runs out.
+static undo_t *reserve_undo(patcher_t *p)
+{
+    undo_t *undo = ejson_arena_alloc(&p->log, sizeof(undo_t), alignof(undo_t));
+    if (undo == NULL)
+        report(p, "Out of memory");
+    return undo;
+}
+
+static void log_undo(patcher_t *p, undo_t *undo, undo_t entry)
+{
+    *undo = entry;
+    undo->prev = p->undo;
+    p->undo = undo;
+}
+
+static void revert(patcher_t *p)
+{
+    for (undo_t *undo = p->undo; undo; undo = undo->prev) {
+        ejson_value *val = undo->val;
+        switch (undo->kind) {
+
+            case UNDO_UNLINK:
+            ejson_remove(val);
+            break;
+
+            case UNDO_RELINK:
+            val->key = undo->key;
+            val->flags = (val->flags & ~(EJSON_FLAG_ESCAPED_KEY | EJSON_FLAG_INTERNED_KEY)) | undo->key_flags;
+            if (undo->after)
+                ejson_insert_after(undo->after, val);
+            else if (undo->parent->when_array.head)
+                ejson_insert_before(undo->parent->when_array.head, val);
+            else
+                ejson_append(undo->parent, val);
+            break;
+
+            case UNDO_PUTBACK:
+            ejson_replace(val, undo->other);
+            break;
+
+            case UNDO_ROOT:
+            *p->doc = val;
+            break;
+        }
+    }
+    p->undo = NULL;
+}
+
+// Member of the operation that must be a string, decoded
+static bool get_string(patcher_t *p, ejson_value *op, const char *name, ejson_string *out)
+{
+    ejson_value *val = ejson_seekbykey(op, name);
+    if (val == NULL || val->type != EJSON_STRING) {
+        report(p, "Member \"%s\" is missing or isn't a string", name);
+        return false;
+    }
+
+    *out = val->when_string;
+    if (val->flags & EJSON_FLAG_ESCAPED) {
+        char *dst = ejson_arena_alloc(&p->scratch, out->size, 1);
+        if (dst == NULL) {
+            report(p, "Out of memory");
+            return false;
+        }
+        out->size = ejson_unescape_to(val->when_string, dst);
+        out->base = dst;
+    }
+    return true;
+}
+
+static bool get_value(patcher_t *p, ejson_value *op, ejson_value **out)
+{
+    ejson_value *val = ejson_seekbykey(op, "value");
+    if (val == NULL) {
+        report(p, "Member \"value\" is missing");
+        return false;
+    }
+    *out = val;
+    return true;
+}
+
+static bool decode_token(patcher_t *p, ejson_string tok, ejson_string *out)
+{
+    if (memchr(tok.base, '~', tok.size) == NULL) {
+        *out = tok;
+        return true;
+    }
+
+    char *dst = ejson_arena_alloc(&p->scratch, tok.size, 1);
+    if (dst == NULL) {
+        report(p, "Out of memory");
+        return false;
+    }
+    size_t size = ejson_pointer_decode(tok, dst);
+    if (size == SIZE_MAX) {
+        report(p, "Invalid escape in pointer \"%.*s\"", (int) tok.size, tok.base);
+        return false;
+    }
+    *out = (ejson_string) {.base=dst, .size=size};
+    return true;
+}
+
+static bool locate(patcher_t *p, ejson_string ptr, location_t *loc)
+{
+    loc->parent = NULL;
+    loc->key    = (ejson_string) {.base=NULL, .size=0};
+    loc->target = *p->doc;
+
+    if (ptr.size > 0 && ptr.base[0] != '/') {
+        report(p, "\"%.*s\" isn't a JSON pointer", (int) ptr.size, ptr.base);
+        return false;
+    }
+
+    ejson_string tok;
+    size_t cur = 0;
+    while (ejson_pointer_next(ptr.base, ptr.size, &cur, &tok)) {
+        if (loc->target == NULL
+         || (loc->target->type != EJSON_ARRAY && loc->target->type != EJSON_OBJECT)) {
+            report(p, "Path \"%.*s\" doesn't exist", (int) ptr.size, ptr.base);
+            return false;
+        }
+        loc->parent = loc->target;
+        loc->target = ejson_pointer_child(loc->parent, tok);
+        if (!decode_token(p, tok, &loc->key))
+            return false;
+    }
+    return true;
+}
+
+// Sibling before the child, or NULL when it's the first one
+static ejson_value *prev_sibling(ejson_value *val)
+{
+    if (val->prev == &val->parent->when_array.head)
+        return NULL;
+    return (ejson_value*) ((char*) val->prev - offsetof(ejson_value, next));
+}
+
+static bool detach(patcher_t *p, ejson_value *val)
+{
+    undo_t *undo = reserve_undo(p);
+    if (undo == NULL)
+        return false;
+    log_undo(p, undo, (undo_t) {
+        .kind      = UNDO_RELINK,
+        .val       = val,
+        .parent    = val->parent,
+        .after     = prev_sibling(val),
+        .key       = val->key,
+        .key_flags = val->flags & (EJSON_FLAG_ESCAPED_KEY | EJSON_FLAG_INTERNED_KEY),
+    });
+    ejson_remove(val);
+    return true;
+}
+
+static bool put_root(patcher_t *p, ejson_value *val)
+{
+    undo_t *undo = reserve_undo(p);
+    if (undo == NULL)
+        return false;
+    log_undo(p, undo, (undo_t) {.kind=UNDO_ROOT, .val=*p->doc});
+    *p->doc = val;
+    return true;
+}
+
+static bool swap(patcher_t *p, ejson_value *old, ejson_value *val)
+{
+    undo_t *undo = reserve_undo(p);
+    if (undo == NULL)
+        return false;
+    if (!ejson_replace(old, val)) {
+        report(p, "A value can't be moved inside itself");
+        return false;
+    }
+    log_undo(p, undo, (undo_t) {.kind=UNDO_PUTBACK, .val=val, .other=old});
+    return true;
+}
+
+// Inserts the detached value where the pointer leads. Members
+// that exist are replaced, and elements shifted forward.
+static bool add(patcher_t *p, ejson_string ptr, ejson_value *val)
+{
+    location_t loc;
+    if (!locate(p, ptr, &loc))
+        return false;
+
+    if (loc.parent == NULL)
+        return put_root(p, val);
+
+    if (loc.parent->type == EJSON_OBJECT && loc.target)
+        return swap(p, loc.target, val);
+
+    undo_t *undo = reserve_undo(p);
+    if (undo == NULL)
+        return false;
+
+    bool ok;
+    if (loc.parent->type == EJSON_OBJECT) {
+
+        if (!ejson_setkey(val, loc.key.base, loc.key.size, p->arena)) {
+            report(p, "Out of memory");
+            return false;
+        }
+        ok = ejson_append(loc.parent, val);
+
+    } else {
+
+        size_t size = loc.parent->when_array.size;
+        size_t index = size;
+        bool last = (loc.key.size == 1 && loc.key.base[0] == '-');
+        if (!last && (!ejson_pointer_index(loc.key, &index) || index > size)) {
+            report(p, "Path \"%.*s\" doesn't exist", (int) ptr.size, ptr.base);
+            return false;
+        }
+
+        val->key = (ejson_string) {.base=NULL, .size=0};
+        val->flags &= ~(EJSON_FLAG_ESCAPED_KEY | EJSON_FLAG_INTERNED_KEY);
+        if (loc.target)
+            ok = ejson_insert_before(loc.target, val);
+        else
+            ok = ejson_append(loc.parent, val);
+    }
+
+    if (!ok) {
+        report(p, "A value can't be moved inside itself");
+        return false;
+    }
+    log_undo(p, undo, (undo_t) {.kind=UNDO_UNLINK, .val=val});
+    return true;
+}
+
+// Locates a value that must exist
+static bool locate_existing(patcher_t *p, ejson_string ptr, location_t *loc)
+{
+    if (!locate(p, ptr, loc))
+        return false;
+    if (loc->target == NULL) {
+        report(p, "Path \"%.*s\" doesn't exist", (int) ptr.size, ptr.base);
+        return false;
+    }
+    return true;
+}
+
+static ejson_value *copy(patcher_t *p, ejson_value *val)
+{
+    ejson_value *dup = ejson_copy(val, p->arena);
+    if (dup == NULL) {
+        report(p, "Out of memory");
+        return NULL;
+    }
+    // The key is given by where it goes
+    dup->key = (ejson_string) {.base=NULL, .size=0};
+    dup->flags &= ~(EJSON_FLAG_ESCAPED_KEY | EJSON_FLAG_INTERNED_KEY);
+    return dup;
+}
+
+static bool apply_op(patcher_t *p, ejson_value *op)
+{
+    if (op->type != EJSON_OBJECT) {
+        report(p, "Not an object");
+        return false;
+    }
+
+    ejson_string name;
+    ejson_string path;
+    if (!get_string(p, op, "op", &name) || !get_string(p, op, "path", &path))
+        return false;
+
+    #define IS(str) (name.size == sizeof(str)-1 && !memcmp(name.base, str, sizeof(str)-1))
+
+    location_t loc;
+    ejson_value *val;
+
+    if (IS("add")) {
+        if (!get_value(p, op, &val) || (val = copy(p, val)) == NULL)
+            return false;
+        return add(p, path, val);
+    }
+
+    if (IS("remove")) {
+        if (!locate_existing(p, path, &loc))
+            return false;
+        if (loc.parent == NULL) {
+            report(p, "The root can't be removed");
+            return false;
+        }
+        return detach(p, loc.target);
+    }
+
+    if (IS("replace")) {
+        if (!get_value(p, op, &val) || !locate_existing(p, path, &loc)
+         || (val = copy(p, val)) == NULL)
+            return false;
+        if (loc.parent == NULL)
+            return put_root(p, val);
+        return swap(p, loc.target, val);
+    }
+
+    if (IS("move") || IS("copy")) {
+        ejson_string from;
+        if (!get_string(p, op, "from", &from) || !locate_existing(p, from, &loc))
+            return false;
+
+        if (IS("copy")) {
+            if ((val = copy(p, loc.target)) == NULL)
+                return false;
+            return add(p, path, val);
+        }
+
+        if (from.size == path.size && !memcmp(from.base, path.base, path.size))
+            return true;
+        if (loc.parent == NULL) {
+            report(p, "The root can't be moved");
+            return false;
+        }
+        // The path is looked up after the value is gone, so a
+        // path inside the value itself isn't found.
+        return detach(p, loc.target) && add(p, path, loc.target);
+    }
+
+    if (IS("test")) {
+        if (!get_value(p, op, &val) || !locate_existing(p, path, &loc))
+            return false;
+        if (!ejson_valcmp(loc.target, val)) {
+            report(p, "Test of \"%.*s\" failed", (int) path.size, path.base);
+            return false;
+        }
+        return true;
+    }
+
+    #undef IS
+
+    report(p, "Unknown operation \"%.*s\"", (int) name.size, name.base);
+    return false;
+}
+
+bool ejson_patch_apply(ejson_value **doc, ejson_value *patch, ejson_arena *arena,
+                       const ejson_allocator *allocator, ejson_error *error)
+{
+    if (patch->type != EJSON_ARRAY) {
+        if (error)
+            snprintf(error->msg, sizeof(error->msg), "The patch isn't an array");
+        return false;
+    }
+
+    if (allocator == NULL)
+        allocator = &ejson_stdalloc;
+
+    patcher_t p = {
+        .doc     = doc,
+        .arena   = arena,
+        .scratch = {.allocator = allocator},
+        .log     = {.allocator = allocator},
+        .undo    = NULL,
+        .error   = error,
+        .op      = 0,
+    };
+
+    bool ok = true;
+    for (ejson_value *op = patch->when_array.head; op; op = op->next, p.op++) {
+        ok = apply_op(&p, op);
+        ejson_arena_free(&p.scratch);
+        if (!ok)
+            break;
+    }
+
+    if (!ok)
+        revert(&p);
+    ejson_arena_free(&p.log);
+    return ok;
+}
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "walk.h"
+#include "arena.h"
+#include "index.h"
+#include "escape.h"
+#include "pointer.h"
+
+// A set of JSON Pointers is compiled into a trie with one node per
+// distinct prefix. Each node finds the nodes after it by key through
+// a hash table, and by array index through a sorted list, so that a
+// document is walked once whatever the number of paths, and each
+// child of an object is matched in constant time.
+
+#define NONE SIZE_MAX
+
+typedef struct pathnode_t pathnode_t;
+struct pathnode_t {
+    ejson_string key;   // Decoded token leading here
+    size_t       index; // The token as an array index, or NONE
+    size_t       slot;  // First path ending here, or NONE
+    size_t       order; // Position among the nodes after the parent
+
+    pathnode_t  *first; // Nodes after this one, as a list
+    pathnode_t  *next;
+    size_t       count;
+
+    pathnode_t **table; // The same nodes by key
+    size_t       mask;
+    pathnode_t **byindex; // and by increasing index
+    size_t       numindex;
+};
+
+struct ejson_pathset {
+    pathnode_t *root;
+    size_t      paths;
+    size_t     *alias; // Earlier path equal to each one, or itself
+};
+
+static void report(ejson_error *error, const char *fmt, ...)
+{
+    if (!error)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error->msg, sizeof(error->msg), fmt, args);
+    va_end(args);
+}
+
+static pathnode_t *new_node(ejson_arena *arena)
+{
+    pathnode_t *node = ejson_arena_alloc(arena, sizeof(pathnode_t), alignof(pathnode_t));
+    if (node) {
+        memset(node, 0, sizeof(pathnode_t));
+        node->index = NONE;
+        node->slot  = NONE;
+    }
+    return node;
+}
+
+// Node after "parent" for the decoded token, added if needed
+static pathnode_t *add_token(pathnode_t *parent, ejson_string key, ejson_arena *arena)
+{
+    // Compiling isn't the hot part, so siblings are just searched
+    pathnode_t *node = parent->first;
+    while (node && (node->key.size != key.size || memcmp(node->key.base, key.base, key.size)))
+        node = node->next;
+    if (node)
+        return node;
+
+    node = new_node(arena);
+    if (node == NULL)
+        return NULL;
+    node->key = key;
+    ejson_pointer_index(node->key, &node->index);
+    node->order = parent->count++;
+    node->next = parent->first;
+    parent->first = node;
+    return node;
+}
+
+static int compare_index(const void *a, const void *b)
+{
+    size_t i = (*(pathnode_t* const*) a)->index;
+    size_t j = (*(pathnode_t* const*) b)->index;
+    return (i > j) - (i < j);
+}
+
+// Builds the tables of the node and of those after it
+static bool build_tables(pathnode_t *node, ejson_arena *arena)
+{
+    if (node->count == 0)
+        return true;
+
+    size_t num = ejson_keyindex_slots(node->count);
+    node->table   = ejson_arena_alloc(arena, num * sizeof(pathnode_t*), alignof(pathnode_t*));
+    node->byindex = ejson_arena_alloc(arena, node->count * sizeof(pathnode_t*), alignof(pathnode_t*));
+    if (node->table == NULL || node->byindex == NULL)
+        return false;
+    memset(node->table, 0, num * sizeof(pathnode_t*));
+    node->mask = num-1;
+
+    for (pathnode_t *next = node->first; next; next = next->next) {
+        size_t i = ejson_keyindex_hash(next->key, false) & node->mask;
+        while (node->table[i])
+            i = (i + 1) & node->mask;
+        node->table[i] = next;
+
+        if (next->index != NONE)
+            node->byindex[node->numindex++] = next;
+
+        if (!build_tables(next, arena))
+            return false;
+    }
+    qsort(node->byindex, node->numindex, sizeof(pathnode_t*), compare_index);
+    return true;
+}
+
+ejson_pathset *ejson_pathset_compile(const char *const *paths, size_t count,
+                                     ejson_error *error, ejson_arena *arena)
+{
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    ejson_pathset *set = ejson_arena_alloc(arena, sizeof(ejson_pathset), alignof(ejson_pathset));
+    size_t *alias = ejson_arena_alloc(arena, (count + 1) * sizeof(size_t), alignof(size_t));
+    pathnode_t *root = new_node(arena);
+    if (set == NULL || alias == NULL || root == NULL)
+        goto oom;
+
+    for (size_t i = 0; i < count; i++) {
+        const char *ptr = paths[i];
+        size_t len = strlen(ptr);
+        if (len > 0 && ptr[0] != '/') {
+            report(error, "Path %zu isn't a JSON pointer", i);
+            ejson_arena_restore(arena, save);
+            return NULL;
+        }
+
+        pathnode_t *node = root;
+        ejson_string tok;
+        size_t cur = 0;
+        while (ejson_pointer_next(ptr, len, &cur, &tok)) {
+            char *key = ejson_arena_alloc(arena, tok.size + 1, 1);
+            if (key == NULL)
+                goto oom;
+            size_t size = ejson_pointer_decode(tok, key);
+            if (size == NONE) {
+                report(error, "Invalid escape in path %zu", i);
+                ejson_arena_restore(arena, save);
+                return NULL;
+            }
+            node = add_token(node, (ejson_string) {.base=key, .size=size}, arena);
+            if (node == NULL)
+                goto oom;
+        }
+
+        if (node->slot == NONE)
+            node->slot = i;
+        alias[i] = node->slot;
+    }
+
+    if (!build_tables(root, arena))
+        goto oom;
+
+    set->root  = root;
+    set->paths = count;
+    set->alias = alias;
+    return set;
+
+oom:
+    report(error, "Out of memory");
+    ejson_arena_restore(arena, save);
+    return NULL;
+}
+
+// Node after "node" for the key, which is still escaped if "escaped"
+static pathnode_t *find_key(const pathnode_t *node, ejson_string key, bool escaped)
+{
+    size_t i = ejson_keyindex_hash(key, escaped) & node->mask;
+    while (node->table[i]) {
+        if (ejson_strings_equal(key, escaped, node->table[i]->key, false))
+            return node->table[i];
+        i = (i + 1) & node->mask;
+    }
+    return NULL;
+}
+
+static void exec_node(const pathnode_t *node, ejson_value *val, ejson_value **out);
+
+static void exec_obj(const pathnode_t *node, ejson_value *val, ejson_value **out)
+{
+    // Indexed objects are faster to look up
+    if (val->when_array.index) {
+        for (pathnode_t *next = node->first; next; next = next->next) {
+            ejson_value *child = ejson_seekbykey2(val, next->key.base, next->key.size);
+            if (child)
+                exec_node(next, child, out);
+        }
+        return;
+    }
+
+    // Only the first child with a given key counts,
+    // like for ejson_seekbykey.
+    bool seen[node->count + 1];
+    memset(seen, 0, sizeof(seen));
+    size_t left = node->count;
+
+    for (ejson_value *child = val->when_array.head; child && left > 0; child = child->next) {
+        pathnode_t *next = find_key(node, child->key, child->flags & EJSON_FLAG_ESCAPED_KEY);
+        if (next && !seen[next->order]) {
+            seen[next->order] = true;
+            left--;
+            exec_node(next, child, out);
+        }
+    }
+}
+
+static void exec_arr(const pathnode_t *node, ejson_value *val, ejson_value **out)
+{
+    if (val->flags & EJSON_FLAG_CONTIGUOUS) {
+        for (size_t k = 0; k < node->numindex; k++) {
+            size_t index = node->byindex[k]->index;
+            if (index >= val->when_array.size)
+                break;
+            exec_node(node->byindex[k], val->when_array.head + index, out);
+        }
+        return;
+    }
+
+    size_t k = 0;
+    size_t index = 0;
+    for (ejson_value *child = val->when_array.head; child && k < node->numindex; child = child->next) {
+        if (node->byindex[k]->index == index)
+            exec_node(node->byindex[k++], child, out);
+        index++;
+    }
+}
+
+static void exec_node(const pathnode_t *node, ejson_value *val, ejson_value **out)
+{
+    if (node->slot != NONE)
+        out[node->slot] = val;
+
+    if (node->count == 0)
+        return;
+
+    if (val->type == EJSON_OBJECT)
+        exec_obj(node, val, out);
+    else if (val->type == EJSON_ARRAY)
+        exec_arr(node, val, out);
+}
+
+static void fill_aliases(const ejson_pathset *set, ejson_value **out)
+{
+    for (size_t i = 0; i < set->paths; i++)
+        out[i] = out[set->alias[i]];
+}
+
+void ejson_pathset_exec(const ejson_pathset *set, ejson_value *root, ejson_value **out)
+{
+    for (size_t i = 0; i < set->paths; i++)
+        out[i] = NULL;
+    exec_node(set->root, root, out);
+    fill_aliases(set, out);
+}
+
+// Walks the source like ejson_parse_and_unpack does, building only
+// the values the paths lead to.
+
+typedef struct {
+    ejson_walker walker;
+    ejson_arena *arena;
+    ejson_value **out;
+} context_t;
+
+// Nodes after the one of the array or object being walked
+typedef struct {
+    const pathnode_t *node;
+    size_t            k;    // Next node by index
+    bool             *seen; // Nodes by key already found
+    size_t            left; // and how many aren't
+} nodes_t;
+
+static const void *array_node(void *state, size_t index, ejson_string key, bool escaped)
+{
+    (void) key;
+    (void) escaped;
+    nodes_t *nodes = state;
+    const pathnode_t *node = nodes->node;
+    if (nodes->k < node->numindex && node->byindex[nodes->k]->index == index)
+        return node->byindex[nodes->k++];
+    return NULL;
+}
+
+// Elements after the last index aren't needed
+static bool array_done(void *state)
+{
+    nodes_t *nodes = state;
+    return nodes->k == nodes->node->numindex;
+}
+
+static const void *object_node(void *state, size_t index, ejson_string key, bool escaped)
+{
+    (void) index;
+    nodes_t *nodes = state;
+    pathnode_t *next = find_key(nodes->node, key, escaped);
+    if (next == NULL || nodes->seen[next->order])
+        return NULL;
+    nodes->seen[next->order] = true;
+    nodes->left--;
+    return next;
+}
+
+static bool object_done(void *state)
+{
+    nodes_t *nodes = state;
+    return nodes->left == 0;
+}
+
+static const ejson_walk_children array_nodes  = {array_node,  array_done};
+static const ejson_walk_children object_nodes = {object_node, object_done};
+
+static bool walk(ejson_walker *w, const void *ptr)
+{
+    context_t *ctx = w->userp;
+    const pathnode_t *node = ptr;
+
+    // The root of an empty set leads nowhere
+    if (node->slot == NONE && node->count == 0)
+        return ejson_walk_skip(w);
+
+    // Values paths end at are built whole, and the
+    // paths going further are followed in the tree.
+    if (node->slot != NONE) {
+        size_t end;
+        ejson_value *val = ejson_parse2(w->src + w->cur, w->len - w->cur,
+                                        &end, w->error, ctx->arena, w->config);
+        if (val == NULL)
+            return false;
+        w->cur += end;
+        exec_node(node, val, ctx->out);
+        return true;
+    }
+
+    char c = w->src[w->cur];
+    if (c == '[') {
+        nodes_t nodes = {.node=node};
+        return ejson_walk_array(w, &array_nodes, &nodes);
+    }
+    if (c == '{') {
+        bool seen[node->count + 1];
+        memset(seen, 0, sizeof(seen));
+        nodes_t nodes = {.node=node, .seen=seen, .left=node->count};
+        return ejson_walk_object(w, &object_nodes, &nodes);
+    }
+    return ejson_walk_skip(w);
+}
+
+bool ejson_parse_paths(const char *src, size_t len, size_t *end,
+                       ejson_error *error, ejson_arena *arena,
+                       ejson_config config, const ejson_pathset *set,
+                       ejson_value **out)
+{
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    context_t ctx = {
+        .walker = {
+            .error = error,
+            .src = src,
+            .cur = 0,
+            .len = len,
+            .config = config,
+            .value = walk,
+        },
+        .arena = arena,
+        .out = out,
+    };
+    ctx.walker.userp = &ctx;
+
+    for (size_t i = 0; i < set->paths; i++)
+        out[i] = NULL;
+
+    if (!ejson_walk_value(&ctx.walker, set->root)) {
+        ejson_arena_restore(arena, save);
+        return false;
+    }
+    fill_aliases(set, out);
+
+    if (end)
+        *end = ctx.walker.cur;
+    return true;
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdalign.h>
+#include "ejson.h"
+#include "arena.h"
+#include "pattern.h"
+
+// The format is compiled twice. The first time "code" is NULL and
+// instructions are only counted, so that the program can be
+// allocated in one block before the second.
+typedef struct {
+    ejson_error *error;
+    ejson_arena *arena;
+    const char  *fmt;
+    size_t cur, len;
+    instr_t *code;
+    size_t   length;
+    size_t   outputs;
+} compiler_t;
+
+static bool is_space(char c)
+{
+    return c == ' '  || c == '\t'
+        || c == '\r' || c == '\n';
+}
+
+static bool is_printable(char c)
+{
+    return c >= 32 && c < 127;
+}
+
+static void report(ejson_error *error, const char *fmt, ...)
+{
+    if (!error)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error->msg, sizeof(error->msg), fmt, args);
+    va_end(args);
+}
+
+static void report_unexpected(compiler_t *c, const char *what)
+{
+    if (c->cur == c->len)
+        report(c->error, "Pattern ended %s", what);
+    else if (is_printable(c->fmt[c->cur]))
+        report(c->error, "Unexpected character '%c' %s", c->fmt[c->cur], what);
+    else
+        report(c->error, "Invalid byte %x %s", c->fmt[c->cur], what);
+}
+
+static void consume_spaces(compiler_t *c)
+{
+    while (c->cur < c->len && is_space(c->fmt[c->cur]))
+        c->cur++;
+}
+
+static bool follows(compiler_t *c, char ch)
+{
+    return c->cur < c->len && c->fmt[c->cur] == ch;
+}
+
+// Decodes the JSON value at the cursor, single quoted strings
+// included. It's only measured while counting.
+static ejson_value *compile_literal(compiler_t *c)
+{
+    ejson_config config = EJSON_DEFAULT_CONFIGS;
+    config.allow_single_quoted_strings = true;
+
+    const char *src = c->fmt + c->cur;
+    size_t      len = c->len - c->cur;
+
+    static ejson_value counted;
+    ejson_value *val = &counted;
+
+    size_t end;
+    if (c->code == NULL) {
+        if (!ejson_measure(src, len, &end, c->error, config, NULL, NULL))
+            return NULL;
+    } else {
+        val = ejson_parse2(src, len, &end, c->error, c->arena, config);
+        if (val == NULL)
+            return NULL;
+        // Keys are compared decoded
+        if (!ejson_unescape(val, c->arena)) {
+            report(c->error, "Out of arena");
+            return NULL;
+        }
+    }
+    c->cur += end;
+    return val;
+}
+
+static bool compile_any(compiler_t *c, ejson_string key);
+
+static bool compile_arr(compiler_t *c, instr_t *ins)
+{
+    c->cur++; // Consume the "["
+
+    consume_spaces(c);
+    if (follows(c, ']')) {
+        c->cur++;
+        return true;
+    }
+
+    for (;;) {
+        if (!compile_any(c, (ejson_string) {.base=NULL, .size=0}))
+            return false;
+        ins->count++;
+
+        consume_spaces(c);
+        if (follows(c, ']'))
+            break;
+        if (!follows(c, ',')) {
+            report_unexpected(c, "after an array item");
+            return false;
+        }
+        c->cur++; // Consume the ","
+    }
+    c->cur++; // Consume the "]"
+    return true;
+}
+
+static bool compile_obj(compiler_t *c, instr_t *ins)
+{
+    c->cur++; // Consume the "{"
+
+    consume_spaces(c);
+    if (follows(c, '}')) {
+        c->cur++;
+        return true;
+    }
+
+    for (;;) {
+        consume_spaces(c);
+        if (!follows(c, '"') && !follows(c, '\'')) {
+            report_unexpected(c, "instead of a key");
+            return false;
+        }
+        ejson_value *key = compile_literal(c);
+        if (key == NULL)
+            return false;
+
+        consume_spaces(c);
+        if (!follows(c, ':')) {
+            report_unexpected(c, "after a key");
+            return false;
+        }
+        c->cur++; // Consume the ":"
+
+        if (!compile_any(c, key->when_string))
+            return false;
+        ins->count++;
+
+        consume_spaces(c);
+        if (follows(c, '}'))
+            break;
+        if (!follows(c, ',')) {
+            report_unexpected(c, "after an object item");
+            return false;
+        }
+        c->cur++; // Consume the ","
+    }
+    c->cur++; // Consume the "}"
+    return true;
+}
+
+static bool compile_any(compiler_t *c, ejson_string key)
+{
+    consume_spaces(c);
+    if (c->cur == c->len) {
+        report(c->error, "Missing pattern");
+        return false;
+    }
+
+    instr_t counted;
+    instr_t *ins = c->code ? &c->code[c->length] : &counted;
+    size_t first = c->length++;
+
+    ins->op = OP_ANY;
+    ins->count = 0;
+    ins->key = key;
+    ins->literal = NULL;
+
+    bool ok = true;
+    switch (c->fmt[c->cur]) {
+
+        case '?':
+        c->cur++;
+        break;
+
+        case '$':
+        c->cur++;
+        if (c->cur == c->len) {
+            report(c->error, "Missing type after '$'");
+            return false;
+        }
+        switch (c->fmt[c->cur]) {
+            case 'a': ins->type = EJSON_ARRAY;   break;
+            case 'o': ins->type = EJSON_OBJECT;  break;
+            case 's': ins->type = EJSON_STRING;  break;
+            case 'n': ins->type = EJSON_NUMBER;  break;
+            case 'b': ins->type = EJSON_BOOLEAN; break;
+            default:
+            report_unexpected(c, "after '$'");
+            return false;
+        }
+        c->cur++;
+        ins->op = OP_UNPACK;
+        ins->slot = c->outputs++;
+        break;
+
+        case '[':
+        ins->op = OP_ARRAY;
+        ok = compile_arr(c, ins);
+        break;
+
+        case '{':
+        ins->op = OP_OBJECT;
+        ok = compile_obj(c, ins);
+        break;
+
+        default:
+        ins->op = OP_LITERAL;
+        ins->literal = compile_literal(c);
+        ok = (ins->literal != NULL);
+        break;
+    }
+
+    ins->length = c->length - first;
+    return ok;
+}
+
+static bool compile(compiler_t *c)
+{
+    c->cur = 0;
+    c->length = 0;
+    c->outputs = 0;
+
+    if (!compile_any(c, (ejson_string) {.base=NULL, .size=0}))
+        return false;
+
+    consume_spaces(c);
+    if (c->cur < c->len) {
+        report_unexpected(c, "after the pattern");
+        return false;
+    }
+    return true;
+}
+
+ejson_pattern *ejson_pattern_compile(const char *fmt, ejson_error *error, ejson_arena *arena)
+{
+    ejson_arena_mark save = ejson_arena_save(arena);
+
+    // The pattern is copied so that keys and
+    // literals don't refer to the caller's string.
+    size_t len = strlen(fmt);
+    char *copy = ejson_arena_alloc(arena, len+1, 1);
+    ejson_pattern *pattern = ejson_arena_alloc(arena, sizeof(ejson_pattern), alignof(ejson_pattern));
+    if (copy == NULL || pattern == NULL) {
+        report(error, "Out of arena");
+        ejson_arena_restore(arena, save);
+        return NULL;
+    }
+    memcpy(copy, fmt, len+1);
+
+    compiler_t c = {
+        .error=error,
+        .arena=arena,
+        .fmt=copy,
+        .len=len,
+        .code=NULL,
+    };
+    if (!compile(&c)) {
+        ejson_arena_restore(arena, save);
+        return NULL;
+    }
+
+    c.code = ejson_arena_alloc(arena, c.length * sizeof(instr_t), alignof(instr_t));
+    if (c.code == NULL) {
+        report(error, "Out of arena");
+        ejson_arena_restore(arena, save);
+        return NULL;
+    }
+    if (!compile(&c)) {
+        ejson_arena_restore(arena, save);
+        return NULL;
+    }
+
+    pattern->code = c.code;
+    pattern->length = c.length;
+    pattern->outputs = c.outputs;
+    return pattern;
+}
+
+size_t ejson_pattern_outputs(const ejson_pattern *pattern)
+{
+    return pattern->outputs;
+}
+
+static ejson_matchresult exec(const instr_t *ins, ejson_value *val, ejson_value **out)
+{
+    switch (ins->op) {
+
+        case OP_ANY:
+        return EJSON_MATCH;
+
+        case OP_UNPACK:
+        if (val->type != ins->type)
+            return EJSON_NOMATCH;
+        out[ins->slot] = val;
+        return EJSON_MATCH;
+
+        case OP_LITERAL:
+        return ejson_valcmp(val, ins->literal) ? EJSON_MATCH : EJSON_NOMATCH;
+
+        case OP_ARRAY:
+        {
+            if (val->type != EJSON_ARRAY)
+                return EJSON_NOMATCH;
+
+            // Elements after the last item are ignored
+            const instr_t *item = ins + 1;
+            ejson_value *child = val->when_array.head;
+            for (size_t i = 0; i < ins->count; i++) {
+                if (child == NULL || exec(item, child, out))
+                    return EJSON_NOMATCH;
+                item += item->length;
+                child = child->next;
+            }
+            return EJSON_MATCH;
+        }
+
+        case OP_OBJECT:
+        {
+            if (val->type != EJSON_OBJECT)
+                return EJSON_NOMATCH;
+
+            // Keys not in the pattern are ignored
+            const instr_t *item = ins + 1;
+            for (size_t i = 0; i < ins->count; i++) {
+                ejson_value *child = ejson_seekbykey2(val, item->key.base, item->key.size);
+                if (child == NULL || exec(item, child, out))
+                    return EJSON_NOMATCH;
+                item += item->length;
+            }
+            return EJSON_MATCH;
+        }
+    }
+    return EJSON_NOMATCH;
+}
+
+ejson_matchresult ejson_pattern_exec(const ejson_pattern *pattern, ejson_value *val, ejson_value **out)
+{
+    return exec(pattern->code, val, out);
+}
@@ -0,0 +1,35 @@
+#ifndef EJSON_PATTERN_H
+#define EJSON_PATTERN_H
+
+#include "ejson.h"
+
+// A pattern is compiled into a program with one instruction per
+// "?", "$", literal, array or object of the format, stored in the
+// order they appear. The items of an array or object follow their
+// instruction, each one taking "length" instructions.
+
+enum {
+    OP_ANY,
+    OP_UNPACK,
+    OP_LITERAL,
+    OP_ARRAY,
+    OP_OBJECT,
+};
+
+typedef struct {
+    int          op;
+    ejson_type   type;    // OP_UNPACK
+    size_t       slot;    // OP_UNPACK, index in "out"
+    size_t       count;   // OP_ARRAY and OP_OBJECT, number of items
+    size_t       length;  // Instructions of the subtree, this one included
+    ejson_string key;     // Items of an OP_OBJECT
+    ejson_value *literal; // OP_LITERAL
+} instr_t;
+
+struct ejson_pattern {
+    instr_t *code;
+    size_t   length;
+    size_t   outputs;
+};
+
+#endif
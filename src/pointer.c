@@ -0,0 +1,89 @@
+#include <string.h>
+#include "pointer.h"
+
+bool ejson_pointer_next(const char *ptr, size_t len, size_t *cur, ejson_string *tok)
+{
+    if (*cur == len)
+        return false;
+
+    size_t start = *cur + 1;
+    const char *slash = memchr(ptr + start, '/', len - start);
+    size_t end = slash ? (size_t) (slash - ptr) : len;
+
+    tok->base = ptr + start;
+    tok->size = end - start;
+    *cur = end;
+    return true;
+}
+
+size_t ejson_pointer_decode(ejson_string tok, char *dst)
+{
+    size_t num = 0;
+    for (size_t i = 0; i < tok.size; i++) {
+        char c = tok.base[i];
+        if (c == '~') {
+            if (i+1 == tok.size)
+                return SIZE_MAX;
+            switch (tok.base[++i]) {
+                case '0': c = '~'; break;
+                case '1': c = '/'; break;
+                default: return SIZE_MAX;
+            }
+        }
+        dst[num++] = c;
+    }
+    return num;
+}
+
+bool ejson_pointer_index(ejson_string tok, size_t *index)
+{
+    if (tok.size == 0 || (tok.size > 1 && tok.base[0] == '0'))
+        return false;
+
+    size_t num = 0;
+    for (size_t i = 0; i < tok.size; i++) {
+        char c = tok.base[i];
+        if (c < '0' || c > '9')
+            return false;
+        if (num > (SIZE_MAX - (c - '0')) / 10)
+            return false;
+        num = num * 10 + (c - '0');
+    }
+    *index = num;
+    return true;
+}
+
+ejson_value *ejson_pointer_child(ejson_value *val, ejson_string tok)
+{
+    if (val->type == EJSON_ARRAY) {
+        size_t index;
+        if (!ejson_pointer_index(tok, &index))
+            return NULL;
+        return ejson_seekbyindex(val, index);
+    }
+
+    if (val->type != EJSON_OBJECT)
+        return NULL;
+
+    if (memchr(tok.base, '~', tok.size) == NULL)
+        return ejson_seekbykey2(val, tok.base, tok.size);
+
+    char key[tok.size];
+    size_t size = ejson_pointer_decode(tok, key);
+    if (size == SIZE_MAX)
+        return NULL;
+    return ejson_seekbykey2(val, key, size);
+}
+
+ejson_value *ejson_seekbypointer(ejson_value *root, const char *ptr, size_t len)
+{
+    if (len > 0 && ptr[0] != '/')
+        return NULL;
+
+    ejson_value *val = root;
+    ejson_string tok;
+    size_t cur = 0;
+    while (val && ejson_pointer_next(ptr, len, &cur, &tok))
+        val = ejson_pointer_child(val, tok);
+    return val;
+}
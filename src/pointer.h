@@ -0,0 +1,25 @@
+#ifndef EJSON_POINTER_H
+#define EJSON_POINTER_H
+
+#include "ejson.h"
+
+// Splits the next reference token off a JSON Pointer (RFC 6901).
+// "*cur" is on the '/' that starts it and is moved to the next one,
+// or to the end. Returns false when there are no tokens left. The
+// token is as it appears in the pointer, with "~0" and "~1" still
+// to be decoded.
+bool ejson_pointer_next(const char *ptr, size_t len, size_t *cur, ejson_string *tok);
+
+// Decodes the token into "dst", which needs room for "tok.size"
+// bytes, and returns the decoded length, or SIZE_MAX when a '~'
+// isn't followed by '0' or '1'.
+size_t ejson_pointer_decode(ejson_string tok, char *dst);
+
+// Parses a token referring to an array element, which is a
+// decimal number without sign or leading zeros.
+bool ejson_pointer_index(ejson_string tok, size_t *index);
+
+// Child of the array or object the token refers to, or NULL
+ejson_value *ejson_pointer_child(ejson_value *val, ejson_string tok);
+
+#endif
@@ -1,33 +1,252 @@
-#include <stdio.h>
-#include <assert.h>
+#include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include "ejson.h"
+#include "scan.h"
+#include "number.h"
 
 #define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
 
+// Size of the buffer ejson_write stages output in
+#define STAGE_SIZE 4096
+
+// Output goes into "dst" until it's full. Then it's handed to the
+// writer and the buffer starts over, or, without a writer, the rest
+// is only counted.
 typedef struct {
     char *dst;
     size_t num, max;
+    size_t total;
+
+    ejson_writer writer;
+    void        *userp;
+    bool         failed;
+
+    ejson_writeopts opts;
+    int             depth;
 } print_context_t;
 
+static void flush(print_context_t *ctx)
+{
+    if (ctx->writer && !ctx->failed && ctx->num > 0) {
+        if (!ctx->writer(ctx->userp, ctx->dst, ctx->num))
+            ctx->failed = true;
+        ctx->num = 0;
+    }
+}
+
 static void append(print_context_t *ctx, const char *str, size_t len)
 {
-    if (ctx->num < ctx->max) {
+    ctx->total += len;
+    if (len <= ctx->max - ctx->num) {
+        memcpy(ctx->dst + ctx->num, str, len);
+        ctx->num += len;
+        return;
+    }
+    while (len > 0) {
+        if (ctx->num == ctx->max) {
+            if (ctx->writer == NULL || ctx->failed)
+                return;
+            flush(ctx);
+        }
         size_t cpy = MIN(len, ctx->max - ctx->num);
         memcpy(ctx->dst + ctx->num, str, cpy);
+        ctx->num += cpy;
+        str += cpy;
+        len -= cpy;
+    }
+}
+
+// Same as append, but with a writer, slices larger than the
+// stage are passed to it directly instead of being copied.
+static void append_large(print_context_t *ctx, const char *str, size_t len)
+{
+    if (ctx->writer == NULL || len < ctx->max) {
+        append(ctx, str, len);
+        return;
+    }
+    flush(ctx);
+    ctx->total += len;
+    if (!ctx->failed && !ctx->writer(ctx->userp, str, len))
+        ctx->failed = true;
+}
+
+static void append_escape(print_context_t *ctx, char c)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    char buf[6];
+    size_t num = 2;
+    buf[0] = '\\';
+    switch (c) {
+        case '"':  buf[1] = '"';  break;
+        case '\\': buf[1] = '\\'; break;
+        case '\b': buf[1] = 'b';  break;
+        case '\f': buf[1] = 'f';  break;
+        case '\n': buf[1] = 'n';  break;
+        case '\r': buf[1] = 'r';  break;
+        case '\t': buf[1] = 't';  break;
+        default:
+        buf[1] = 'u';
+        buf[2] = '0';
+        buf[3] = '0';
+        buf[4] = hex[(c >> 4) & 0xF];
+        buf[5] = hex[c & 0xF];
+        num = 6;
+        break;
     }
-    ctx->num += len;
+    append(ctx, buf, num);
 }
 
-static void print_str(print_context_t *ctx, ejson_string str)
+// Writes a string between double quotes. Runs of bytes that need no
+// escaping are found by the scanning kernels and copied at once.
+// Strings flagged as escaped are as they were in the source, so
+// their escape sequences are kept, except for "\'" which JSON lacks.
+static void print_str(print_context_t *ctx, ejson_string str, bool escaped)
 {
     append(ctx, "\"", 1);
-    append(ctx, str.base, str.size);
+    size_t cur = 0;
+    while (cur < str.size) {
+        size_t end;
+        if (ctx->max - ctx->num >= str.size - cur) {
+            // Scanning and copying in one pass
+            end = ejson_copy_plain(ctx->dst + ctx->num, str.base, cur, str.size);
+            ctx->num   += end - cur;
+            ctx->total += end - cur;
+        } else {
+            end = ejson_scan_escapable(str.base, cur, str.size);
+            append(ctx, str.base + cur, end - cur);
+        }
+        if (end == str.size)
+            break;
+        char c = str.base[end];
+        cur = end + 1;
+
+        if (c == '\\' && escaped) {
+            char next = str.base[cur++];
+            if (next == '\'')
+                append(ctx, "'", 1);
+            else {
+                append(ctx, "\\", 1);
+                append(ctx, &next, 1);
+            }
+            continue;
+        }
+        append_escape(ctx, c);
+    }
     append(ctx, "\"", 1);
 }
 
+// Goes to a new line at the current depth when indenting
+static void newline(print_context_t *ctx)
+{
+    if (ctx->opts.indent <= 0)
+        return;
+    append(ctx, "\n", 1);
+    for (int i = 0; i < ctx->depth * ctx->opts.indent; i++)
+        append(ctx, " ", 1);
+}
+
+// Writes a "," or ":" followed by a space, unless the output is
+// compact or a "," is followed by a new line anyway.
+static void separator(print_context_t *ctx, char c)
+{
+    append(ctx, &c, 1);
+    if (!ctx->opts.compact && (c == ':' || ctx->opts.indent <= 0))
+        append(ctx, " ", 1);
+}
+
+// Whether the value is written by copying its source
+static bool is_verbatim(print_context_t *ctx, ejson_value *val)
+{
+    return ctx->opts.verbatim && val->src.base && !(val->flags & EJSON_FLAG_DIRTY);
+}
+
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Whether the source of the parent goes on from "end", where the
+// source of a child stops, to the next child with only blanks, a
+// comma and the key of the next child in between. The two children
+// can then be copied at once.
+static bool copied_together(ejson_value *parent, const char *end, ejson_value *next)
+{
+    const char *lo = parent->src.base;
+    const char *hi = lo + parent->src.size;
+    const char *cur = end;
+    const char *stop = next->src.base;
+    if (lo == NULL || cur < lo || stop < cur || stop + next->src.size > hi)
+        return false;
+
+    while (cur < stop && is_blank(*cur))
+        cur++;
+    if (cur == stop || *cur++ != ',')
+        return false;
+    while (cur < stop && is_blank(*cur))
+        cur++;
+
+    if (parent->type == EJSON_OBJECT) {
+        // The key must be the one in the source
+        if (next->key.base != cur + 1 || stop - cur < (ptrdiff_t) next->key.size + 2)
+            return false;
+        cur += next->key.size + 2;
+        while (cur < stop && is_blank(*cur))
+            cur++;
+        if (cur == stop || *cur++ != ':')
+            return false;
+        while (cur < stop && is_blank(*cur))
+            cur++;
+    }
+    return cur == stop;
+}
+
+static void print_any(print_context_t *ctx, ejson_value *val);
+
+// Writes the children of an array or object. Runs of children that
+// are copied from the source and were next to each other in it are
+// written with one copy, keys and separators included.
+static void print_children(print_context_t *ctx, ejson_value *val)
+{
+    const char *run = NULL;
+    const char *end = NULL;
+    for (ejson_iter iter = ejson_iterover(val); ejson_next(&iter); ) {
+        ejson_value *child = iter.val;
+        bool verbatim = is_verbatim(ctx, child);
+        if (run && verbatim && copied_together(val, end, child)) {
+            end = child->src.base + child->src.size;
+            continue;
+        }
+        if (run) {
+            append_large(ctx, run, end - run);
+            run = NULL;
+        }
+
+        if (iter.idx > 0)
+            separator(ctx, ',');
+        newline(ctx);
+        if (val->type == EJSON_OBJECT) {
+            print_str(ctx, iter.key, child->flags & EJSON_FLAG_ESCAPED_KEY);
+            separator(ctx, ':');
+        }
+        if (verbatim) {
+            run = child->src.base;
+            end = run + child->src.size;
+        } else
+            print_any(ctx, child);
+    }
+    if (run)
+        append_large(ctx, run, end - run);
+}
+
 static void print_any(print_context_t *ctx, ejson_value *val)
 {
+    if (is_verbatim(ctx, val)) {
+        append_large(ctx, val->src.base, val->src.size);
+        return;
+    }
+
     switch (val->type) {
         
         case EJSON_NULL: 
@@ -36,45 +255,41 @@ static void print_any(print_context_t *ctx, ejson_value *val)
         
         case EJSON_ARRAY:
         append(ctx, "[", 1);
-        for (ejson_iter iter = ejson_iterover(val); ejson_next(&iter); ) {
-            print_any(ctx, iter.val);
-            if (ejson_hasnext(iter.val))
-                append(ctx, ", ", 2);
-        }
+        ctx->depth++;
+        print_children(ctx, val);
+        ctx->depth--;
+        if (val->when_array.head)
+            newline(ctx);
         append(ctx, "]", 1);
         break;
 
         case EJSON_OBJECT:
         append(ctx, "{", 1);
-        for (ejson_iter iter = ejson_iterover(val); ejson_next(&iter); ) {
-            print_str(ctx, iter.key);
-            append(ctx, ": ", 2);
-            print_any(ctx, iter.val);
-            if (ejson_hasnext(iter.val))
-                append(ctx, ", ", 2);
-        }
+        ctx->depth++;
+        print_children(ctx, val);
+        ctx->depth--;
+        if (val->when_array.head)
+            newline(ctx);
         append(ctx, "}", 1);
         break;
         
         case EJSON_NUMBER:
         {
-            char buff[128];
-            double  flt = val->when_number.as_flt;
-            int64_t itg = val->when_number.as_int;
-            int n;
-            if (flt == itg)
-                n = snprintf(buff, sizeof(buff), "%lld", val->when_number.as_int);
+            char buff[EJSON_NUMBER_MAX];
+            size_t n;
+
+            // Integers are printed from "as_int", which may hold more
+            // digits than the double
+            if (val->when_number.is_int)
+                n = ejson_format_int(val->when_number.as_int, buff);
             else
-                n = snprintf(buff, sizeof(buff), "%lf", val->when_number.as_flt);
-            assert(n > 0);
+                n = ejson_format_double(val->when_number.as_flt, buff);
             append(ctx, buff, n);
         }
         break;
         
         case EJSON_STRING:
-        append(ctx, "\"", 1);
-        append(ctx, val->when_string.base, val->when_string.size); 
-        append(ctx, "\"", 1);
+        print_str(ctx, val->when_string, val->flags & EJSON_FLAG_ESCAPED);
         break;
         
         case EJSON_BOOLEAN:
@@ -92,9 +307,12 @@ size_t ejson_print(ejson_value *val, char *dst, size_t max)
         .dst=dst,
         .max=max,
         .num=0,
+        .total=0,
+        .writer=NULL,
+        .opts=EJSON_DEFAULT_WRITEOPTS,
     };
     print_any(&ctx, val);
-    size_t num = ctx.num;
+    size_t num = ctx.total;
 
     if (num < max)
         dst[num] = '\0';
@@ -102,4 +320,84 @@ size_t ejson_print(ejson_value *val, char *dst, size_t max)
         dst[max-1] = '\0';
     
     return num;
-}
\ No newline at end of file
+}
+
+bool ejson_write(ejson_value *val, ejson_writer writer, void *userp, ejson_writeopts opts)
+{
+    char stage[STAGE_SIZE];
+    print_context_t ctx = {
+        .dst=stage,
+        .max=sizeof(stage),
+        .num=0,
+        .total=0,
+        .writer=writer,
+        .userp=userp,
+        .failed=false,
+        .opts=opts,
+        .depth=0,
+    };
+    print_any(&ctx, val);
+    flush(&ctx);
+    return !ctx.failed;
+}
+
+bool ejson_fdwriter(void *userp, const char *data, size_t len)
+{
+    int fd = *(int*) userp;
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len  -= n;
+    }
+    return true;
+}
+
+bool ejson_bufwriter(void *userp, const char *data, size_t len)
+{
+    ejson_buffer *buf = userp;
+
+    // One more byte is kept for the terminator
+    if (buf->size + len + 1 > buf->capacity) {
+        const ejson_allocator *allocator = buf->allocator;
+        if (allocator == NULL)
+            allocator = &ejson_stdalloc;
+
+        size_t capacity = 2 * buf->capacity;
+        if (capacity < buf->size + len + 1)
+            capacity = buf->size + len + 1;
+        if (capacity < 256)
+            capacity = 256;
+
+        char *data2 = allocator->alloc(allocator->userp, capacity);
+        if (data2 == NULL)
+            return false;
+        if (buf->data) {
+            memcpy(data2, buf->data, buf->size);
+            allocator->free(allocator->userp, buf->data, buf->capacity);
+        }
+        buf->data = data2;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, len);
+    buf->size += len;
+    buf->data[buf->size] = '\0';
+    return true;
+}
+
+void ejson_buffer_free(ejson_buffer *buf)
+{
+    if (buf->data) {
+        const ejson_allocator *allocator = buf->allocator;
+        if (allocator == NULL)
+            allocator = &ejson_stdalloc;
+        allocator->free(allocator->userp, buf->data, buf->capacity);
+    }
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
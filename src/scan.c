@@ -0,0 +1,507 @@
+#include <string.h>
+#include <stdbool.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#else
+#define HAVE_X86 0
+#endif
+
+static ejson_scan_level max_level = EJSON_SCAN_SCALAR;
+static ejson_scan_level cur_level = EJSON_SCAN_SCALAR;
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t'
+        || c == '\r' || c == '\n';
+}
+
+static size_t scan_spaces_scalar(const char *src, size_t cur, size_t len)
+{
+    while (cur < len && is_space(src[cur]))
+        cur++;
+    return cur;
+}
+
+static size_t scan_quote_scalar(const char *src, size_t cur, size_t len, char quote)
+{
+    while (cur < len && src[cur] != quote && src[cur] != '\\')
+        cur++;
+    return cur;
+}
+
+static bool is_escapable(char c)
+{
+    return c == '"' || c == '\\' || (unsigned char) c < 0x20;
+}
+
+static size_t scan_escapable_scalar(const char *src, size_t cur, size_t len)
+{
+    while (cur < len && !is_escapable(src[cur]))
+        cur++;
+    return cur;
+}
+
+static size_t copy_plain_scalar(char *dst, const char *src, size_t cur, size_t len)
+{
+    size_t start = cur;
+    while (cur < len && !is_escapable(src[cur])) {
+        dst[cur - start] = src[cur];
+        cur++;
+    }
+    return cur;
+}
+
+// Bytes of a 64-byte block, one bit each
+typedef struct {
+    uint64_t quotes;   // Double quotes
+    uint64_t escapes;  // Backslashes
+    uint64_t brackets; // Brackets and braces
+    uint64_t others;   // Colons and commas
+} classes_t;
+
+typedef classes_t (*classify_t)(const char *block);
+
+static classes_t classify_scalar(const char *block)
+{
+    classes_t cls = {0};
+    for (int i = 0; i < 64; i++) {
+        char c = block[i];
+        if (c == '"')
+            cls.quotes |= (uint64_t) 1 << i;
+        else if (c == '\\')
+            cls.escapes |= (uint64_t) 1 << i;
+        else if (c == '{' || c == '}' || c == '[' || c == ']')
+            cls.brackets |= (uint64_t) 1 << i;
+        else if (c == ':' || c == ',')
+            cls.others |= (uint64_t) 1 << i;
+    }
+    return cls;
+}
+
+#if HAVE_X86
+
+static classes_t classify_sse2(const char *block)
+{
+    const __m128i dq = _mm_set1_epi8('"');
+    const __m128i bs = _mm_set1_epi8('\\');
+    const __m128i lc = _mm_set1_epi8('{');
+    const __m128i rc = _mm_set1_epi8('}');
+    const __m128i ls = _mm_set1_epi8('[');
+    const __m128i rs = _mm_set1_epi8(']');
+    const __m128i co = _mm_set1_epi8(':');
+    const __m128i cm = _mm_set1_epi8(',');
+
+    classes_t cls = {0};
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (block + 16 * i));
+        __m128i b = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, lc), _mm_cmpeq_epi8(v, rc)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, ls), _mm_cmpeq_epi8(v, rs)));
+        __m128i o = _mm_or_si128(_mm_cmpeq_epi8(v, co), _mm_cmpeq_epi8(v, cm));
+        cls.quotes   |= (uint64_t) (_mm_movemask_epi8(_mm_cmpeq_epi8(v, dq)) & 0xFFFF) << (16 * i);
+        cls.escapes  |= (uint64_t) (_mm_movemask_epi8(_mm_cmpeq_epi8(v, bs)) & 0xFFFF) << (16 * i);
+        cls.brackets |= (uint64_t) (_mm_movemask_epi8(b) & 0xFFFF) << (16 * i);
+        cls.others   |= (uint64_t) (_mm_movemask_epi8(o) & 0xFFFF) << (16 * i);
+    }
+    return cls;
+}
+
+__attribute__((target("avx2")))
+static classes_t classify_avx2(const char *block)
+{
+    const __m256i dq = _mm256_set1_epi8('"');
+    const __m256i bs = _mm256_set1_epi8('\\');
+    const __m256i lc = _mm256_set1_epi8('{');
+    const __m256i rc = _mm256_set1_epi8('}');
+    const __m256i ls = _mm256_set1_epi8('[');
+    const __m256i rs = _mm256_set1_epi8(']');
+    const __m256i co = _mm256_set1_epi8(':');
+    const __m256i cm = _mm256_set1_epi8(',');
+
+    classes_t cls = {0};
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (block + 32 * i));
+        __m256i b = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, lc), _mm256_cmpeq_epi8(v, rc)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, ls), _mm256_cmpeq_epi8(v, rs)));
+        __m256i o = _mm256_or_si256(_mm256_cmpeq_epi8(v, co), _mm256_cmpeq_epi8(v, cm));
+        cls.quotes   |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dq)) << (32 * i);
+        cls.escapes  |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bs)) << (32 * i);
+        cls.brackets |= (uint64_t) (uint32_t) _mm256_movemask_epi8(b) << (32 * i);
+        cls.others   |= (uint64_t) (uint32_t) _mm256_movemask_epi8(o) << (32 * i);
+    }
+    return cls;
+}
+
+static size_t scan_spaces_sse2(const char *src, size_t cur, size_t len)
+{
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i ht = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    while (cur + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + cur));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, ht)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        unsigned int mask = ~_mm_movemask_epi8(m) & 0xFFFF;
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        cur += 16;
+    }
+    return scan_spaces_scalar(src, cur, len);
+}
+
+static size_t scan_quote_sse2(const char *src, size_t cur, size_t len, char quote)
+{
+    const __m128i q = _mm_set1_epi8(quote);
+    const __m128i bs = _mm_set1_epi8('\\');
+
+    while (cur + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + cur));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs));
+        unsigned int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        cur += 16;
+    }
+    return scan_quote_scalar(src, cur, len, quote);
+}
+
+static size_t scan_escapable_sse2(const char *src, size_t cur, size_t len)
+{
+    const __m128i dq = _mm_set1_epi8('"');
+    const __m128i bs = _mm_set1_epi8('\\');
+    const __m128i ct = _mm_set1_epi8(0x1F);
+
+    while (cur + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + cur));
+        // Control characters are the bytes not above 0x1F, unsigned
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, dq), _mm_cmpeq_epi8(v, bs)),
+            _mm_cmpeq_epi8(_mm_max_epu8(v, ct), ct));
+        unsigned int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        cur += 16;
+    }
+    return scan_escapable_scalar(src, cur, len);
+}
+
+// Vectors are stored whole, also when they contain the byte that
+// stops the copy, which is fine as long as "dst" has room for the
+// rest of the source.
+static size_t copy_plain_sse2(char *dst, const char *src, size_t cur, size_t len)
+{
+    const __m128i dq = _mm_set1_epi8('"');
+    const __m128i bs = _mm_set1_epi8('\\');
+    const __m128i ct = _mm_set1_epi8(0x1F);
+
+    size_t start = cur;
+    while (cur + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + cur));
+        _mm_storeu_si128((__m128i*) (dst + cur - start), v);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, dq), _mm_cmpeq_epi8(v, bs)),
+            _mm_cmpeq_epi8(_mm_max_epu8(v, ct), ct));
+        unsigned int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        cur += 16;
+    }
+    return copy_plain_scalar(dst + cur - start, src, cur, len);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_spaces_avx2(const char *src, size_t cur, size_t len)
+{
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i ht = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    while (cur + 32 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + cur));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, ht)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(m);
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        cur += 32;
+    }
+    return scan_spaces_sse2(src, cur, len);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_quote_avx2(const char *src, size_t cur, size_t len, char quote)
+{
+    const __m256i q = _mm256_set1_epi8(quote);
+    const __m256i bs = _mm256_set1_epi8('\\');
+
+    while (cur + 32 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + cur));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, q), _mm256_cmpeq_epi8(v, bs));
+        unsigned int mask = _mm256_movemask_epi8(m);
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        cur += 32;
+    }
+    return scan_quote_sse2(src, cur, len, quote);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_escapable_avx2(const char *src, size_t cur, size_t len)
+{
+    const __m256i dq = _mm256_set1_epi8('"');
+    const __m256i bs = _mm256_set1_epi8('\\');
+    const __m256i ct = _mm256_set1_epi8(0x1F);
+
+    while (cur + 32 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + cur));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, dq), _mm256_cmpeq_epi8(v, bs)),
+            _mm256_cmpeq_epi8(_mm256_max_epu8(v, ct), ct));
+        unsigned int mask = _mm256_movemask_epi8(m);
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        cur += 32;
+    }
+    return scan_escapable_sse2(src, cur, len);
+}
+
+__attribute__((target("avx2")))
+static size_t copy_plain_avx2(char *dst, const char *src, size_t cur, size_t len)
+{
+    const __m256i dq = _mm256_set1_epi8('"');
+    const __m256i bs = _mm256_set1_epi8('\\');
+    const __m256i ct = _mm256_set1_epi8(0x1F);
+
+    size_t start = cur;
+    if (len - cur < 32)
+        return copy_plain_scalar(dst, src, cur, len);
+
+    bool aligned = false;
+    for (;;) {
+        // The last vector ends with the source, overlapping
+        // the previous one. The bytes before "cur" are copied
+        // again and their bits are ignored.
+        size_t pos = cur;
+        if (pos + 32 > len)
+            pos = len - 32;
+
+        __m256i v = _mm256_loadu_si256((const __m256i*) (src + pos));
+        _mm256_storeu_si256((__m256i*) (dst + pos - start), v);
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, dq), _mm256_cmpeq_epi8(v, bs)),
+            _mm256_cmpeq_epi8(_mm256_max_epu8(v, ct), ct));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(m) >> (cur - pos);
+        if (mask)
+            return cur + __builtin_ctz(mask);
+        if (pos + 32 == len)
+            return len;
+
+        // Stores crossing cache lines are slow, so after the first
+        // one the following are aligned, overlapping it a bit.
+        if (!aligned) {
+            cur += 32 - ((uintptr_t) dst & 31);
+            aligned = true;
+        } else
+            cur += 32;
+    }
+}
+
+#endif
+
+__attribute__((constructor))
+static void detect_level(void)
+{
+#if HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        max_level = EJSON_SCAN_AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        max_level = EJSON_SCAN_SSE2;
+#endif
+    cur_level = max_level;
+}
+
+ejson_scan_level ejson_scan_setlevel(ejson_scan_level level)
+{
+    if (level > max_level)
+        level = max_level;
+    cur_level = level;
+    return level;
+}
+
+// Bit N of the result is the parity of bits 0 to N of "x"
+static uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Bits of the bytes escaped by a backslash, following the method of
+// simdjson: runs of backslashes starting on an odd bit are told from
+// those starting on an even one with a carrying addition. "carry" is
+// set when the previous block ended with an unpaired backslash.
+static uint64_t find_escaped(uint64_t escapes, uint64_t *carry)
+{
+    const uint64_t even = 0x5555555555555555ULL;
+
+    escapes &= ~*carry;
+    uint64_t follows = (escapes << 1) | *carry;
+    uint64_t odd_starts = escapes & ~even & ~follows;
+
+    uint64_t even_runs;
+    *carry = __builtin_add_overflow(odd_starts, escapes, &even_runs);
+    return (even ^ (even_runs << 1)) & follows;
+}
+
+static classify_t pick_classify(void)
+{
+    switch (cur_level) {
+#if HAVE_X86
+        case EJSON_SCAN_AVX2: return classify_avx2;
+        case EJSON_SCAN_SSE2: return classify_sse2;
+#endif
+        default: break;
+    }
+    return classify_scalar;
+}
+
+// Classifies the 64 bytes at "src + cur", padding
+// with spaces the ones past the end of the source.
+static classes_t classify_at(classify_t classify, const char *src,
+                             size_t cur, size_t len)
+{
+    if (len - cur >= 64)
+        return classify(src + cur);
+
+    char tail[64];
+    memset(tail, ' ', sizeof(tail));
+    memcpy(tail, src + cur, len - cur);
+    return classify(tail);
+}
+
+void ejson_scan_structurals(const char *src, size_t len, uint64_t *bits)
+{
+    classify_t classify = pick_classify();
+
+    // All ones when the previous block ended inside a string
+    uint64_t carry = 0;
+    uint64_t escape_carry = 0;
+
+    for (size_t i = 0; i < len; i += 64) {
+
+        classes_t cls = classify_at(classify, src, i, len);
+        uint64_t quotes = cls.quotes & ~find_escaped(cls.escapes, &escape_carry);
+
+        // Bytes between an opening quote and the
+        // closing one, the opening one included.
+        uint64_t in_string = prefix_xor(quotes) ^ carry;
+        carry = (uint64_t) ((int64_t) in_string >> 63);
+
+        bits[i / 64] = ((cls.brackets | cls.others) & ~in_string) | quotes;
+    }
+}
+
+size_t ejson_scan_skip(const char *src, size_t cur, size_t len)
+{
+    classify_t classify = pick_classify();
+
+    size_t depth = 1;
+    uint64_t carry = 0;
+    uint64_t escape_carry = 0;
+
+    for (size_t i = cur; i < len; i += 64) {
+
+        classes_t cls = classify_at(classify, src, i, len);
+        uint64_t quotes = cls.quotes & ~find_escaped(cls.escapes, &escape_carry);
+
+        uint64_t in_string = prefix_xor(quotes) ^ carry;
+        carry = (uint64_t) ((int64_t) in_string >> 63);
+
+        uint64_t brackets = cls.brackets & ~in_string;
+        while (brackets) {
+            size_t k = i + __builtin_ctzll(brackets);
+            brackets &= brackets - 1;
+
+            char c = src[k];
+            if (c == '[' || c == '{')
+                depth++;
+            else if (--depth == 0)
+                return k;
+        }
+    }
+    return len;
+}
+
+size_t ejson_scan_spaces(const char *src, size_t cur, size_t len)
+{
+    switch (cur_level) {
+#if HAVE_X86
+        case EJSON_SCAN_AVX2: return scan_spaces_avx2(src, cur, len);
+        case EJSON_SCAN_SSE2: return scan_spaces_sse2(src, cur, len);
+#endif
+        default: break;
+    }
+    return scan_spaces_scalar(src, cur, len);
+}
+
+size_t ejson_scan_quote(const char *src, size_t cur, size_t len, char quote)
+{
+    switch (cur_level) {
+#if HAVE_X86
+        case EJSON_SCAN_AVX2: return scan_quote_avx2(src, cur, len, quote);
+        case EJSON_SCAN_SSE2: return scan_quote_sse2(src, cur, len, quote);
+#endif
+        default: break;
+    }
+    return scan_quote_scalar(src, cur, len, quote);
+}
+
+size_t ejson_scan_escapable(const char *src, size_t cur, size_t len)
+{
+    switch (cur_level) {
+#if HAVE_X86
+        case EJSON_SCAN_AVX2: return scan_escapable_avx2(src, cur, len);
+        case EJSON_SCAN_SSE2: return scan_escapable_sse2(src, cur, len);
+#endif
+        default: break;
+    }
+    return scan_escapable_scalar(src, cur, len);
+}
+
+size_t ejson_copy_plain(char *dst, const char *src, size_t cur, size_t len)
+{
+    switch (cur_level) {
+#if HAVE_X86
+        case EJSON_SCAN_AVX2: return copy_plain_avx2(dst, src, cur, len);
+        case EJSON_SCAN_SSE2: return copy_plain_sse2(dst, src, cur, len);
+#endif
+        default: break;
+    }
+    return copy_plain_scalar(dst, src, cur, len);
+}
+
+size_t ejson_scan_string(const char *src, size_t cur, size_t len, char quote)
+{
+    for (;;) {
+        cur = ejson_scan_quote(src, cur, len, quote);
+        if (cur == len || src[cur] == quote)
+            return cur;
+        cur += 2; // Skip the backslash and the byte after it
+        if (cur > len)
+            return len;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef EJSON_SCAN_H
+#define EJSON_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte scanning kernels used by the parser. Each one has a scalar
+// version and, on x86, SSE2 and AVX2 versions that process 16 or 32
+// bytes at a time. The best version supported by the CPU is picked
+// when the library is loaded.
+
+typedef enum {
+    EJSON_SCAN_SCALAR,
+    EJSON_SCAN_SSE2,
+    EJSON_SCAN_AVX2,
+} ejson_scan_level;
+
+// Returns the index of the first non-whitespace byte
+// at or after "cur", or "len" if there is none.
+size_t ejson_scan_spaces(const char *src, size_t cur, size_t len);
+
+// Returns the index of the first byte equal to "quote" or
+// to a backslash at or after "cur", or "len" if there is none.
+size_t ejson_scan_quote(const char *src, size_t cur, size_t len, char quote);
+
+// Returns the index of the first byte at or after "cur" that can't
+// be written as is in a JSON string, that is a double quote, a
+// backslash or a control character, or "len" if there is none.
+size_t ejson_scan_escapable(const char *src, size_t cur, size_t len);
+
+// Same as ejson_scan_escapable, but also copies the bytes it goes
+// past to "dst", which needs room for "len - cur" bytes.
+size_t ejson_copy_plain(char *dst, const char *src, size_t cur, size_t len);
+
+// Returns the index of the quote closing the string whose contents
+// start at "cur", or "len" if there is none. Escape sequences are
+// skipped without being checked.
+size_t ejson_scan_string(const char *src, size_t cur, size_t len, char quote);
+
+// Marks in "bits" the structural characters of the source, that is
+// the unescaped quotes of strings and the brackets, colons and commas
+// outside of them. Bit N of word W stands for byte 64*W+N, so "bits" needs
+// room for (len+63)/64 words.
+void ejson_scan_structurals(const char *src, size_t len, uint64_t *bits);
+
+// Skips to the end of the array or object whose contents start at
+// "cur", returning the offset of its closing bracket or "len" if
+// there isn't one. Brackets are only counted, not matched, and
+// strings are assumed to be double quoted.
+size_t ejson_scan_skip(const char *src, size_t cur, size_t len);
+
+// Forces the kernels to a given level. Levels not supported
+// by the CPU are lowered to the best supported one. Returns
+// the level actually in use. Only meant for benchmarks.
+ejson_scan_level ejson_scan_setlevel(ejson_scan_level level);
+
+#endif
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ejson.h"
+#include "index.h"
+
+// A snapshot is an image of a tree that can be used in place. It's
+// laid out as:
+//
+//   header | values | key indexes | index slots | string bytes
+//
+// The values are in breadth-first order, so the children of each
+// array and object are contiguous, starting with the root. Every
+// pointer is stored as "base" plus its offset in the image. Loading
+// the image at "base" needs no work at all, while anywhere else the
+// pointers are moved by the difference in one pass over the values
+// and indexes. Images are trusted, only the header is validated.
+
+#define MAGIC "EJSNAP3"
+
+// Address images are written for. It's far from where the
+// system places mappings by default, so ejson_snapshot_open
+// usually gets it.
+#define SNAPSHOT_BASE ((uint64_t) 0x600000000000)
+
+// Size of the buffer the image is staged in
+#define STAGE_SIZE 4096
+
+typedef struct {
+    char     magic[8];
+    uint64_t size;    // Bytes of the image
+    uint64_t base;    // Address the pointers are relative to
+    uint64_t values;  // Number of values
+    uint64_t indexes; // Number of key indexes
+    uint64_t slots;   // Number of slots of all indexes
+    uint64_t strings; // Bytes of strings and keys
+} header_t;
+
+typedef struct {
+    ejson_value *val;
+    size_t       pos;
+} container_t;
+
+typedef struct {
+    ejson_writer writer;
+    void        *userp;
+    bool         failed;
+    char         stage[STAGE_SIZE];
+    size_t       staged;
+
+    const ejson_allocator *allocator;
+
+    // Arrays and objects with children in the order their children
+    // appear in the image, each with its own position
+    container_t *queue;
+    size_t       queued;
+    size_t       capacity;
+
+    header_t head;
+
+    // Where the next children, index, slots and string go. They
+    // are handed out in the same order in every pass.
+    size_t next_block;
+    size_t next_index;
+    size_t next_slot;
+    size_t next_string;
+
+    uint64_t *scratch;
+    size_t    scratch_cap;
+} context_t;
+
+static void report(ejson_error *error, const char *fmt, ...)
+{
+    if (!error)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error->msg, sizeof(error->msg), fmt, args);
+    va_end(args);
+}
+
+static size_t values_offset(void)
+{
+    return sizeof(header_t);
+}
+
+static size_t indexes_offset(header_t *head)
+{
+    return values_offset() + head->values * sizeof(ejson_value);
+}
+
+static size_t slots_offset(header_t *head)
+{
+    return indexes_offset(head) + head->indexes * sizeof(ejson_keyindex);
+}
+
+static size_t strings_offset(header_t *head)
+{
+    return slots_offset(head) + head->slots * sizeof(ejson_value*);
+}
+
+static void *at(context_t *ctx, size_t offset)
+{
+    return (void*) (uintptr_t) (ctx->head.base + offset);
+}
+
+static ejson_value *value_at(context_t *ctx, size_t pos)
+{
+    return at(ctx, values_offset() + pos * sizeof(ejson_value));
+}
+
+static void flush(context_t *ctx)
+{
+    if (!ctx->failed && ctx->staged > 0)
+        if (!ctx->writer(ctx->userp, ctx->stage, ctx->staged))
+            ctx->failed = true;
+    ctx->staged = 0;
+}
+
+static void emit(context_t *ctx, const void *data, size_t len)
+{
+    const char *src = data;
+    while (len > 0) {
+        if (ctx->staged == STAGE_SIZE)
+            flush(ctx);
+        size_t cpy = STAGE_SIZE - ctx->staged;
+        if (cpy > len) cpy = len;
+        memcpy(ctx->stage + ctx->staged, src, cpy);
+        ctx->staged += cpy;
+        src += cpy;
+        len -= cpy;
+    }
+}
+
+static bool has_children(ejson_value *val)
+{
+    return (val->type == EJSON_ARRAY || val->type == EJSON_OBJECT)
+        && val->when_array.head != NULL;
+}
+
+static bool has_index(ejson_value *val)
+{
+    return val->type == EJSON_OBJECT
+        && val->when_array.index != NULL
+        && val->when_array.index->slots != NULL;
+}
+
+static bool enqueue(context_t *ctx, ejson_value *val, size_t pos)
+{
+    if (ctx->queued == ctx->capacity) {
+        size_t capacity = ctx->capacity ? 2 * ctx->capacity : 64;
+        container_t *queue = ctx->allocator->alloc(ctx->allocator->userp, capacity * sizeof(container_t));
+        if (queue == NULL)
+            return false;
+        if (ctx->queue) {
+            memcpy(queue, ctx->queue, ctx->queued * sizeof(container_t));
+            ctx->allocator->free(ctx->allocator->userp, ctx->queue, ctx->capacity * sizeof(container_t));
+        }
+        ctx->queue = queue;
+        ctx->capacity = capacity;
+    }
+    ctx->queue[ctx->queued++] = (container_t) {.val=val, .pos=pos};
+    return true;
+}
+
+typedef bool (*visit_t)(context_t *ctx, ejson_value *val, size_t pos, container_t *parent);
+
+// Visits the values in the order they have in the image. The root
+// has no parent. Containers are added to the queue by the first
+// pass, and the others go through it again.
+static bool walk(context_t *ctx, ejson_value *root, visit_t visit)
+{
+    ctx->next_block  = 1;
+    ctx->next_index  = 0;
+    ctx->next_slot   = 0;
+    ctx->next_string = 0;
+
+    if (!visit(ctx, root, 0, NULL))
+        return false;
+
+    size_t pos = 1;
+    for (size_t i = 0; i < ctx->queued; i++) {
+        container_t *parent = &ctx->queue[i];
+        for (ejson_value *child = parent->val->when_array.head; child; child = child->next)
+            if (!visit(ctx, child, pos++, parent))
+                return false;
+    }
+    return true;
+}
+
+static bool count_value(context_t *ctx, ejson_value *val, size_t pos, container_t *parent)
+{
+    (void) parent;
+
+    header_t *head = &ctx->head;
+    head->values++;
+    head->strings += val->key.size;
+    if (val->type == EJSON_STRING)
+        head->strings += val->when_string.size;
+    if (has_index(val)) {
+        head->indexes++;
+        head->slots += val->when_array.index->mask + 1;
+    }
+    if (has_children(val))
+        return enqueue(ctx, val, pos);
+    return true;
+}
+
+static const char *place_string(context_t *ctx, ejson_string str)
+{
+    if (str.base == NULL)
+        return NULL;
+    const char *base = at(ctx, strings_offset(&ctx->head) + ctx->next_string);
+    ctx->next_string += str.size;
+    return base;
+}
+
+static bool write_value(context_t *ctx, ejson_value *val, size_t pos, container_t *parent)
+{
+    ejson_value out = *val;
+
+    if (parent == NULL) {
+        out.prev   = NULL;
+        out.next   = NULL;
+        out.parent = NULL;
+    } else {
+        if (val == parent->val->when_array.head)
+            out.prev = &value_at(ctx, parent->pos)->when_array.head;
+        else
+            out.prev = &value_at(ctx, pos-1)->next;
+        out.next = val->next ? value_at(ctx, pos+1) : NULL;
+        out.parent = value_at(ctx, parent->pos);
+    }
+
+    // Keys are copied out of the dictionary
+    out.key.base = place_string(ctx, val->key);
+    out.flags &= ~EJSON_FLAG_INTERNED_KEY;
+
+    // The source isn't part of the image
+    out.src = (ejson_string) {.base=NULL, .size=0};
+    out.flags &= ~EJSON_FLAG_DIRTY;
+
+    switch (val->type) {
+
+        case EJSON_STRING:
+        out.when_string.base = place_string(ctx, val->when_string);
+        break;
+
+        case EJSON_ARRAY:
+        case EJSON_OBJECT:
+        out.flags |= EJSON_FLAG_CONTIGUOUS;
+        out.when_array.index = NULL;
+        if (has_children(val)) {
+            out.when_array.head = value_at(ctx, ctx->next_block);
+            ctx->next_block += val->when_array.size;
+        }
+        if (has_index(val)) {
+            size_t offset = indexes_offset(&ctx->head) + ctx->next_index * sizeof(ejson_keyindex);
+            out.when_array.index = at(ctx, offset);
+            ctx->next_index++;
+        }
+        break;
+
+        default:
+        break;
+    }
+
+    emit(ctx, &out, sizeof(out));
+    return true;
+}
+
+static bool write_index(context_t *ctx, ejson_value *val, size_t pos, container_t *parent)
+{
+    (void) pos;
+    (void) parent;
+
+    if (!has_index(val))
+        return true;
+
+    size_t num = val->when_array.index->mask + 1;
+    size_t offset = slots_offset(&ctx->head) + ctx->next_slot * sizeof(ejson_value*);
+    ctx->next_slot += num;
+
+    ejson_keyindex out = {
+        .arena = NULL,
+        .slots = at(ctx, offset),
+        .mask  = num - 1,
+        .dups  = val->when_array.index->dups,
+    };
+    emit(ctx, &out, sizeof(out));
+    return true;
+}
+
+static bool write_slots(context_t *ctx, ejson_value *val, size_t pos, container_t *parent)
+{
+    (void) pos;
+    (void) parent;
+
+    size_t first = ctx->next_block;
+    if (has_children(val))
+        ctx->next_block += val->when_array.size;
+
+    if (!has_index(val))
+        return true;
+
+    size_t num = val->when_array.index->mask + 1;
+    if (num > ctx->scratch_cap) {
+        uint64_t *scratch = ctx->allocator->alloc(ctx->allocator->userp, num * sizeof(uint64_t));
+        if (scratch == NULL)
+            return false;
+        if (ctx->scratch)
+            ctx->allocator->free(ctx->allocator->userp, ctx->scratch, ctx->scratch_cap * sizeof(uint64_t));
+        ctx->scratch = scratch;
+        ctx->scratch_cap = num;
+    }
+    memset(ctx->scratch, 0, num * sizeof(uint64_t));
+
+    size_t idx = 0;
+    for (ejson_value *child = val->when_array.head; child; child = child->next, idx++) {
+        size_t slot = ejson_keyindex_slot(val, child);
+        if (slot != SIZE_MAX)
+            ctx->scratch[slot] = (uintptr_t) value_at(ctx, first + idx);
+    }
+    emit(ctx, ctx->scratch, num * sizeof(uint64_t));
+    return true;
+}
+
+static bool write_strings(context_t *ctx, ejson_value *val, size_t pos, container_t *parent)
+{
+    (void) pos;
+    (void) parent;
+
+    if (val->key.base)
+        emit(ctx, val->key.base, val->key.size);
+    if (val->type == EJSON_STRING && val->when_string.base)
+        emit(ctx, val->when_string.base, val->when_string.size);
+    return true;
+}
+
+bool ejson_snapshot_write(ejson_value *val, ejson_writer writer, void *userp,
+                          const ejson_allocator *allocator)
+{
+    context_t ctx = {
+        .writer = writer,
+        .userp = userp,
+        .allocator = allocator ? allocator : &ejson_stdalloc,
+    };
+    memcpy(ctx.head.magic, MAGIC, sizeof(ctx.head.magic));
+    ctx.head.base = SNAPSHOT_BASE;
+
+    bool ok = walk(&ctx, val, count_value);
+    if (ok) {
+        size_t size = strings_offset(&ctx.head) + ctx.head.strings;
+        ctx.head.size = (size + 7) & ~(size_t) 7;
+
+        emit(&ctx, &ctx.head, sizeof(ctx.head));
+        ok = walk(&ctx, val, write_value)
+          && walk(&ctx, val, write_index)
+          && walk(&ctx, val, write_slots)
+          && walk(&ctx, val, write_strings);
+
+        static const char padding[8];
+        emit(&ctx, padding, ctx.head.size - size);
+        flush(&ctx);
+    }
+
+    if (ctx.queue)
+        ctx.allocator->free(ctx.allocator->userp, ctx.queue, ctx.capacity * sizeof(container_t));
+    if (ctx.scratch)
+        ctx.allocator->free(ctx.allocator->userp, ctx.scratch, ctx.scratch_cap * sizeof(uint64_t));
+    return ok && !ctx.failed;
+}
+
+static void *move(const void *ptr, uintptr_t delta)
+{
+    if (ptr == NULL)
+        return NULL;
+    return (void*) ((uintptr_t) ptr + delta);
+}
+
+ejson_value *ejson_snapshot_load(void *image, size_t len, ejson_error *error)
+{
+    header_t *head = image;
+    if ((uintptr_t) image % alignof(ejson_value) != 0) {
+        report(error, "Snapshot image isn't aligned");
+        return NULL;
+    }
+    if (len < sizeof(header_t) || memcmp(head->magic, MAGIC, sizeof(head->magic))) {
+        report(error, "Not a snapshot image");
+        return NULL;
+    }
+    if (head->size > len
+     || head->values == 0
+     || head->values  > len / sizeof(ejson_value)
+     || head->indexes > len / sizeof(ejson_keyindex)
+     || head->slots   > len / sizeof(ejson_value*)
+     || head->strings > len
+     || strings_offset(head) + head->strings > head->size) {
+        report(error, "Snapshot image is truncated");
+        return NULL;
+    }
+
+    char *base = image;
+    uintptr_t delta = (uintptr_t) base - head->base;
+    if (delta != 0) {
+
+        ejson_value *values = (ejson_value*) (base + values_offset());
+        for (size_t i = 0; i < head->values; i++) {
+            ejson_value *val = &values[i];
+            val->prev     = move(val->prev, delta);
+            val->next     = move(val->next, delta);
+            val->parent   = move(val->parent, delta);
+            val->key.base = move(val->key.base, delta);
+            switch (val->type) {
+
+                case EJSON_STRING:
+                val->when_string.base = move(val->when_string.base, delta);
+                break;
+
+                case EJSON_ARRAY:
+                case EJSON_OBJECT:
+                val->when_array.head  = move(val->when_array.head, delta);
+                val->when_array.index = move(val->when_array.index, delta);
+                break;
+
+                default:
+                break;
+            }
+        }
+
+        ejson_keyindex *indexes = (ejson_keyindex*) (base + indexes_offset(head));
+        for (size_t i = 0; i < head->indexes; i++)
+            indexes[i].slots = move(indexes[i].slots, delta);
+
+        ejson_value **slots = (ejson_value**) (base + slots_offset(head));
+        for (size_t i = 0; i < head->slots; i++)
+            slots[i] = move(slots[i], delta);
+
+        head->base = (uintptr_t) base;
+    }
+
+    return (ejson_value*) (base + values_offset());
+}
+
+bool ejson_snapshot_open(const char *path, ejson_snapshot *snap, ejson_error *error)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        report(error, "Couldn't open '%s'", path);
+        return false;
+    }
+
+    struct stat info;
+    header_t head;
+    if (fstat(fd, &info) < 0 || pread(fd, &head, sizeof(head), 0) != sizeof(head)) {
+        report(error, "Couldn't read '%s'", path);
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+
+    // Mapped privately, so that relocating the image doesn't
+    // change the file. The address the image was written for
+    // is tried first.
+    void *hint = (void*) (uintptr_t) head.base;
+    int flags = MAP_PRIVATE;
+#ifdef MAP_FIXED_NOREPLACE
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    void *addr = mmap(hint, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (addr == MAP_FAILED)
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        report(error, "Couldn't map '%s'", path);
+        return false;
+    }
+
+    ejson_value *root = ejson_snapshot_load(addr, size, error);
+    if (root == NULL) {
+        munmap(addr, size);
+        return false;
+    }
+
+    snap->root = root;
+    snap->base = addr;
+    snap->size = size;
+    return true;
+}
+
+void ejson_snapshot_close(ejson_snapshot *snap)
+{
+    munmap(snap->base, snap->size);
+    snap->root = NULL;
+    snap->base = NULL;
+    snap->size = 0;
+}
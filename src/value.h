@@ -0,0 +1,107 @@
+#ifndef EJSON_VALUE_H
+#define EJSON_VALUE_H
+
+#include "ejson.h"
+
+#define EMPTY_STRING ((ejson_string) {.base=NULL, .size=0})
+
+static inline void init_val_for_str(ejson_value *val, ejson_string str)
+{
+    val->prev = NULL;
+    val->next = NULL;
+    val->parent = NULL;
+    val->flags = 0;
+    val->type = EJSON_STRING;
+    val->key  = EMPTY_STRING;
+    val->src  = EMPTY_STRING;
+    val->when_string = str;
+}
+
+static inline void init_val_for_obj(ejson_value *val, ejson_value *head, size_t size)
+{
+    val->prev = NULL;
+    val->next = NULL;
+    val->parent = NULL;
+    val->flags = 0;
+    val->type = EJSON_OBJECT;
+    val->key  = EMPTY_STRING;
+    val->src  = EMPTY_STRING;
+    val->when_array.head = head;
+    val->when_array.size = size;
+    val->when_array.index = NULL;
+    val->when_array.hash  = 0;
+}
+
+static inline void init_val_for_arr(ejson_value *val, ejson_value *head, size_t size)
+{
+    val->prev = NULL;
+    val->next = NULL;
+    val->parent = NULL;
+    val->flags = 0;
+    val->type = EJSON_ARRAY;
+    val->key  = EMPTY_STRING;
+    val->src  = EMPTY_STRING;
+    val->when_array.head = head;
+    val->when_array.size = size;
+    val->when_array.index = NULL;
+    val->when_array.hash  = 0;
+}
+
+static inline void init_val_for_num(ejson_value *val, ejson_number num)
+{
+    val->prev = NULL;
+    val->next = NULL;
+    val->parent = NULL;
+    val->flags = 0;
+    val->type = EJSON_NUMBER;
+    val->key  = EMPTY_STRING;
+    val->src  = EMPTY_STRING;
+    val->when_number = num;
+}
+
+static inline void init_val_for_null(ejson_value *val)
+{
+    val->prev = NULL;
+    val->next = NULL;
+    val->parent = NULL;
+    val->flags = 0;
+    val->type = EJSON_NULL;
+    val->key  = EMPTY_STRING;
+    val->src  = EMPTY_STRING;
+}
+
+static inline void init_val_for_true(ejson_value *val)
+{
+    val->prev = NULL;
+    val->next = NULL;
+    val->parent = NULL;
+    val->flags = 0;
+    val->type = EJSON_BOOLEAN;
+    val->key  = EMPTY_STRING;
+    val->src  = EMPTY_STRING;
+    val->when_boolean = 1;
+}
+
+static inline void init_val_for_false(ejson_value *val)
+{
+    val->prev = NULL;
+    val->next = NULL;
+    val->parent = NULL;
+    val->flags = 0;
+    val->type = EJSON_BOOLEAN;
+    val->key  = EMPTY_STRING;
+    val->src  = EMPTY_STRING;
+    val->when_boolean = 0;
+}
+
+// Links the children of a container back to it
+static inline void adopt_children(ejson_value *val)
+{
+    ejson_value *head = val->when_array.head;
+    if (head)
+        head->prev = &val->when_array.head;
+    for (ejson_value *child = head; child; child = child->next)
+        child->parent = val;
+}
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "walk.h"
+#include "scan.h"
+#include "parse.h"
+
+static bool is_printable(char c)
+{
+    return c >= 32 && c < 127;
+}
+
+static void report(ejson_error *error, const char *fmt, ...)
+{
+    if (!error)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error->msg, sizeof(error->msg), fmt, args);
+    va_end(args);
+}
+
+static void consume_spaces(ejson_walker *w)
+{
+    w->cur = ejson_scan_spaces(w->src, w->cur, w->len);
+}
+
+// The bracket scanner doesn't know about single quoted
+// strings, so those sources are measured instead.
+static bool can_skip_rest(ejson_walker *w)
+{
+    return !w->config.allow_single_quoted_strings;
+}
+
+// Moves past the closing bracket of the array or
+// object the cursor is in.
+static bool skip_rest(ejson_walker *w, char open)
+{
+    w->cur = ejson_scan_skip(w->src, w->cur, w->len);
+    if (w->cur == w->len) {
+        report(w->error, "Source end in %s", open == '[' ? "array" : "object");
+        return false;
+    }
+    w->cur++; // Consume the "]" or "}"
+    return true;
+}
+
+bool ejson_walk_skip(ejson_walker *w)
+{
+    char c = w->src[w->cur];
+    if ((c == '[' || c == '{') && can_skip_rest(w)) {
+        w->cur++;
+        return skip_rest(w, c);
+    }
+
+    size_t end;
+    if (!ejson_measure(w->src + w->cur, w->len - w->cur, &end,
+                       w->error, w->config, NULL, NULL))
+        return false;
+    w->cur += end;
+    return true;
+}
+
+bool ejson_walk_value(ejson_walker *w, const void *node)
+{
+    consume_spaces(w);
+    if (w->cur == w->len) {
+        report(w->error, "Missing value");
+        return false;
+    }
+
+    if (node == NULL)
+        return ejson_walk_skip(w);
+    return w->value(w, node);
+}
+
+bool ejson_walk_array(ejson_walker *w, const ejson_walk_children *children, void *state)
+{
+    w->cur++; // Consume the "["
+
+    consume_spaces(w);
+    if (w->cur == w->len) {
+        report(w->error, "Source end in array");
+        return false;
+    }
+    if (w->src[w->cur] == ']') {
+        w->cur++; // Consume the "]"
+        return true;
+    }
+
+    for (size_t index = 0;; index++) {
+
+        const void *node = children->child(state, index, (ejson_string) {0}, false);
+        if (!ejson_walk_value(w, node))
+            return false;
+
+        consume_spaces(w);
+        if (w->cur == w->len) {
+            report(w->error, "Source end in array (after value)");
+            return false;
+        }
+        char c = w->src[w->cur];
+        if (c == ']') {
+            w->cur++;
+            return true;
+        }
+        if (c != ',') {
+            if (is_printable(c))
+                report(w->error, "Missing ',' or ']' after value (character '%c' instead)", c);
+            else
+                report(w->error, "Invalid byte %x in array (after value)", c);
+            return false;
+        }
+        w->cur++; // Consume the ","
+
+        if (children->done(state) && can_skip_rest(w))
+            return skip_rest(w, '[');
+    }
+}
+
+bool ejson_walk_object(ejson_walker *w, const ejson_walk_children *children, void *state)
+{
+    w->cur++; // Consume the "{"
+
+    consume_spaces(w);
+    if (w->cur == w->len) {
+        report(w->error, "Source end in object");
+        return false;
+    }
+    if (w->src[w->cur] == '}') {
+        w->cur++; // Consume the "}"
+        return true;
+    }
+
+    for (;;) {
+        char c = w->src[w->cur];
+        if (c != '"') {
+            if (is_printable(c))
+                report(w->error, "Missing key (character '%c' instead)", c);
+            else
+                report(w->error, "Invalid byte %x in object", c);
+            return false;
+        }
+
+        ejson_string key;
+        bool escaped;
+        if (!ejson_lex_string(w->src, w->len, &w->cur, w->error, &key, &escaped))
+            return false;
+
+        consume_spaces(w);
+        if (w->cur == w->len) {
+            report(w->error, "Source end in object (after key)");
+            return false;
+        }
+        c = w->src[w->cur];
+        if (c != ':') {
+            if (is_printable(c))
+                report(w->error, "Missing ':' after key (character '%c' instead)", c);
+            else
+                report(w->error, "Invalid byte %x in object (after key)", c);
+            return false;
+        }
+        w->cur++; // Consume the ":"
+
+        const void *node = children->child(state, 0, key, escaped);
+        if (!ejson_walk_value(w, node))
+            return false;
+
+        consume_spaces(w);
+        if (w->cur == w->len) {
+            report(w->error, "Source end in object (after value)");
+            return false;
+        }
+        c = w->src[w->cur];
+        if (c == '}') {
+            w->cur++;
+            return true;
+        }
+        if (c != ',') {
+            if (is_printable(c))
+                report(w->error, "Missing ',' or '}' after value (character '%c' instead)", c);
+            else
+                report(w->error, "Invalid byte %x in object (after value)", c);
+            return false;
+        }
+        w->cur++; // Consume the ","
+
+        if (children->done(state) && can_skip_rest(w))
+            return skip_rest(w, '{');
+
+        consume_spaces(w);
+        if (w->cur == w->len) {
+            report(w->error, "Source end in object (after '%c')", c);
+            return false;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef EJSON_WALK_H
+#define EJSON_WALK_H
+
+#include "ejson.h"
+
+// Walks a source without building it, for the parsers that only
+// need some of its values. The path to those values is checked as
+// strictly as by the parser, but skipped arrays and objects only
+// need balanced brackets and closed strings. What each value leads
+// to is an opaque node of the caller, which decides how to walk it.
+
+typedef struct ejson_walker ejson_walker;
+struct ejson_walker {
+    ejson_error *error;
+    const char  *src;
+    size_t       cur;
+    size_t       len;
+    ejson_config config;
+    void        *userp;
+
+    // Walks the value at the cursor, which "node" leads to. Values
+    // no node leads to are skipped without calling it.
+    bool (*value)(ejson_walker *walker, const void *node);
+};
+
+// Children the caller wants from the array or object being walked.
+// "state" belongs to the caller and is passed to both callbacks.
+typedef struct {
+    // Node the child leads to, or NULL when it isn't needed. Arrays
+    // pass the index of the element, and objects the key of the
+    // member, which is still escaped if "escaped".
+    const void *(*child)(void *state, size_t index, ejson_string key, bool escaped);
+
+    // Whether none of the children after those seen so far is
+    // needed, so that the rest of the container can be skipped
+    bool (*done)(void *state);
+} ejson_walk_children;
+
+// Walks the value at the cursor, after any whitespace, passing it
+// to the callback of the walker or skipping it if "node" is NULL
+bool ejson_walk_value(ejson_walker *walker, const void *node);
+
+// Moves past the value at the cursor
+bool ejson_walk_skip(ejson_walker *walker);
+
+// Walk the array or object at the cursor, whose first character is
+// "[" or "{", and each of its children through "children".
+bool ejson_walk_array (ejson_walker *walker, const ejson_walk_children *children, void *state);
+bool ejson_walk_object(ejson_walker *walker, const ejson_walk_children *children, void *state);
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "ejson.h"
+
+// Parses into fixed arenas whose buffers start at every offset
+// from an aligned address, and checks that every value is aligned
+// and equal to the one parsed into a growable arena.
+
+static const char src[] =
+    "{\"name\": \"test\", \"values\": [1, 2.5, -3, true, false, null],"
+    " \"nested\": {\"a\": [[], {}, [{\"b\": \"c\"}]], \"d\": \"\\u00e9\"},"
+    " \"list\": [{\"x\": 1}, {\"x\": 2}, {\"x\": 3}]}";
+
+static bool all_aligned(ejson_value *val)
+{
+    if ((uintptr_t) val % alignof(ejson_value) != 0)
+        return false;
+    if (val->type != EJSON_ARRAY && val->type != EJSON_OBJECT)
+        return true;
+    for (ejson_value *child = val->when_array.head; child; child = child->next)
+        if (!all_aligned(child))
+            return false;
+    return true;
+}
+
+int main(void)
+{
+    ejson_error error;
+    ejson_arena ref_arena = {.allocator=&ejson_stdalloc};
+    ejson_value *ref = ejson_parse(src, strlen(src), &error, &ref_arena);
+    if (ref == NULL) {
+        fprintf(stderr, "Error: %s\n", error.msg);
+        return -1;
+    }
+
+    static alignas(max_align_t) char mem[1 << 16];
+    int fails = 0;
+    for (size_t offset = 0; offset < alignof(max_align_t); offset++) {
+        for (int contiguous = 0; contiguous < 2; contiguous++) {
+            ejson_config config = EJSON_DEFAULT_CONFIGS;
+            config.contiguous_children = contiguous;
+
+            // The size is odd too, so that the end isn't aligned either
+            ejson_arena arena = {.base=mem + offset, .size=sizeof(mem) - 2*offset - 1};
+            ejson_value *val = ejson_parse2(src, strlen(src), NULL, &error, &arena, config);
+            if (val == NULL || !all_aligned(val) || !ejson_valcmp(val, ref)) {
+                fprintf(stderr, "Failed at offset %zu%s: %s\n", offset,
+                        contiguous ? " with contiguous children" : "",
+                        val ? "misaligned or different value" : error.msg);
+                fails++;
+            }
+        }
+    }
+
+    ejson_arena_free(&ref_arena);
+    if (fails > 0)
+        return -1;
+    printf("align: ok\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+#include "ejson.h"
+
+// Feeds every source of the corpus to the incremental parser in
+// chunks of several sizes, and checks that it agrees with ejson_parse2
+// on the value, on where it ends, and on the error message.
+
+static const char *corpus[] = {
+    // Valid
+    "null", "true", "false", "0", "-0", "7", "-12", "3.25", "-0.5e-3",
+    "1E+10", "2e5", "123456789012345678901234567890", "9223372036854775807",
+    "-9223372036854775808", "\"\"", "\"abc\"", "\"a\\\"b\"", "\"\\\\\"",
+    "\"\\u00e9\\ud83d\\ude00\\n\"", "[]", "{}", "[ ]", "{ }", "  [1 , 2 ]  ",
+    "[1,2.5,-3,true,false,null]", "{\"\":0}", "{\"a\\\"b\":[{}]}",
+    "{\"name\": \"test\", \"values\": [1, 2.5, -3, true, false, null],"
+    " \"nested\": {\"a\": [[], {}, [{\"b\": \"c\"}]], \"d\": \"\\u00e9\"},"
+    " \"list\": [{\"x\": 1}, {\"x\": 2}, {\"x\": 3}]}",
+    "'abc'", "['a\\'b', \"c\"]",
+
+    // Valid, with bytes left after the value
+    "01", "-01", "1-2", "0e1-", "1.5.2", "[1] x", "null,", "\"a\"b",
+
+    // Invalid
+    "", "   ", "-", "-x", "1.", "1.e", "1e", "1e+", "1ex", "-]", "1e999",
+    "-1e999", "[01]", "[1-2]", "[1.]", "[1e]", "[-]", "[1e999]", "tru",
+    "nul x", "[tru]", "[nulx]", "[Null]", "]", "}", ",", ":", "[", "{",
+    "[1", "[1,", "[1 2]", "[1,]", "{\"a\"", "{\"a\":", "{\"a\" 1}", "{\"a\":1",
+    "{\"a\":1,", "{\"a\":1,}", "{\"a\":1 \"b\":2}", "{1:2}", "{'a':1}",
+    "\"abc", "\"\\x\"", "\"\\u12\"", "\"\\u12", "\"\\", "\"\\\"", "'abc",
+    "['a\\x']", "\x01", "[\x01]", "{\x01}", "{\"a\"\x01}", "[1\x01]", "1\x01",
+    "1e\x01", "[[[[[[", "[[[]]]]",
+};
+
+typedef struct {
+    ejson_value *root;
+    size_t       end;
+    char         msg[sizeof(((ejson_error*) 0)->msg)];
+} result_t;
+
+static void parse_whole(const char *src, size_t len, ejson_config config,
+                        ejson_arena *arena, result_t *res)
+{
+    ejson_error error = {0};
+    res->end = 0;
+    res->root = ejson_parse2(src, len, &res->end, &error, arena, config);
+    strcpy(res->msg, error.msg);
+}
+
+static void parse_chunks(const char *src, size_t len, size_t chunk, ejson_config config,
+                         ejson_arena *arena, result_t *res)
+{
+    ejson_error error = {0};
+    ejson_parser parser;
+    ejson_parser_init(&parser, &error, arena, config);
+
+    res->root = NULL;
+    res->end = 0;
+
+    ejson_feedresult status = EJSON_FEED_MORE;
+    size_t off = 0;
+    while (off < len && status == EJSON_FEED_MORE) {
+        size_t num = (len - off < chunk) ? len - off : chunk;
+        status = ejson_feed(&parser, src + off, num);
+        res->end = off + parser.end;
+        off += num;
+    }
+    if (status == EJSON_FEED_MORE)
+        status = ejson_feed(&parser, "", 0);
+
+    if (status == EJSON_FEED_DONE)
+        res->root = parser.root;
+    strcpy(res->msg, error.msg);
+}
+
+static bool agree(result_t *whole, result_t *fed)
+{
+    if (whole->root == NULL || fed->root == NULL)
+        return whole->root == fed->root && !strcmp(whole->msg, fed->msg);
+    return whole->end == fed->end && ejson_valcmp(whole->root, fed->root);
+}
+
+int main(void)
+{
+    static const size_t chunks[] = {1, 2, 3, 5, 8, SIZE_MAX};
+
+    int fails = 0;
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++) {
+        for (int single = 0; single < 2; single++) {
+            ejson_config config = EJSON_DEFAULT_CONFIGS;
+            config.allow_single_quoted_strings = single;
+
+            const char *src = corpus[i];
+            size_t      len = strlen(src);
+
+            ejson_arena whole_arena = {.allocator=&ejson_stdalloc};
+            result_t whole;
+            parse_whole(src, len, config, &whole_arena, &whole);
+
+            for (size_t j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+                ejson_arena fed_arena = {.allocator=&ejson_stdalloc};
+                result_t fed;
+                parse_chunks(src, len, chunks[j], config, &fed_arena, &fed);
+                if (!agree(&whole, &fed)) {
+                    fprintf(stderr, "Failed on '%s'%s in chunks of %zu:\n"
+                            "    parse: %s (end %zu)\n    feed:  %s (end %zu)\n",
+                            src, single ? " with single quotes" : "", chunks[j],
+                            whole.root ? "ok" : whole.msg, whole.end,
+                            fed.root ? "ok" : fed.msg, fed.end);
+                    fails++;
+                }
+                ejson_arena_free(&fed_arena);
+            }
+            ejson_arena_free(&whole_arena);
+        }
+    }
+
+    if (fails > 0)
+        return -1;
+    printf("feed: ok\n");
+    return 0;
+}